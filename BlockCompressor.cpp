@@ -0,0 +1,431 @@
+/*
+This is the source file for the block compressor used by the SocketBuffer class for compressed sessions.
+Details are explained on GitHub: https://github.com/viktor-nikolov/lwIP-file-via-socket
+
+BSD 2-Clause License:
+
+Copyright (c) 2024 Viktor Nikolov
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+#include "BlockCompressor.h"
+#include <algorithm>
+#include <cstring>
+
+namespace {
+const std::size_t MIN_MATCH = 4;
+const std::size_t LAST_LITERALS = 5; // The LZ4 format requires the last 5 bytes of a block to be literals
+const std::size_t MF_LIMIT = 12;     // and the last match to start at least 12 bytes before the end of a block
+const std::size_t MAX_OFFSET = 65535;
+const std::size_t GOOD_MATCH = 16;  // A match in the block, which is this long, isn't compared with the dictionary
+
+inline std::uint32_t read32( const std::uint8_t *p ) {
+	std::uint32_t v;
+	memcpy( &v, p, sizeof(v) ); // memcpy avoids unaligned access issues
+	return v;
+}
+
+inline std::uint32_t hash32( std::uint32_t v, int bits ) {
+	return (v * 2654435761U) >> (32 - bits);
+}
+
+// Returns the number of equal bytes of a and b, comparing a up to the limit
+inline std::size_t matchLength( const std::uint8_t *a, const std::uint8_t *b, const std::uint8_t *limit ) {
+	const std::uint8_t *start = a;
+	while( a < limit && *a == *b ) {
+		a++;
+		b++;
+	}
+	return std::size_t(a - start);
+}
+
+// Writes the length, which didn't fit in the 4 bits of the token, as a sequence of bytes
+inline std::uint8_t *writeLength( std::uint8_t *op, std::size_t len ) {
+	for( ; len >= 255; len -= 255 )
+		*op++ = 255;
+	*op++ = std::uint8_t(len);
+	return op;
+}
+
+/* Writes one LZ4 sequence, i.e., literals followed by a match.
+ * matchLen == 0 means the last sequence of the block, which contains only literals. */
+std::uint8_t *writeSequence( std::uint8_t *op, const std::uint8_t *literals, std::size_t litLen,
+                             std::size_t offset, std::size_t matchLen )
+{
+	std::uint8_t *token = op++;
+	if( litLen >= 15 ) {
+		*token = 15 << 4;
+		op = writeLength( op, litLen - 15 );
+	} else
+		*token = std::uint8_t(litLen << 4);
+	memcpy( op, literals, litLen );
+	op += litLen;
+
+	if( matchLen == 0 )
+		return op;
+
+	*op++ = std::uint8_t(offset);
+	*op++ = std::uint8_t(offset >> 8);
+	std::size_t ml = matchLen - MIN_MATCH;
+	if( ml >= 15 ) {
+		*token |= 15;
+		op = writeLength( op, ml - 15 );
+	} else
+		*token |= std::uint8_t(ml);
+	return op;
+} // writeSequence
+} // namespace
+
+BlockCompressor::BlockCompressor()
+	: FastTable( std::size_t(1) << FAST_HASH_BITS ), ChainHead( std::size_t(1) << STRONG_HASH_BITS ),
+	  ChainPrev( MAX_BLOCK_SIZE )
+{
+} // BlockCompressor::BlockCompressor
+
+std::size_t BlockCompressor::compress( Level level, const char *src, std::size_t n, char *dst, std::size_t dstCapacity )
+{
+	if( level == Level::None || n == 0 || n > MAX_BLOCK_SIZE || dstCapacity < maxCompressedSize(n) )
+		return 0;
+
+	const std::uint8_t *in = reinterpret_cast<const std::uint8_t*>(src);
+	std::uint8_t *out = reinterpret_cast<std::uint8_t*>(dst);
+	std::size_t compressedSize = level == Level::Fast ? compressFast( in, n, out ) : compressStrong( in, n, out );
+
+	return compressedSize < n ? compressedSize : 0; // Incompressible data are sent raw
+} // BlockCompressor::compress
+
+std::size_t BlockCompressor::compressFast( const std::uint8_t *src, std::size_t n, std::uint8_t *dst )
+{
+	const std::uint8_t *ip = src;
+	const std::uint8_t *anchor = src; // Start of the literals not written yet
+	const std::uint8_t *const end = src + n;
+	std::uint8_t *op = dst;
+
+	if( n > MF_LIMIT ) { // Shorter blocks are stored as literals only
+		const std::uint8_t *const mfLimit = end - MF_LIMIT;
+		const std::uint8_t *const matchLimit = end - LAST_LITERALS;
+		std::fill( FastTable.begin(), FastTable.end(), std::uint16_t(0) );
+		unsigned misses{0}; // We skip faster through data where we don't find matches
+
+		ip++;
+		while( ip < mfLimit ) {
+			std::uint32_t sequence = read32( ip );
+			std::uint32_t h = hash32( sequence, FAST_HASH_BITS );
+			const std::uint8_t *ref = src + FastTable[h];
+			FastTable[h] = std::uint16_t(ip - src);
+
+			if( ref >= ip || std::size_t(ip - ref) > MAX_OFFSET || read32( ref ) != sequence ) {
+				ip += 1 + (misses++ >> 6);
+				continue;
+			}
+			misses = 0;
+
+			while( ip > anchor && ref > src && ip[-1] == ref[-1] ) { // Extend the match backwards
+				ip--;
+				ref--;
+			}
+			std::size_t len = MIN_MATCH + matchLength( ip + MIN_MATCH, ref + MIN_MATCH, matchLimit );
+			op = writeSequence( op, anchor, std::size_t(ip - anchor), std::size_t(ip - ref), len );
+			ip += len;
+			anchor = ip;
+
+			if( ip < mfLimit ) // Position inside of the match helps to find the next match
+				FastTable[ hash32( read32( ip - 2 ), FAST_HASH_BITS ) ] = std::uint16_t(ip - 2 - src);
+		}
+	}
+
+	op = writeSequence( op, anchor, std::size_t(end - anchor), 0, 0 );
+	return std::size_t(op - dst);
+} // BlockCompressor::compressFast
+
+std::size_t BlockCompressor::compressStrong( const std::uint8_t *src, std::size_t n, std::uint8_t *dst )
+{
+	const std::uint8_t *ip = src;
+	const std::uint8_t *anchor = src; // Start of the literals not written yet
+	const std::uint8_t *const end = src + n;
+	std::uint8_t *op = dst;
+
+	if( n > MF_LIMIT ) { // Shorter blocks are stored as literals only
+		const std::uint8_t *const mfLimit = end - MF_LIMIT;
+		const std::uint8_t *const matchLimit = end - LAST_LITERALS;
+		const std::uint8_t *nextToInsert = src; // Positions before this one are in the hash chains
+		std::fill( ChainHead.begin(), ChainHead.end(), -1 );
+
+		// Finds the longest match for position p; returns its length (0 if none found)
+		auto findBest = [&]( const std::uint8_t *p, const std::uint8_t *&bestRef ) -> std::size_t {
+			for( ; nextToInsert < p; nextToInsert++ ) {
+				std::int32_t pos = std::int32_t(nextToInsert - src);
+				std::uint32_t h = hash32( read32( nextToInsert ), STRONG_HASH_BITS );
+				ChainPrev[pos] = ChainHead[h];
+				ChainHead[h] = pos;
+			}
+
+			std::size_t best{0};
+			std::uint32_t sequence = read32( p );
+			std::int32_t candidate = ChainHead[ hash32( sequence, STRONG_HASH_BITS ) ];
+			for( int attempts = 0; candidate >= 0 && attempts < STRONG_MAX_ATTEMPTS; attempts++ ) {
+				const std::uint8_t *ref = src + candidate;
+				if( std::size_t(p - ref) > MAX_OFFSET )
+					break;
+				if( read32( ref ) == sequence ) {
+					std::size_t len = MIN_MATCH + matchLength( p + MIN_MATCH, ref + MIN_MATCH, matchLimit );
+					if( len > best ) {
+						best = len;
+						bestRef = ref;
+					}
+				}
+				candidate = ChainPrev[candidate];
+			}
+			return best;
+		};
+
+		while( ip < mfLimit ) {
+			const std::uint8_t *ref = nullptr;
+			std::size_t len = findBest( ip, ref );
+			if( len < MIN_MATCH ) {
+				ip++;
+				continue;
+			}
+
+			// Lazy matching: we prefer a longer match starting at the next position
+			if( ip + 1 < mfLimit ) {
+				const std::uint8_t *ref2 = nullptr;
+				std::size_t len2 = findBest( ip + 1, ref2 );
+				if( len2 > len ) {
+					ip++;
+					ref = ref2;
+					len = len2;
+				}
+			}
+
+			op = writeSequence( op, anchor, std::size_t(ip - anchor), std::size_t(ip - ref), len );
+			ip += len;
+			anchor = ip;
+		}
+	}
+
+	op = writeSequence( op, anchor, std::size_t(end - anchor), 0, 0 );
+	return std::size_t(op - dst);
+} // BlockCompressor::compressStrong
+
+void BlockCompressor::setDictionary( const void *dictionary, std::size_t size )
+{
+	const std::uint8_t *data = static_cast<const std::uint8_t*>(dictionary);
+	if( size > MAX_DICTIONARY_SIZE ) { // The end of the dictionary is the closest to the data, so we keep it
+		data += size - MAX_DICTIONARY_SIZE;
+		size = MAX_DICTIONARY_SIZE;
+	}
+	if( data == Dictionary && size == DictionarySize )
+		return;
+
+	Dictionary = data;
+	DictionarySize = size;
+	DictTable.assign( std::size_t(1) << FAST_HASH_BITS, 0 );
+	BlockTable.assign( std::size_t(1) << FAST_HASH_BITS, 0 );
+	BlockBase = 0;
+	// The later positions overwrite the earlier ones, so the matches prefer the end of the dictionary
+	for( std::size_t pos = 0; pos + MIN_MATCH <= size; pos++ )
+		DictTable[ hash32( read32( data + pos ), FAST_HASH_BITS ) ] = std::uint16_t(pos + 1);
+} // BlockCompressor::setDictionary
+
+std::uint32_t BlockCompressor::dictionaryId( const void *dictionary, std::size_t size )
+{
+	const std::uint8_t *data = static_cast<const std::uint8_t*>(dictionary);
+	if( size > MAX_DICTIONARY_SIZE ) { // The part used by setDictionary()
+		data += size - MAX_DICTIONARY_SIZE;
+		size = MAX_DICTIONARY_SIZE;
+	}
+	std::uint32_t hash = 2166136261U;
+	for( std::size_t i = 0; i < size; i++ )
+		hash = (hash ^ data[i]) * 16777619U;
+	return hash;
+} // BlockCompressor::dictionaryId
+
+std::size_t BlockCompressor::compressWithDictionary( const char *src, std::size_t n, char *dst, std::size_t dstCapacity )
+{
+	if( DictionarySize == 0 ) // No dictionary; an empty dictionary is the plain LZ4 block format
+		return compress( Level::Fast, src, n, dst, dstCapacity );
+	if( n == 0 || n > MAX_BLOCK_SIZE || dstCapacity < maxCompressedSize(n) )
+		return 0;
+
+	std::size_t compressedSize = compressDictionary( reinterpret_cast<const std::uint8_t*>(src), n,
+	                                                 reinterpret_cast<std::uint8_t*>(dst) );
+	return compressedSize < n ? compressedSize : 0; // Incompressible data are sent raw
+} // BlockCompressor::compressWithDictionary
+
+std::size_t BlockCompressor::compressDictionary( const std::uint8_t *src, std::size_t n, std::uint8_t *dst )
+{
+	const std::uint8_t *ip = src;
+	const std::uint8_t *anchor = src; // Start of the literals not written yet
+	const std::uint8_t *const end = src + n;
+	const std::uint8_t *const dictEnd = Dictionary + DictionarySize;
+	std::uint8_t *op = dst;
+
+	if( BlockBase > 0xFFFFFFFFU - MAX_BLOCK_SIZE - 1 ) { // The positions would overflow; we start over
+		std::fill( BlockTable.begin(), BlockTable.end(), 0U );
+		BlockBase = 0;
+	}
+
+	if( n > MF_LIMIT ) { // Shorter blocks are stored as literals only
+		const std::uint8_t *const mfLimit = end - MF_LIMIT;
+		const std::uint8_t *const matchLimit = end - LAST_LITERALS;
+		unsigned misses{0}; // We skip faster through data where we don't find matches
+
+		while( ip < mfLimit ) {
+			std::uint32_t sequence = read32( ip );
+			std::uint32_t h = hash32( sequence, FAST_HASH_BITS );
+			std::uint32_t blockEntry = BlockTable[h];
+			BlockTable[h] = BlockBase + std::uint32_t(ip - src) + 1;
+
+			// A match in this block
+			const std::uint8_t *blockRef = nullptr;
+			std::size_t blockLen{0};
+			if( blockEntry > BlockBase ) {
+				const std::uint8_t *ref = src + (blockEntry - BlockBase - 1);
+				if( read32( ref ) == sequence ) {
+					blockRef = ref;
+					blockLen = MIN_MATCH + matchLength( ip + MIN_MATCH, blockRef + MIN_MATCH, matchLimit );
+				}
+			}
+			// A match in the dictionary (the dictionary ends right before the block), unless the block has a long one
+			const std::uint8_t *dictRef = nullptr;
+			std::size_t dictLen{0};
+			if( blockLen < GOOD_MATCH && DictTable[h] != 0 ) {
+				const std::uint8_t *ref = Dictionary + DictTable[h] - 1;
+				if( std::size_t(ip - src) + std::size_t(dictEnd - ref) <= MAX_OFFSET && read32( ref ) == sequence )
+					dictRef = ref;
+			}
+			if( blockRef == nullptr && dictRef == nullptr ) {
+				ip += 1 + (misses++ >> 6);
+				continue;
+			}
+			misses = 0;
+
+			if( dictRef ) {
+				// The match may continue from the end of the dictionary to the start of the block
+				const std::uint8_t *limit = std::size_t(dictEnd - dictRef) < std::size_t(matchLimit - ip)
+				                            ? ip + (dictEnd - dictRef) : matchLimit;
+				dictLen = MIN_MATCH + matchLength( ip + MIN_MATCH, dictRef + MIN_MATCH, limit );
+				if( ip + dictLen == limit && limit < matchLimit )
+					dictLen += matchLength( ip + dictLen, src, matchLimit );
+			}
+
+			std::size_t len, offset;
+			const std::uint8_t *start = ip;
+			if( blockLen >= dictLen ) {
+				while( ip > anchor && blockRef > src && ip[-1] == blockRef[-1] ) { // Extend the match backwards
+					ip--;
+					blockRef--;
+				}
+				offset = std::size_t(ip - blockRef);
+				len = blockLen;
+			} else {
+				while( ip > anchor && dictRef > Dictionary && ip[-1] == dictRef[-1] ) {
+					ip--;
+					dictRef--;
+				}
+				offset = std::size_t(ip - src) + std::size_t(dictEnd - dictRef);
+				len = dictLen;
+			}
+			len += std::size_t(start - ip);
+			op = writeSequence( op, anchor, std::size_t(ip - anchor), offset, len );
+			ip += len;
+			anchor = ip;
+
+			if( ip < mfLimit ) // Position inside of the match helps to find the next match
+				BlockTable[ hash32( read32( ip - 2 ), FAST_HASH_BITS ) ] = BlockBase + std::uint32_t(ip - 2 - src) + 1;
+		}
+	}
+	BlockBase += std::uint32_t(n);
+
+	op = writeSequence( op, anchor, std::size_t(end - anchor), 0, 0 );
+	return std::size_t(op - dst);
+} // BlockCompressor::compressDictionary
+
+void BlockCompressor::recordBlock( Level level, std::size_t rawBytes, std::size_t wireBytes,
+                                   std::uint64_t compressNs, std::uint64_t sendNs )
+{
+	if( level != CurrentLevel ) // The block was compressed before the level changed
+		return;
+
+	WindowRaw += rawBytes;
+	WindowWire += wireBytes;
+	WindowCompressNs += compressNs;
+	WindowSendNs += sendNs;
+	if( ++BlocksInWindow >= WINDOW_BLOCKS )
+		chooseLevel();
+} // BlockCompressor::recordBlock
+
+void BlockCompressor::chooseLevel()
+{
+	const double ALPHA = 0.5; // Weight of the last window in the moving averages
+	const int current = int(CurrentLevel);
+
+	if( CurrentLevel != Level::None && WindowRaw > 0 ) {
+		double c = double(WindowCompressNs) / double(WindowRaw);
+		double r = double(WindowWire) / double(WindowRaw);
+		CompressCost[current] = CompressCost[current] < 0 ? c : ALPHA * c + (1 - ALPHA) * CompressCost[current];
+		Ratio[current] = Ratio[current] < 0 ? r : ALPHA * r + (1 - ALPHA) * Ratio[current];
+	}
+	/* The send cost is the ratio of the sums over roughly the last SEND_HISTORY_BYTES on the wire. A blocking send()
+	 * waits till a big part of the socket's send buffer drains (Linux wakes the writer when a third of it is free),
+	 * so a single window may contain no waiting at all even when the link is the bottleneck. */
+	if( WindowWire > 0 ) {
+		const double keep = double(SEND_HISTORY_BYTES) / double(SEND_HISTORY_BYTES + WindowWire);
+		SendNsSum = SendNsSum * keep + double(WindowSendNs);
+		SendWireSum = SendWireSum * keep + double(WindowWire);
+		SendCost = SendNsSum / SendWireSum;
+	}
+	BlocksInWindow = 0;
+	WindowRaw = WindowWire = WindowCompressNs = WindowSendNs = 0;
+
+	for( int l = 0; l < LEVEL_COUNT; l++ )
+		WindowsSinceUse[l]++;
+	WindowsSinceUse[current] = 0;
+
+	// The level with the lowest expected cost per raw byte (of those measured)
+	int best = 0;
+	double bestCost = CompressCost[0] + Ratio[0] * SendCost;
+	for( int l = 1; l < LEVEL_COUNT; l++ ) {
+		if( CompressCost[l] < 0 )
+			continue;
+		double cost = CompressCost[l] + Ratio[l] * SendCost;
+		if( cost < bestCost ) {
+			best = l;
+			bestCost = cost;
+		}
+	}
+
+	/* A level, which was probed and lost, is probed less and less often (a probe of a much slower level
+	 * costs a lot on a fast link); the level, which wins, is probed at the base period again. */
+	if( Probing && best != current )
+		ProbePeriod[current] = ProbePeriod[current] * 2 < MAX_PROBE_PERIOD ? ProbePeriod[current] * 2 : MAX_PROBE_PERIOD;
+	ProbePeriod[best] = PROBE_PERIOD;
+	Probing = false;
+
+	// A level, which wasn't measured yet or not for a long time, is probed for one window
+	for( int l = int(Level::Fast); l < LEVEL_COUNT; l++ ) {
+		if( l != best && (CompressCost[l] < 0 || WindowsSinceUse[l] >= ProbePeriod[l]) ) {
+			CurrentLevel = Level(l);
+			Probing = true;
+			return;
+		}
+	}
+	CurrentLevel = Level(best);
+} // BlockCompressor::chooseLevel
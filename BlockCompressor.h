@@ -0,0 +1,131 @@
+/*
+This is the header file for the block compressor used by the SocketBuffer class for compressed sessions.
+Details are explained on GitHub: https://github.com/viktor-nikolov/lwIP-file-via-socket
+
+BSD 2-Clause License:
+
+Copyright (c) 2024 Viktor Nikolov
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+#ifndef BLOCKCOMPRESSOR_H
+#define BLOCKCOMPRESSOR_H
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+/* BlockCompressor compresses blocks of data in the LZ4 block format (so any LZ4 decoder can read them;
+ * file_via_socket.py has its own decoder). It has no dependency on an external library.
+ * Two levels are available:
+ *   Fast   - greedy matching using a single hash table; intended for fast links
+ *   Strong - hash chains with lazy matching; better ratio for slow links
+ *
+ * The adaptive mode is implemented here as well. The SocketBuffer reports, for each sent block,
+ * how much time it spent compressing and how much time it was blocked in send(). At the end of each
+ * window of blocks we pick the level with the lowest expected cost per raw byte:
+ *   cost(level) = compression time per raw byte + compression ratio * send time per wire byte
+ * When the link is the bottleneck, the send time per byte is high and compression pays off.
+ * When the CPU is the bottleneck (or the link is fast), no compression wins.
+ *
+ * Small blocks (e.g., a few hundred bytes sent by each flush) compress poorly, because each block starts
+ * with an empty history. compressWithDictionary() lets the matches of the Fast level refer also to a static
+ * dictionary (trained by train_dictionary.py), which is logically placed in front of each block. The result
+ * is the LZ4 block format with a dictionary (LZ4_decompress_safe_usingDict()). */
+class BlockCompressor {
+public:
+	enum class Level { None, Fast, Strong };
+
+	static const std::size_t MAX_BLOCK_SIZE = 16384; // Max. size of a block of raw data
+	static const std::size_t MAX_DICTIONARY_SIZE = 32768; // Longer dictionaries are cut to their last 32 KB
+
+	// Size of the output buffer needed to compress n bytes
+	static constexpr std::size_t maxCompressedSize( std::size_t n ) { return n + n / 255 + 16; }
+
+	BlockCompressor();
+
+	/* Compresses n bytes (n <= MAX_BLOCK_SIZE) from src to dst. dstCapacity must be at least
+	 * maxCompressedSize(n). Returns the compressed size, or 0 when the data didn't compress
+	 * (the caller should send the raw data then). */
+	std::size_t compress( Level level, const char *src, std::size_t n, char *dst, std::size_t dstCapacity );
+
+	/***** Static dictionary *****/
+
+	/* Sets the dictionary for compressWithDictionary(). The data aren't copied, they must stay valid
+	 * (typically a constant array generated by train_dictionary.py). Indexing the dictionary takes
+	 * time proportional to its size; setting the same dictionary again costs nothing. */
+	void setDictionary( const void *dictionary, std::size_t size );
+
+	/* Compresses n bytes against the dictionary; the parameters and the result are the same as of compress(). */
+	std::size_t compressWithDictionary( const char *src, std::size_t n, char *dst, std::size_t dstCapacity );
+
+	/* Identifier of the dictionary (FNV-1a hash of its data), by which the server finds its copy of the dictionary */
+	static std::uint32_t dictionaryId( const void *dictionary, std::size_t size );
+
+	/***** Adaptive mode *****/
+
+	// Level the adaptive mode wants to use for the next block
+	Level adaptiveLevel() const { return CurrentLevel; }
+
+	// Reports a sent block; wireBytes is the size of the data after compression
+	void recordBlock( Level level, std::size_t rawBytes, std::size_t wireBytes,
+	                  std::uint64_t compressNs, std::uint64_t sendNs );
+
+private:
+	std::size_t compressFast( const std::uint8_t *src, std::size_t n, std::uint8_t *dst );
+	std::size_t compressStrong( const std::uint8_t *src, std::size_t n, std::uint8_t *dst );
+	std::size_t compressDictionary( const std::uint8_t *src, std::size_t n, std::uint8_t *dst );
+	void chooseLevel();
+
+	static const int FAST_HASH_BITS = 12;
+	static const int STRONG_HASH_BITS = 14;
+	static const int STRONG_MAX_ATTEMPTS = 64; // How far we walk a hash chain
+
+	std::vector<std::uint16_t> FastTable;   // Position of the last occurrence of a hash (Fast level)
+	std::vector<std::int32_t>  ChainHead;   // Position of the last occurrence of a hash (Strong level)
+	std::vector<std::int32_t>  ChainPrev;   // Previous position with the same hash (Strong level)
+
+	const std::uint8_t *Dictionary{ nullptr };
+	std::size_t DictionarySize{ 0 };
+	std::vector<std::uint16_t> DictTable;   // Position in the Dictionary + 1 of the last occurrence of a hash (0 = none)
+	/* Position of the last occurrence of a hash in the block being compressed, plus BlockBase.
+	 * Entries below BlockBase belong to the previous blocks, so the table needn't be cleared for each (small) block. */
+	std::vector<std::uint32_t> BlockTable;
+	std::uint32_t BlockBase{ 0 };
+
+	/* Statistics of the adaptive mode. Costs are in ns per byte, kept as moving averages.
+	 * A negative value means the level wasn't measured yet. */
+	static const int LEVEL_COUNT = 3;
+	static const unsigned WINDOW_BLOCKS = 16;   // Number of blocks in one measurement window
+	static const unsigned PROBE_PERIOD = 32;    // A level is re-measured at least this often (in windows)...
+	static const unsigned MAX_PROBE_PERIOD = 512; // ...or, after its probes lost repeatedly, up to this often
+	static const std::uint64_t SEND_HISTORY_BYTES = 4*1024*1024; // Memory of the send cost (wire bytes)
+	double CompressCost[LEVEL_COUNT] = { 0.0, -1.0, -1.0 }; // Compression time per raw byte
+	double Ratio[LEVEL_COUNT]        = { 1.0, -1.0, -1.0 }; // Wire bytes per raw byte
+	double SendCost{ 0.0 };                                  // Time blocked in send() per wire byte
+	double SendNsSum{ 0.0 }, SendWireSum{ 0.0 };             // Decayed sums, of which SendCost is the ratio
+	unsigned WindowsSinceUse[LEVEL_COUNT] = {};
+	unsigned ProbePeriod[LEVEL_COUNT] = { PROBE_PERIOD, PROBE_PERIOD, PROBE_PERIOD };
+	bool Probing{ false };                                   // The current window measures a probed level
+	Level CurrentLevel{ Level::Fast };
+	unsigned BlocksInWindow{ 0 };
+	std::uint64_t WindowRaw{0}, WindowWire{0}, WindowCompressNs{0}, WindowSendNs{0};
+}; //class BlockCompressor
+
+#endif //BLOCKCOMPRESSOR_H
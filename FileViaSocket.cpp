@@ -27,18 +27,33 @@ CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
 OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
 OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 */
-#include "FileViaSocket.h"
+#include "SocketBufferBase.h" // The ostream (FileViaSocket.h) is header-only, so the C API links no iostreams
+#include "SocketBufferTrace.h"
 #include <cstring>
+#include <cstdio>
+#include <chrono>
+#include <algorithm>
+
+#if defined(__x86_64__) || defined(__i386__)
+#   include <x86intrin.h> // __rdtsc()
+#   include <atomic>
+#endif
 
 #ifdef __WIN32__
 #   include <winsock2.h>
 #   define SHUTDOWN_HOW_BOTH SD_BOTH   // We pass this as a parameter to function shutdown()
-#elif defined(__linux__)
+#   define SHUTDOWN_HOW_SEND SD_SEND
+#elif !defined(FVS_LWIP) // Linux
 #   include <sys/socket.h>
 #   include <arpa/inet.h>
 #   include <unistd.h>
+#   include <sys/select.h>
+#   include <linux/tcp.h>     // TCP_INFO (glibc's netinet/tcp.h lacks the newer fields of tcp_info)
+#   include <cstddef>
 #   define SHUTDOWN_HOW_BOTH SHUT_RDWR // We pass this as a parameter to function shutdown()
-#else // If not Windows nor Linux, we assume FreeRTOS with lwIP
+#   define SHUTDOWN_HOW_SEND SHUT_WR
+#else // FreeRTOS with lwIP (on Zynq, or on Linux with the FreeRTOS POSIX port)
+#   ifndef __linux__ // With the FreeRTOS POSIX port, lwIP uses errno of glibc (see lwipopts.h of the demo)
 /* When using lwIP and ostream together, we face an issue with two different definitions of errno.
  * lwIP defines errno as a global variable in lwip/errno.h. lwIP functions set this global variable.
  * However, when we include header ostream it takes with it sys/errno.h
@@ -86,26 +101,165 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #   undef ESTALE
 #   undef EDQUOT
 #   undef ENOPROTOOPT
+#   endif
 
 #   include "lwip/sockets.h"
 #   define SHUTDOWN_HOW_BOTH SHUT_RDWR  // We pass this as a parameter to function shutdown()
+#   define SHUTDOWN_HOW_SEND SHUT_WR
 #   define INADDR_NONE IPADDR_NONE      // lwIP doesn't provide macro INADDR_NONE
 #   undef close  // Macro "close" defined in lwip/sockets.h messes with our methods named "close"
+#   undef write  // The same for ostream::write
+#   undef accept // and RecordFilter::accept
+#   include "lwip/stats.h" // The resource usage (see SocketBufferBase::networkUsage())
+#   include "lwip/memp.h"
+#   ifndef __linux__
+#       include "xtime_l.h" // Zynq global timer, which we use as the monotonic clock
+#   endif
+#endif
+
+namespace {
+/* Framing of compressed sessions (and sessions with latency measurement).
+ * The session starts with a preamble: the magic (8 bytes), u8 version, u8 flags, u16 reserved.
+ * Then frames follow: u8 frame type, u32 payload length, payload (all numbers are little-endian).
+ * The payload of an LZ4 frame starts with u32 length of the raw data, followed by the compressed data.
+ * A session compressed against a static dictionary sends a dictionary frame (u32 ID of the dictionary)
+ * after the preamble; its LZ4 dictionary frames have the payload of the LZ4 frame, and their matches may refer
+ * to the dictionary, which logically precedes each frame's data.
+ * The payload of a timestamp frame is u32 sequence number, u64 time when the oldest byte of the following
+ * data frame was written to the stream, u64 time of sending (both in ns of the client's monotonic clock). */
+const char FRAME_MAGIC[8] = { '\x89', 'F', 'V', 'S', '\r', '\n', '\x1a', '\n' };
+const char FRAMING_VERSION = 1;
+const std::size_t PREAMBLE_SIZE = 12;
+const char PREAMBLE_FLAG_ECHO = 0x01;    // The client wants the server to echo the timestamp frames
+const char PREAMBLE_FLAG_CONTROL = 0x02; // The client accepts control requests from the server
+const char FRAME_RAW = 0;
+const char FRAME_LZ4 = 1;
+const char FRAME_TIMESTAMP = 2;
+const char FRAME_DICTIONARY = 3;
+const char FRAME_LZ4_DICT = 4;
+const std::size_t FRAME_HEADER_SIZE = 5;
+const std::size_t FRAME_DICTIONARY_SIZE = FRAME_HEADER_SIZE + 4;
+const std::size_t FRAME_LZ4_HEADER_SIZE = FRAME_HEADER_SIZE + 4;
+const std::size_t FRAME_TIMESTAMP_SIZE = FRAME_HEADER_SIZE + 20;
+// Space reserved in front of the data of a Block, so the frame headers can be written without copying the data
+const std::size_t FRAME_PREFIX_SIZE = FRAME_TIMESTAMP_SIZE + FRAME_LZ4_HEADER_SIZE;
+
+/* Messages sent by the server to the client: u8 message type, u16 payload length, payload.
+ * The payload of the echo is u32 sequence number, u64 first byte time, u64 send time (copied from
+ * the timestamp frame), u64 time of receiving the frame, u64 time of writing the data to the file
+ * (both in ns of the server's monotonic clock).
+ * Control requests: verbosity (u8 highest log level), bulk pause (u8 0/1), flush interval (u32 ms). */
+const std::size_t SERVER_MESSAGE_HEADER_SIZE = 3;
+const char SERVER_MESSAGE_ECHO = 1;
+const std::size_t SERVER_MESSAGE_ECHO_SIZE = 36;
+const char SERVER_MESSAGE_VERBOSITY = 2;
+const char SERVER_MESSAGE_BULK_PAUSE = 3;
+const char SERVER_MESSAGE_FLUSH_INTERVAL = 4;
+// How often we look for control requests (echoes are read after each frame)
+const std::uint64_t CONTROL_POLL_INTERVAL_NS = 10000000;
+// How long close() waits for the server to close the connection (a server, which hangs, mustn't block us forever)
+const std::uint64_t CLOSE_WAIT_NS = 2000000000;
+
+inline void putU32( char *p, std::uint32_t v ) {
+	p[0] = char(v);
+	p[1] = char(v >> 8);
+	p[2] = char(v >> 16);
+	p[3] = char(v >> 24);
+}
+
+inline void putU64( char *p, std::uint64_t v ) {
+	putU32( p, std::uint32_t(v) );
+	putU32( p + 4, std::uint32_t(v >> 32) );
+}
+
+inline std::uint32_t getU32( const char *p ) {
+	const unsigned char *u = reinterpret_cast<const unsigned char*>(p);
+	return std::uint32_t(u[0]) | std::uint32_t(u[1]) << 8 | std::uint32_t(u[2]) << 16 | std::uint32_t(u[3]) << 24;
+}
+
+inline std::uint64_t getU64( const char *p ) {
+	return std::uint64_t( getU32( p ) ) | std::uint64_t( getU32( p + 4 ) ) << 32;
+}
+
+/* Returns time of a monotonic clock in nanoseconds. */
+std::uint64_t monotonicNs()
+{
+#if defined(__WIN32__) || defined(__linux__)
+	return std::uint64_t( std::chrono::duration_cast<std::chrono::nanoseconds>(
+	                          std::chrono::steady_clock::now().time_since_epoch() ).count() );
+#else // If not Windows nor Linux, we assume FreeRTOS on Zynq
+	XTime t;
+	XTime_GetTime( &t );
+	// We split the conversion to avoid overflow of the 64-bit multiplication
+	return (t / COUNTS_PER_SECOND) * 1000000000ULL + (t % COUNTS_PER_SECOND) * 1000000000ULL / COUNTS_PER_SECOND;
 #endif
+} // monotonicNs
 
-void SocketBuffer::open( const std::string &serverIP, unsigned short port )
+/* Waits till data can be read from the socket (or the connection is closed); returns false when the deadline
+ * (monotonicNs()) passed first. */
+bool waitReadable( int socket, std::uint64_t deadlineNs )
 {
+	std::uint64_t now = monotonicNs();
+	if( now >= deadlineNs )
+		return false;
+	std::uint64_t remainingUs = ( deadlineNs - now ) / 1000;
+	fd_set readSet;
+	FD_ZERO( &readSet );
+	FD_SET( socket, &readSet );
+	struct timeval timeout;
+	timeout.tv_sec = long(remainingUs / 1000000);
+	timeout.tv_usec = long(remainingUs % 1000000);
+	return select( socket + 1, &readSet, nullptr, nullptr, &timeout ) > 0;
+} // waitReadable
+
+#if defined(__x86_64__) || defined(__i386__)
+// Reference point of the measurement of the TSC frequency (see SocketBufferBase::rawTimestampHz())
+const std::uint64_t tscReferenceNs = monotonicNs();
+const std::uint64_t tscReferenceTicks = __rdtsc();
+#endif
+} // namespace
+
+#if defined(FVS_TRACE) && defined(FVS_LWIP) // The trace ring (see SocketBufferTrace.h)
+FvsTraceEvent fvsTraceRing[FVS_TRACE_RING_SIZE];
+volatile std::uint32_t fvsTraceCount = 0;
+
+void fvsTraceRecord( FvsTraceProbe probe, int fd, std::uint32_t a, std::uint32_t b )
+{
+	// The slot is reserved atomically, so the tasks using streams don't overwrite each other's events
+	std::uint32_t slot = __atomic_fetch_add( &fvsTraceCount, 1, __ATOMIC_RELAXED ) & (FVS_TRACE_RING_SIZE - 1);
+	fvsTraceRing[slot] = { SocketBufferBase::rawTimestamp(), a, b, std::uint16_t(probe), std::int16_t(fd) };
+} // fvsTraceRecord
+
+std::size_t fvsTraceSnapshot( FvsTraceEvent *dest, std::size_t max )
+{
+	std::uint32_t count = fvsTraceCount;
+	std::size_t n = count < FVS_TRACE_RING_SIZE ? count : FVS_TRACE_RING_SIZE;
+	if( n > max )
+		n = max;
+	for( std::size_t i = 0; i < n; i++ )
+		dest[i] = fvsTraceRing[ (count - n + i) & (FVS_TRACE_RING_SIZE - 1) ];
+	return n;
+} // fvsTraceSnapshot
+#endif
+
+void SocketBufferBase::open( const std::string &serverIP, unsigned short port )
+{
+	PutAreaGuard guard( *this );
 	if( Socket >= 0 ) { // We still have an open socket from before
 		close();
 		Socket = -1;
 	}
 
+	ServerIP = serverIP;
+	ServerPort = port;
+	FVS_TRACE_OPEN( serverIP.c_str(), port );
+
 	// Create socket
 	if( (Socket = socket(AF_INET, SOCK_STREAM, 0 )) < 0 )
 #ifdef __WIN32__
-		throw FileViaSocket::SocketCreationErrorExc( WSAGetLastError() );
+		throw FileViaSocketErrors::SocketCreationErrorExc( WSAGetLastError() );
 #else
-		throw FileViaSocket::SocketCreationErrorExc( errno );
+		throw FileViaSocketErrors::SocketCreationErrorExc( errno );
 #endif
 
 	struct sockaddr_in serv_addr = {};
@@ -115,85 +269,266 @@ void SocketBuffer::open( const std::string &serverIP, unsigned short port )
 	// Convert IPv4 and IPv6 addresses from text to binary form
 	serv_addr.sin_addr.s_addr = inet_addr( serverIP.c_str() );
 	if( serv_addr.sin_addr.s_addr == INADDR_NONE ) {
+		closeSocket();
 		std::string m{"Server IP was provided in a wrong format '" + serverIP + "'!"};
-		throw FileViaSocket::WrongServerIPFormatExc( m );
+		throw FileViaSocketErrors::WrongServerIPFormatExc( m );
 	}
 
 	// Connect to the server
-	if( connect(Socket, (struct sockaddr *)&serv_addr, sizeof(serv_addr)) < 0 )
+	if( connect(Socket, (struct sockaddr *)&serv_addr, sizeof(serv_addr)) < 0 ) {
 #ifdef __WIN32__
-		throw FileViaSocket::SocketConnectionErrorExc( WSAGetLastError() );
+		int errCode = WSAGetLastError();
 #else
-		throw FileViaSocket::SocketConnectionErrorExc( errno );
+		int errCode = errno;
 #endif
-} // SocketBuffer::open
+		closeSocket(); // Nothing was sent, so there is nothing to flush (and the socket can't be reused for connect)
+		throw FileViaSocketErrors::SocketConnectionErrorExc( errCode );
+	}
+	FVS_TRACE_CONNECTED( Socket, ServerIP.c_str(), port );
 
-void SocketBuffer::close()
-{
-	if( Socket >= 0 ) {
-		sync(); // Write remaining data from the buffer to the socket
-		shutdown(Socket, SHUTDOWN_HOW_BOTH); // Gracefully closing the socket
+	if( NoDelay ) {
+		int value = 1;
+		setsockopt(Socket, IPPROTO_TCP, TCP_NODELAY, (const char*)&value, sizeof(value));
+	}
+
+	Statistics = Stats();
+	nextTcpInfoNs = 0;
+	TrackTime = TimeAccounting;
+	accountingDepth = 0;
+	if( TrackTime )
+		sessionStartTicks = rawTimestamp();
 
+	Timestamps = TimestampsRequested;
+	PrefixRecords = PrefixRequested;
+	AtLineStart = true;
+	Verbosity = VERBOSITY_ALL;
+	BulkPaused = false;
+	FlushIntervalMs = 0;
+	FlushDeferred = false;
+	nextControlPollNs = 0;
+
+	// A framed session starts with the preamble, which tells the server that frames follow
+	Framed = CompressionMode != Compression::None || MeasureLatency || ControlChannel;
+	TrackLatency = MeasureLatency;
+	TrackControl = ControlChannel;
+	UseDictionary = CompressionMode == Compression::Dictionary && DictionaryData != nullptr && DictionarySize > 0;
+	if( Framed ) {
+		if( ! Compressor ) { // The compressor and its buffers are allocated only when framing is used
+			Compressor.reset( new BlockCompressor );
+			Block.resize( FRAME_PREFIX_SIZE + BlockCompressor::MAX_BLOCK_SIZE );
+			CompressedBlock.resize( FRAME_PREFIX_SIZE + BlockCompressor::maxCompressedSize( BlockCompressor::MAX_BLOCK_SIZE ) );
+		}
+		bytesInBlock = 0;
+		bytesInServerMessages = 0;
+		if( TrackLatency ) {
+			Latency->reset();
+			timestampSeq = 0;
+			bestRttNs = 0;
+		}
+
+		char preamble[PREAMBLE_SIZE + FRAME_DICTIONARY_SIZE] = {};
+		memcpy( preamble, FRAME_MAGIC, sizeof(FRAME_MAGIC) );
+		preamble[8] = FRAMING_VERSION;
+		preamble[9] = char( (TrackLatency ? PREAMBLE_FLAG_ECHO : 0) | (TrackControl ? PREAMBLE_FLAG_CONTROL : 0) );
+		long preambleSize = PREAMBLE_SIZE;
+		if( UseDictionary ) { // The dictionary frame follows the preamble in the same packet
+			Compressor->setDictionary( DictionaryData, DictionarySize );
+			preamble[PREAMBLE_SIZE] = FRAME_DICTIONARY;
+			putU32( preamble + PREAMBLE_SIZE + 1, 4 );
+			putU32( preamble + PREAMBLE_SIZE + FRAME_HEADER_SIZE, BlockCompressor::dictionaryId( DictionaryData, DictionarySize ) );
+			preambleSize += FRAME_DICTIONARY_SIZE;
+		}
+		if( transportSend(Socket, preamble, std::size_t(preambleSize)) != preambleSize ) {
 #ifdef __WIN32__
-		closesocket( Socket ); // Calling Winsock2 function for closing the socket
-#elif defined(__linux__)
-		::close( Socket );     // Calling the global library function for closing the file descriptor
-#else // If not Windows nor Linux, we assume FreeRTOS with lwIP
-		lwip_close( Socket );
+			int errCode = WSAGetLastError();
+#else
+			int errCode = errno;
 #endif
-		Socket = -1;
+			closeSocket();
+			throw FileViaSocketErrors::SocketConnectionErrorExc( errCode );
+		}
 	}
-} // SocketBuffer::close
 
-int SocketBuffer::overflow( int c ) {
+	if( Timestamps != TimestampFormat::None )
+		putCalibration();
+} // SocketBufferBase::open
+
+void SocketBufferBase::open( const std::vector<Receiver> &pool, const std::string &key )
+{
+	if( pool.empty() )
+		throw FileViaSocketErrors::WrongServerIPFormatExc();
+
+	/* Rendezvous hashing: each receiver gets a weight computed from the key and the receiver's address.
+	 * We try the receivers from the highest weight down. */
+	std::vector<std::pair<std::uint64_t, std::size_t>> order; // Weight and index of the receiver
+	for( std::size_t i = 0; i < pool.size(); i++ ) {
+		std::string id = key + '\0' + pool[i].ip + ':' + std::to_string( pool[i].port );
+		std::uint64_t h = 0xCBF29CE484222325ULL; // FNV-1a
+		for( char c : id )
+			h = (h ^ (unsigned char)c) * 0x100000001B3ULL;
+		h ^= h >> 33; // Final mixing, so similar addresses get unrelated weights
+		h *= 0xFF51AFD7ED558CCDULL;
+		h ^= h >> 33;
+		order.emplace_back( h, i );
+	}
+	std::sort( order.begin(), order.end(), []( const std::pair<std::uint64_t, std::size_t> &a,
+	                                           const std::pair<std::uint64_t, std::size_t> &b ) {
+		return a.first > b.first;
+	} );
+
+	for( std::size_t i = 0; i < order.size(); i++ ) {
+		const Receiver &r = pool[ order[i].second ];
+		try {
+			open( r.ip, r.port );
+			return; // Connected
+		} catch( ... ) { // Also a receiver with a wrong address or a failed socket() mustn't stop the failover
+			if( i + 1 == order.size() ) // No other receiver to fail over to
+				throw;
+		}
+	}
+} // SocketBufferBase::open
+
+int SocketBufferBase::close()
+{
+	PutAreaGuard guard( *this );
 	if( Socket < 0 )
-		return traits_type::eof();
+		return 0; // Success; nothing to close
+	AccountedCall call( *this );
+	bool sent = true;
+	if( Filter && Filter->active() )
+		sent = flushRecords( true, true ); // The incomplete record and the remaining summaries of the filter
+	if( Timestamps != TimestampFormat::None && sent )
+		sent = putCalibration(); // The second calibration record lets the receiver measure the counter's frequency
+	if( sent )
+		sent = flushAll( FVS_FLUSH_CLOSE ) == 0; // Write remaining data from the buffer to the socket
+	if( TrackLatency || TrackControl ) {
+		/* We tell the server we are done and read the remaining echoes till the server closes the connection,
+		 * at most CLOSE_WAIT_NS. (Closing a socket with unread received data would reset the connection.) */
+		shutdown(Socket, SHUTDOWN_HOW_SEND);
+		readServerMessages( true, monotonicNs() + CLOSE_WAIT_NS );
+	}
+	FVS_TRACE_CLOSE( Socket, Statistics.dataBytes, Statistics.wireBytes );
+	shutdown(Socket, SHUTDOWN_HOW_BOTH); // Gracefully closing the socket
+	closeSocket();
+	Framed = false;
+	TrackLatency = false;
+	TrackControl = false;
+	return sent ? 0 : -1;
+} // SocketBufferBase::close
 
-	if ( c == traits_type::eof() ) {
-		sync();
+void SocketBufferBase::closeSocket()
+{
+#ifdef __WIN32__
+	closesocket( Socket ); // Calling Winsock2 function for closing the socket
+#elif !defined(FVS_LWIP)
+	::close( Socket );     // Calling the global library function for closing the file descriptor
+#else // FreeRTOS with lwIP
+	lwip_close( Socket );
+#endif
+	Socket = -1;
+} // SocketBufferBase::closeSocket
+
+void SocketBufferBase::setLatencyMeasurement( bool enable )
+{
+	MeasureLatency = enable;
+	if( enable && ! Latency ) // The histogram is allocated only when it's needed
+		Latency.reset( new LatencyHistogram );
+} // SocketBufferBase::setLatencyMeasurement
+
+void SocketBufferBase::noteFirstByte()
+{
+	if( TrackLatency && bytesInBuffer == 0 )
+		bufferFirstByteNs = monotonicNs();
+} // SocketBufferBase::noteFirstByte
+
+int SocketBufferBase::putChar( int c )
+{
+	if( Socket < 0 )
+		return std::char_traits<char>::eof();
+	PutAreaGuard guard( *this );
+	AccountedCall call( *this );
+
+	if ( c == std::char_traits<char>::eof() ) {
+		flush();
+		return 1; // Success
+	}
+
+	if( Filter && Filter->active() ) {
+		char ch = char(c);
+		if( ch != '\n' && Record.size() < MAX_RECORD_SIZE ) { // Formatted numbers come here char by char
+			Record.push_back( ch );
+			return 1; // Success
+		}
+		if( filterRecords( &ch, 1 ) != 1 )
+			return std::char_traits<char>::eof(); // Failure
+		flushDeferred();
 		return 1; // Success
 	}
 
-	if( bytesInBuffer == SOCKET_BUFF_SIZE-1 ) { // This character fills the buffer
+	if( PrefixRecords && AtLineStart ) {
+		char timestamp[MAX_TIMESTAMP_SIZE];
+		if( putData( timestamp, std::streamsize(formatTimestamp( timestamp, Timestamps )) ) <= 0 )
+			return std::char_traits<char>::eof(); // Failure
+	}
+	if( Timestamps != TimestampFormat::None )
+		AtLineStart = c == '\n';
+
+	if( bytesInBuffer == bufferSize-1 ) { // This character fills the buffer
 		buffer[ bytesInBuffer ] = char(c);
 
-		if( send(Socket, buffer, SOCKET_BUFF_SIZE, 0) != SOCKET_BUFF_SIZE )
-			return traits_type::eof(); // Failure
+		FVS_TRACE_FLUSH( FVS_FLUSH_FULL, bufferSize );
+		if( ! sendData( buffer, bufferSize ) )
+			return std::char_traits<char>::eof(); // Failure
 		bytesInBuffer = 0;
 	}
 	else { // There is space in the buffer for more characters
+		noteFirstByte();
 		buffer[ bytesInBuffer ] = char(c);
 		bytesInBuffer++;
 	}
 
+	flushDeferred();
 	return 1; // Success
-} // SocketBuffer::overflow
+} // SocketBufferBase::putChar
 
-std::streamsize SocketBuffer::xsputn( const char_type* s, std::streamsize n )
+std::streamsize SocketBufferBase::putChars( const char *s, std::streamsize n )
 {
 	if( Socket < 0 )
 		return 0; // Failure
+	PutAreaGuard guard( *this );
+	AccountedCall call( *this );
+
+	std::streamsize written = Filter && Filter->active() ? filterRecords( s, n ) : putRecords( s, n );
+	flushDeferred();
+	return written;
+} // SocketBufferBase::putChars
 
-	if( bytesInBuffer + n >= SOCKET_BUFF_SIZE ) { // Data won't fit in the buffer; we need to send data to the socket
+std::streamsize SocketBufferBase::putData( const char *s, std::streamsize n )
+{
+	if( bytesInBuffer + n >= bufferSize ) { // Data won't fit in the buffer; we need to send data to the socket
 		std::streamsize bytesConsumed{0}; // Number of bytes we already consumed form s
 
 		// If we have data in the buffer, we fill the buffer to be full and send it
 		if( bytesInBuffer > 0 ) {
-			memcpy( buffer + bytesInBuffer, s, SOCKET_BUFF_SIZE - bytesInBuffer );
-			bytesConsumed = SOCKET_BUFF_SIZE - bytesInBuffer;
-			if( send(Socket, buffer, SOCKET_BUFF_SIZE, 0) != SOCKET_BUFF_SIZE )
+			memcpy( buffer + bytesInBuffer, s, bufferSize - bytesInBuffer );
+			bytesConsumed = bufferSize - bytesInBuffer;
+			FVS_TRACE_FLUSH( FVS_FLUSH_FULL, bufferSize );
+			if( ! sendData( buffer, bufferSize ) )
 				return 0; // Failure
 		}
 
 		// Now send all data from s, which would not fit in the buffer
-		std::streamsize n2 = ( n - bytesConsumed ) - ( n - bytesConsumed ) % SOCKET_BUFF_SIZE;
+		std::streamsize n2 = ( n - bytesConsumed ) - ( n - bytesConsumed ) % bufferSize;
 		if( n2 > 0 ) { // Is there something to send?
-			if( send(Socket, s + bytesConsumed, n2, 0) != n2 )
+			FVS_TRACE_FLUSH( FVS_FLUSH_DIRECT, n2 );
+			if( ! sendData( s + bytesConsumed, n2 ) )
 				return bytesConsumed; // Failure
 			bytesConsumed += n2;
 		}
 
 		if( bytesConsumed < n ) { // We store data, which are still remaining, in the buffer
+			bytesInBuffer = 0;
+			noteFirstByte();
 			memcpy( buffer, s + bytesConsumed, n - bytesConsumed );
 			bytesInBuffer = n - bytesConsumed;
 		} else {
@@ -201,37 +536,607 @@ std::streamsize SocketBuffer::xsputn( const char_type* s, std::streamsize n )
 		}
 	}
 	else { // Data still fit in the buffer
+		noteFirstByte();
 		memcpy( buffer + bytesInBuffer, s, n );
 		bytesInBuffer += n;
 	}
 	return n; // Success
-} // SocketBuffer::xsputn
+} // SocketBufferBase::putData
+
+std::streamsize SocketBufferBase::putRecords( const char *s, std::streamsize n )
+{
+	if( ! PrefixRecords ) {
+		if( Timestamps != TimestampFormat::None && n > 0 )
+			AtLineStart = s[n - 1] == '\n';
+		return putData( s, n );
+	}
+
+	std::streamsize pos{0};
+	while( pos < n ) {
+		if( AtLineStart ) {
+			char timestamp[MAX_TIMESTAMP_SIZE];
+			if( putData( timestamp, std::streamsize(formatTimestamp( timestamp, Timestamps )) ) <= 0 )
+				return pos; // Failure
+			AtLineStart = false;
+		}
+		const char *newLine = static_cast<const char*>( memchr( s + pos, '\n', std::size_t(n - pos) ) );
+		std::streamsize end = newLine ? newLine - s + 1 : n;
+		if( putData( s + pos, end - pos ) != end - pos )
+			return pos; // Failure
+		AtLineStart = newLine != nullptr;
+		pos = end;
+	}
+	return n; // Success
+} // SocketBufferBase::putRecords
+
+std::uint64_t SocketBufferBase::rawTimestamp()
+{
+#if defined(__x86_64__) || defined(__i386__)
+	return __rdtsc();
+#elif defined(__aarch64__)
+	std::uint64_t ticks;
+	asm volatile( "mrs %0, cntvct_el0" : "=r"(ticks) );
+	return ticks;
+#elif defined(__WIN32__) || defined(__linux__)
+	return monotonicNs(); // No counter readable from the user space (e.g., ARMv7 Linux)
+#else // If not Windows nor Linux, we assume FreeRTOS on Zynq, we use its global timer
+	XTime ticks;
+	XTime_GetTime( &ticks );
+	return ticks;
+#endif
+} // SocketBufferBase::rawTimestamp
+
+std::uint64_t SocketBufferBase::rawTimestampHz()
+{
+#if defined(__x86_64__) || defined(__i386__)
+	/* The TSC frequency isn't available to the user space; we measure it against the monotonic clock
+	 * from the reference point taken when the program started, so open() doesn't wait for a measurement.
+	 * The result is kept once the interval is at least 10 ms long. A program asking sooner gets an estimate
+	 * over at least 1 ms (the receiver refines the frequency from the two calibration records anyway). */
+	static std::atomic<std::uint64_t> measuredHz{0};
+	std::uint64_t hz = measuredHz.load( std::memory_order_relaxed );
+	if( hz != 0 )
+		return hz;
+	std::uint64_t startNs = tscReferenceNs;
+	std::uint64_t startTicks = tscReferenceTicks;
+	if( startNs == 0 ) { // Called by a static initializer before the reference point was taken
+		startNs = monotonicNs();
+		startTicks = __rdtsc();
+	}
+	while( monotonicNs() - startNs < 1000000 ) // 1 ms
+		;
+	std::uint64_t ticks = __rdtsc() - startTicks;
+	std::uint64_t ns = monotonicNs() - startNs;
+	hz = std::uint64_t( double(ticks) * 1e9 / double(ns) );
+	if( ns >= 10000000 )
+		measuredHz.store( hz, std::memory_order_relaxed );
+	return hz;
+#elif defined(__aarch64__)
+	std::uint64_t hz;
+	asm volatile( "mrs %0, cntfrq_el0" : "=r"(hz) );
+	return hz;
+#elif defined(__WIN32__) || defined(__linux__)
+	return 1000000000ULL;
+#else // If not Windows nor Linux, we assume FreeRTOS on Zynq
+	return COUNTS_PER_SECOND;
+#endif
+} // SocketBufferBase::rawTimestampHz
+
+std::size_t SocketBufferBase::formatTimestamp( char *dest, TimestampFormat format )
+{
+	std::uint64_t ticks = rawTimestamp();
+	if( format == TimestampFormat::Binary ) {
+		dest[0] = '\x1e';
+		putU64( dest + 1, ticks );
+		return 9;
+	}
+	static const char digits[] = "0123456789abcdef";
+	for( int i = 15; i >= 0; i-- ) {
+		dest[i] = digits[ ticks & 0xF ];
+		ticks >>= 4;
+	}
+	dest[16] = ' ';
+	return 17;
+} // SocketBufferBase::formatTimestamp
+
+bool SocketBufferBase::putCalibration()
+{
+	std::uint64_t wallNs{0};
+#if defined(__WIN32__) || defined(__linux__)
+	wallNs = std::uint64_t( std::chrono::duration_cast<std::chrono::nanoseconds>(
+	                            std::chrono::system_clock::now().time_since_epoch() ).count() );
+#endif // FreeRTOS has no wall-clock time; the receiver uses the time of the connection
+	char ticks[MAX_TIMESTAMP_SIZE];
+	formatTimestamp( ticks, TimestampFormat::Hex );
+	std::string record = AtLineStart ? "" : "\n";
+	record += "#FVS-CAL ";
+	record += Timestamps == TimestampFormat::Binary ? "bin" : "hex";
+	record += " ticks=" + std::string( ticks, 16 ) + " hz=" + std::to_string( rawTimestampHz() ) +
+	          " wall_ns=" + std::to_string( wallNs ) + "\n";
+	AtLineStart = true;
+	return putData( record.data(), std::streamsize(record.size()) ) == std::streamsize(record.size());
+} // SocketBufferBase::putCalibration
+
+SocketBufferBase::NetworkUsage SocketBufferBase::networkUsage()
+{
+	NetworkUsage usage;
+#if defined(FVS_LWIP) && LWIP_STATS
+	// lwIP updates the statistics without locking; a value may be a moment old, which doesn't matter here
+	usage.available = true;
+#   if MEM_STATS
+	usage.heap = { lwip_stats.mem.used, lwip_stats.mem.max, lwip_stats.mem.avail, lwip_stats.mem.err };
+#   endif
+#   if MEMP_STATS
+	auto pool = []( memp_t type ) {
+		const struct stats_mem *m = lwip_stats.memp[type];
+		return m ? NetworkUsage::Resource{ m->used, m->max, m->avail, m->err } : NetworkUsage::Resource{};
+	};
+	usage.pbufPool = pool( MEMP_PBUF_POOL );
+	usage.pbufRef = pool( MEMP_PBUF );
+	usage.tcpSegments = pool( MEMP_TCP_SEG );
+#   endif
+#   if SYS_STATS
+	usage.mailboxes = { lwip_stats.sys.mbox.used, lwip_stats.sys.mbox.max, 0, lwip_stats.sys.mbox.err };
+#   endif
+#endif
+	return usage;
+} // SocketBufferBase::networkUsage
+
+std::string SocketBufferBase::statsSummary() const
+{
+	char s[512];
+	int n = snprintf( s, sizeof(s), "data=%llu wire=%llu sends=%llu flushes=%llu",
+	                  (unsigned long long)Statistics.dataBytes, (unsigned long long)Statistics.wireBytes,
+	                  (unsigned long long)Statistics.sendCalls, (unsigned long long)Statistics.flushes );
+	if( TrackTime && n > 0 && std::size_t(n) < sizeof(s) ) {
+		const double msPerTick = 1000.0 / double(rawTimestampHz());
+		std::uint64_t ownTicks = Statistics.streamTicks - Statistics.sendTicks;
+		n += snprintf( s + n, sizeof(s) - std::size_t(n), " stream=%.1fms send=%.1fms cpu=%.1f%% session=%.1fms",
+		               double(Statistics.streamTicks) * msPerTick, double(Statistics.sendTicks) * msPerTick,
+		               Statistics.sessionTicks ? 100.0 * double(ownTicks) / double(Statistics.sessionTicks) : 0.0,
+		               double(Statistics.sessionTicks) * msPerTick );
+	}
+	const NetworkUsage usage = networkUsage();
+	if( usage.available && n > 0 ) {
+		const std::pair<const char*, const NetworkUsage::Resource*> resources[] = {
+			{ "heap", &usage.heap }, { "pbuf_pool", &usage.pbufPool }, { "pbuf", &usage.pbufRef },
+			{ "tcp_seg", &usage.tcpSegments }, { "mbox", &usage.mailboxes } };
+		for( const auto &r : resources ) {
+			if( std::size_t(n) >= sizeof(s) )
+				break;
+			n += snprintf( s + n, sizeof(s) - std::size_t(n), " %s=%lu/%lu/%lu/%lu", r.first,
+			               (unsigned long)r.second->used, (unsigned long)r.second->max,
+			               (unsigned long)r.second->avail, (unsigned long)r.second->err );
+		}
+	}
+	return s;
+} // SocketBufferBase::statsSummary
+
+RecordFilter &SocketBufferBase::recordFilter()
+{
+	if( putAreaDepth == 0 )
+		releasePutArea(); // The records written from now on must go through the filter
+	if( ! Filter ) // The filter is allocated only when it's needed
+		Filter.reset( new RecordFilter );
+	return *Filter;
+} // SocketBufferBase::recordFilter
+
+std::streamsize SocketBufferBase::filterRecords( const char *s, std::streamsize n )
+{
+	std::uint64_t now{0}; // We read the clock once per call
+	std::streamsize pos{0};
+	while( pos < n ) {
+		const char *newLine = static_cast<const char*>( memchr( s + pos, '\n', std::size_t(n - pos) ) );
+		std::streamsize end = newLine ? newLine - s + 1 : n;
+
+		if( ! newLine ) { // The rest of the data is an incomplete record
+			Record.append( s + pos, std::size_t(end - pos) );
+			if( Record.size() > MAX_RECORD_SIZE ) { // Too long to be a record; we send it unfiltered
+				if( putRecords( Record.data(), std::streamsize(Record.size()) ) != std::streamsize(Record.size()) )
+					return pos; // Failure
+				Record.clear();
+			}
+			return n;
+		}
+
+		// A complete record; when it's entirely in s, we pass it to the filter without copying
+		const char *record = s + pos;
+		std::size_t len = std::size_t(end - pos);
+		if( ! Record.empty() ) {
+			Record.append( record, len );
+			record = Record.data();
+			len = Record.size();
+		}
+		if( now == 0 )
+			now = monotonicNs();
+		FilterSummaries.clear();
+		bool pass = Filter->accept( record, len, now, FilterSummaries );
+		if( ! FilterSummaries.empty() &&
+		    putRecords( FilterSummaries.data(), std::streamsize(FilterSummaries.size()) ) != std::streamsize(FilterSummaries.size()) )
+			return pos; // Failure
+		if( pass && putRecords( record, std::streamsize(len) ) != std::streamsize(len) )
+			return pos; // Failure
+		Record.clear();
+		pos = end;
+	}
+	return n; // Success
+} // SocketBufferBase::filterRecords
 
-int SocketBuffer::sync()
+bool SocketBufferBase::flushRecords( bool all, bool incomplete )
 {
-	if( bytesInBuffer == 0 ) // No data to send
+	FilterSummaries.clear();
+	Filter->sweep( monotonicNs(), FilterSummaries, all );
+	if( ! FilterSummaries.empty() &&
+	    putRecords( FilterSummaries.data(), std::streamsize(FilterSummaries.size()) ) != std::streamsize(FilterSummaries.size()) )
+		return false;
+	if( incomplete && ! Record.empty() ) {
+		if( putRecords( Record.data(), std::streamsize(Record.size()) ) != std::streamsize(Record.size()) )
+			return false;
+		Record.clear();
+	}
+	return true;
+} // SocketBufferBase::flushRecords
+
+std::streamsize SocketBufferBase::writeFrom( const Generator &generator, std::streamsize totalBytes )
+{
+	if( Socket < 0 )
+		return -1; // Failure
+	PutAreaGuard guard( *this );
+	AccountedCall call( *this );
+	pollControl(); // The server may have resumed bulk transfers
+	if( BulkPaused )
+		return 0;
+
+	std::streamsize bytesProduced{0}; // Number of bytes the generator already produced
+	while( bytesProduced < totalBytes ) {
+		// The generator writes directly to the free part of our buffer
+		std::streamsize space = bufferSize - bytesInBuffer;
+		if( space > totalBytes - bytesProduced )
+			space = totalBytes - bytesProduced;
+
+		noteFirstByte();
+		std::size_t n = generator( buffer + bytesInBuffer, std::size_t(space) );
+		if( n == 0 ) // The generator has no more data
+			break;
+		if( std::streamsize(n) > space ) // Protect ourselves against a misbehaving generator
+			n = std::size_t(space);
+		bytesInBuffer += int(n);
+		bytesProduced += std::streamsize(n);
+
+		if( bytesInBuffer == bufferSize ) { // The buffer is full, we send it
+			FVS_TRACE_FLUSH( FVS_FLUSH_FULL, bufferSize );
+			if( ! sendData( buffer, bufferSize ) )
+				return -1; // Failure
+			bytesInBuffer = 0;
+		}
+	}
+	return bytesProduced; // Success
+} // SocketBufferBase::writeFrom
+
+int SocketBufferBase::flush()
+{
+	return flushData( true );
+} // SocketBufferBase::flush
+
+int SocketBufferBase::flushData( bool explicitFlush )
+{
+	PutAreaGuard guard( *this );
+	AccountedCall call( *this );
+	// The server may have asked us to send the data less often
+	bool defer = FlushIntervalMs > 0 && Socket >= 0 && monotonicNs() < lastFlushNs + FlushIntervalMs * 1000000ULL;
+	// The incomplete record is sent only when the application flushes the data now; otherwise its rest may follow,
+	// and the filter has to see the whole record
+	if( Filter && Filter->active() && Socket >= 0 && ! flushRecords( false, explicitFlush && ! defer ) )
+		return -1; // Failure
+	if( defer ) {
+		FlushDeferred = bytesInBuffer > 0 || bytesInBlock > 0;
+		return 0; // Success; the data are sent by a later write when the interval elapses, or by close()
+	}
+	return flushAll( FlushDeferred ? FVS_FLUSH_DEFERRED : FVS_FLUSH_EXPLICIT );
+} // SocketBufferBase::flushData
+
+int SocketBufferBase::flushAll( int cause )
+{
+	FlushDeferred = false;
+	if( bytesInBuffer == 0 && bytesInBlock == 0 ) // No data to send
 		return 0; // Success
 
 	if( Socket < 0 )
 		return -1; // Failure
 
-	if( send(Socket, buffer, bytesInBuffer, 0) != bytesInBuffer )
+	FVS_TRACE_FLUSH( cause, std::size_t(bytesInBuffer) + bytesInBlock );
+
+	if( FlushIntervalMs > 0 )
+		lastFlushNs = monotonicNs();
+	Statistics.flushes++;
+	if( bytesInBuffer > 0 ) {
+		if( ! sendData( buffer, bytesInBuffer ) )
+			return -1; // Failure
+		bytesInBuffer = 0;
+	}
+
+	if( Framed && ! sendBlock() ) // Flush also the block being framed
 		return -1; // Failure
-	bytesInBuffer = 0;
 
 	return 0; // Success
-} // SocketBuffer::sync
+} // SocketBufferBase::flushAll
+
+bool SocketBufferBase::sendData( const char *data, std::streamsize len )
+{
+	Statistics.dataBytes += std::uint64_t(len);
+	if( ! Framed )
+		return sendToSocket( data, std::size_t(len) );
+
+	std::uint64_t dataFirstByteNs{0}; // Data from our buffer are older than data written directly to the socket
+	if( TrackLatency )
+		dataFirstByteNs = data == buffer ? bufferFirstByteNs : monotonicNs();
+
+	while( len > 0 ) { // We cut the data to blocks, each block is sent in a frame
+		if( TrackLatency && bytesInBlock == 0 )
+			blockFirstByteNs = dataFirstByteNs;
+		std::size_t n = BlockCompressor::MAX_BLOCK_SIZE - bytesInBlock;
+		if( std::streamsize(n) > len )
+			n = std::size_t(len);
+		memcpy( Block.data() + FRAME_PREFIX_SIZE + bytesInBlock, data, n );
+		bytesInBlock += n;
+		data += n;
+		len -= std::streamsize(n);
+
+		if( bytesInBlock == BlockCompressor::MAX_BLOCK_SIZE && ! sendBlock() )
+			return false;
+	}
+	return true;
+} // SocketBufferBase::sendData
+
+bool SocketBufferBase::sendBlock()
+{
+	if( bytesInBlock == 0 )
+		return true;
+
+	BlockCompressor::Level level;
+	switch( CompressionMode ) {
+		case Compression::Fast:       level = BlockCompressor::Level::Fast;   break;
+		case Compression::Strong:     level = BlockCompressor::Level::Strong; break;
+		case Compression::Adaptive:   level = Compressor->adaptiveLevel();    break;
+		case Compression::Dictionary: level = BlockCompressor::Level::Fast;   break; // When no dictionary is set
+		default:                      level = BlockCompressor::Level::None;   break;
+	}
+
+	std::uint64_t compressStart = monotonicNs();
+	std::size_t compressedSize = UseDictionary
+		? Compressor->compressWithDictionary( Block.data() + FRAME_PREFIX_SIZE, bytesInBlock,
+		                                      CompressedBlock.data() + FRAME_PREFIX_SIZE,
+		                                      CompressedBlock.size() - FRAME_PREFIX_SIZE )
+		: Compressor->compress( level, Block.data() + FRAME_PREFIX_SIZE, bytesInBlock,
+		                        CompressedBlock.data() + FRAME_PREFIX_SIZE,
+		                        CompressedBlock.size() - FRAME_PREFIX_SIZE );
+	std::uint64_t sendStart = monotonicNs();
+
+	/* The frame header is written in front of the data, so the whole frame is sent by a single send().
+	 * (Sending the header separately would produce a small TCP packet and Nagle's algorithm could delay
+	 * the rest of the frame.) */
+	char *frame;
+	std::size_t frameSize;
+	if( compressedSize > 0 ) {
+		char *header = CompressedBlock.data() + FRAME_PREFIX_SIZE - FRAME_LZ4_HEADER_SIZE;
+		header[0] = UseDictionary ? FRAME_LZ4_DICT : FRAME_LZ4;
+		putU32( header + 1, std::uint32_t(4 + compressedSize) );
+		putU32( header + FRAME_HEADER_SIZE, std::uint32_t(bytesInBlock) );
+		frame = header;
+		frameSize = FRAME_LZ4_HEADER_SIZE + compressedSize;
+	} else { // The data are sent raw; the raw frame header is shorter, so it starts later in the Block
+		char *header = Block.data() + FRAME_PREFIX_SIZE - FRAME_HEADER_SIZE;
+		header[0] = FRAME_RAW;
+		putU32( header + 1, std::uint32_t(bytesInBlock) );
+		frame = header;
+		frameSize = FRAME_HEADER_SIZE + bytesInBlock;
+	}
+
+	if( TrackLatency ) { // The timestamp frame precedes the data frame
+		frame -= FRAME_TIMESTAMP_SIZE;
+		frameSize += FRAME_TIMESTAMP_SIZE;
+		frame[0] = FRAME_TIMESTAMP;
+		putU32( frame + 1, std::uint32_t(FRAME_TIMESTAMP_SIZE - FRAME_HEADER_SIZE) );
+		putU32( frame + FRAME_HEADER_SIZE, timestampSeq++ );
+		putU64( frame + FRAME_HEADER_SIZE + 4, blockFirstByteNs );
+		putU64( frame + FRAME_HEADER_SIZE + 12, monotonicNs() );
+	}
+
+	bool success = sendToSocket( frame, frameSize );
+
+	if( TrackLatency && success )
+		readServerMessages( false ); // Echoes of the previous frames may have arrived
+	else if( success )
+		pollControl();
+
+	if( CompressionMode == Compression::Adaptive )
+		Compressor->recordBlock( level, bytesInBlock, frameSize, sendStart - compressStart, monotonicNs() - sendStart );
+
+	bytesInBlock = 0;
+	return success;
+} // SocketBufferBase::sendBlock
+
+long SocketBufferBase::socketSend( int socket, const char *data, std::size_t len )
+{
+	return long( send(socket, data, len, 0) );
+} // SocketBufferBase::socketSend
+
+bool SocketBufferBase::inlineWritesAllowed() const
+{
+	return Socket >= 0 && ! (Filter && Filter->active()) && Timestamps == TimestampFormat::None
+	       && ! TrackLatency && ! TrackControl && ! TrackTime;
+} // SocketBufferBase::inlineWritesAllowed
+
+bool SocketBufferBase::sendToSocket( const char *data, std::size_t len )
+{
+	FVS_TRACE_SEND_BEGIN( Socket, len );
+	std::uint64_t sendStart = TrackTime ? rawTimestamp() : 0;
+	auto sent = transportSend(Socket, data, len);
+	if( TrackTime )
+		Statistics.sendTicks += rawTimestamp() - sendStart;
+	FVS_TRACE_SEND_END( Socket, len, sent );
+	if( sent >= 0 && std::size_t(sent) < len )
+		FVS_TRACE_PARTIAL_SEND( Socket, len, sent );
+	bool success = sent == std::streamsize(len);
+	Statistics.sendCalls++;
+	if( success )
+		Statistics.wireBytes += len;
+
+#if defined(__linux__) && !defined(FVS_LWIP) // lwIP doesn't provide TCP_INFO
+	std::uint64_t now = monotonicNs();
+	if( now >= nextTcpInfoNs ) {
+		nextTcpInfoNs = now + TCP_INFO_INTERVAL_MS * 1000000ULL;
+		sampleTcpInfo();
+	}
+#endif
+	return success;
+} // SocketBufferBase::sendToSocket
+
+void SocketBufferBase::sampleTcpInfo()
+{
+#if defined(__linux__) && !defined(FVS_LWIP)
+	struct tcp_info info = {};
+	socklen_t len = sizeof(info);
+	if( getsockopt(Socket, IPPROTO_TCP, TCP_INFO, &info, &len) != 0 )
+		return;
+
+	Statistics.tcpInfoSamples++;
+	Statistics.rttUs = info.tcpi_rtt;
+	Statistics.rttVarUs = info.tcpi_rttvar;
+	Statistics.cwnd = info.tcpi_snd_cwnd;
+	Statistics.mss = info.tcpi_snd_mss;
+	Statistics.retransmits = info.tcpi_total_retrans;
+	Statistics.unackedSegments = info.tcpi_unacked;
+	// Older kernels return a shorter structure without the newer fields
+	if( len >= offsetof(struct tcp_info, tcpi_delivery_rate) + sizeof(info.tcpi_delivery_rate) )
+		Statistics.deliveryRate = info.tcpi_delivery_rate;
+	if( len >= offsetof(struct tcp_info, tcpi_notsent_bytes) + sizeof(info.tcpi_notsent_bytes) )
+		Statistics.notSentBytes = info.tcpi_notsent_bytes;
+
+	int sendBuffer = 0;
+	socklen_t optLen = sizeof(sendBuffer);
+	if( getsockopt(Socket, SOL_SOCKET, SO_SNDBUF, &sendBuffer, &optLen) == 0 )
+		Statistics.sendBufferBytes = std::uint32_t(sendBuffer);
+
+	if( ! AutotuneSendBuffer || Statistics.rttUs == 0 )
+		return;
+
+	/* The BDP is estimated from the delivery rate and from the congestion window, whichever is bigger.
+	 * When the send buffer limits us, the delivery rate is about (send buffer / RTT), so the target
+	 * (twice the BDP) grows geometrically till the network (congestion window) becomes the limit. */
+	std::uint64_t bdpByRate = Statistics.deliveryRate * Statistics.rttUs / 1000000;
+	std::uint64_t bdpByCwnd = std::uint64_t(Statistics.cwnd) * Statistics.mss;
+	std::uint64_t target = 2 * (bdpByRate > bdpByCwnd ? bdpByRate : bdpByCwnd);
+	if( target > AutotuneMaxBytes )
+		target = AutotuneMaxBytes;
+
+	/* Linux reports twice the value set by SO_SNDBUF (it reserves space for its bookkeeping).
+	 * We only enlarge the buffer; by setting SO_SNDBUF we disable the kernel's own autotuning. */
+	if( target > Statistics.sendBufferBytes ) {
+		int value = int(target / 2);
+		if( setsockopt(Socket, SOL_SOCKET, SO_SNDBUF, &value, sizeof(value)) == 0 )
+			Statistics.autotuneChanges++;
+	}
+#endif
+} // SocketBufferBase::sampleTcpInfo
+
+void SocketBufferBase::pollControl()
+{
+	if( ! TrackControl )
+		return;
+	std::uint64_t now = monotonicNs();
+	if( now >= nextControlPollNs ) {
+		nextControlPollNs = now + CONTROL_POLL_INTERVAL_NS;
+		readServerMessages( false );
+	}
+} // SocketBufferBase::pollControl
+
+void SocketBufferBase::readServerMessages( bool wait, std::uint64_t deadlineNs )
+{
+	while( true ) {
+		char *dest = serverMessages + bytesInServerMessages;
+		int space = int(sizeof(serverMessages)) - bytesInServerMessages;
+		int n;
+		if( wait && deadlineNs != 0 && ! waitReadable( Socket, deadlineNs ) )
+			return; // The server didn't close the connection in time
+#ifdef __WIN32__
+		if( ! wait ) { // Winsock doesn't have MSG_DONTWAIT; we ask how many bytes are waiting instead
+			u_long available = 0;
+			if( ioctlsocket( Socket, FIONREAD, &available ) != 0 || available == 0 )
+				return;
+			if( available < u_long(space) )
+				space = int(available);
+		}
+		n = recv( Socket, dest, space, 0 );
+#else
+		n = recv( Socket, dest, space, wait ? 0 : MSG_DONTWAIT );
+#endif
+		if( n <= 0 ) // No more data, or the connection was closed
+			return;
+		bytesInServerMessages += n;
+
+		// Process all complete messages
+		int pos = 0;
+		while( bytesInServerMessages - pos >= int(SERVER_MESSAGE_HEADER_SIZE) ) {
+			const char *message = serverMessages + pos;
+			int payloadSize = (unsigned char)message[1] | (unsigned char)message[2] << 8;
+			if( payloadSize > int(sizeof(serverMessages) - SERVER_MESSAGE_HEADER_SIZE) ) { // Corrupted data
+				bytesInServerMessages = 0;
+				return;
+			}
+			if( bytesInServerMessages - pos < int(SERVER_MESSAGE_HEADER_SIZE) + payloadSize )
+				break; // The message is not complete yet
+
+			const char *payload = message + SERVER_MESSAGE_HEADER_SIZE;
+			if( message[0] == SERVER_MESSAGE_ECHO && payloadSize >= int(SERVER_MESSAGE_ECHO_SIZE) && TrackLatency )
+				processEcho( getU64( payload + 4 ), getU64( payload + 12 ), getU64( payload + 20 ), getU64( payload + 28 ) );
+			else if( message[0] == SERVER_MESSAGE_VERBOSITY && payloadSize >= 1 )
+				Verbosity = (unsigned char)payload[0];
+			else if( message[0] == SERVER_MESSAGE_BULK_PAUSE && payloadSize >= 1 )
+				BulkPaused = payload[0] != 0;
+			else if( message[0] == SERVER_MESSAGE_FLUSH_INTERVAL && payloadSize >= 4 )
+				FlushIntervalMs = getU32( payload );
+			// Messages of unknown types are skipped
+			pos += int(SERVER_MESSAGE_HEADER_SIZE) + payloadSize;
+		}
+		memmove( serverMessages, serverMessages + pos, std::size_t(bytesInServerMessages - pos) );
+		bytesInServerMessages -= pos;
+	}
+} // SocketBufferBase::readServerMessages
+
+void SocketBufferBase::processEcho( std::uint64_t firstByteNs, std::uint64_t sendNs, std::uint64_t serverRecvNs,
+                                std::uint64_t serverWrittenNs )
+{
+	std::uint64_t echoRecvNs = monotonicNs();
+
+	/* Round trip time without the time the server spent processing the frame. The clock offset is estimated
+	 * the same way as in NTP. The estimate is the more precise the shorter the round trip was, therefore we
+	 * use the offset from the echo with the shortest round trip. The best round trip time slowly ages, so
+	 * newer echoes can replace it (the clocks drift apart over time). */
+	std::int64_t rtt = std::int64_t(echoRecvNs - sendNs) - std::int64_t(serverWrittenNs - serverRecvNs);
+	if( rtt < 0 )
+		rtt = 0;
+	if( bestRttNs == 0 || std::uint64_t(rtt) <= bestRttNs ) {
+		bestRttNs = std::uint64_t(rtt) + 1; // +1 makes the value non-zero, i.e., valid
+		clockOffsetNs = ( std::int64_t(serverRecvNs - sendNs) + std::int64_t(serverWrittenNs - echoRecvNs) ) / 2;
+	} else
+		bestRttNs += bestRttNs / 64;
+
+	// Time of writing to the file converted to the client's clock, minus time of writing to the stream
+	std::int64_t latency = std::int64_t(serverWrittenNs - firstByteNs) - clockOffsetNs;
+	Latency->record( latency > 0 ? std::uint64_t(latency) : 0 );
+} // SocketBufferBase::processEcho
 
-FileViaSocket::SocketCreationErrorExc::SocketCreationErrorExc( int errCode )
+FileViaSocketErrors::SocketCreationErrorExc::SocketCreationErrorExc( int errCode )
 {
 #ifdef __WIN32__
 	message = "Socket creation error! WSAGetLastError() == " + std::to_string(errCode);
 #else
 	message = "Socket creation error! errno == " + std::to_string(errno);
 #endif
-} // FileViaSocket::SocketCreationErrorExc
+} // FileViaSocketErrors::SocketCreationErrorExc
 
-FileViaSocket::SocketConnectionErrorExc::SocketConnectionErrorExc( int errCode )
+FileViaSocketErrors::SocketConnectionErrorExc::SocketConnectionErrorExc( int errCode )
 {
 #ifdef __WIN32__
 	message = "Socket connection error! WSAGetLastError() == " + std::to_string(errCode);
@@ -259,4 +1164,4 @@ FileViaSocket::SocketConnectionErrorExc::SocketConnectionErrorExc( int errCode )
 			break;
 	}
 #endif
-} // FileViaSocket::SocketConnectionErrorExc
+} // FileViaSocketErrors::SocketConnectionErrorExc
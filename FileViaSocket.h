@@ -31,102 +31,249 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #define FILEVIASOCKET_H
 
 #include <ostream>
-#include <exception>
+#include "SocketBufferBase.h"
 
-/* SocketBuffer is the streambuf class which is used by the FileViaSocket ostream class.
- * All logic of sending data over an IP socket is implemented in this class. */
-class SocketBuffer : public std::streambuf {
+/* Transport of BasicSocketBuffer: a class with the static method send(), which sends the data to the connected
+ * socket and returns the number of bytes sent, or -1 on an error. The connection itself (connect, the messages
+ * from the server, shutdown) uses the socket API of the platform.
+ * SocketTransport is send() of the platform; an application may, e.g., wrap it to count or mirror the data. */
+struct SocketTransport {
+	static long send( int socket, const char *data, std::size_t len ) {
+		return SocketBufferBase::socketSend( socket, data, len );
+	}
+};
+
+/* Flush policies of BasicSocketBuffer: a class telling when the data are sent besides a full buffer and an explicit flush.
+ *   INLINE_WRITES  - writes, which fit in the buffer, are stored by inline code, without calling SocketBufferBase
+ *   flushAfter()   - returns true when the data just written should be sent at once */
+struct FlushWhenFull { // The data are sent when the buffer is full, or on flush() (the default)
+	static const bool INLINE_WRITES = true;
+	static bool flushAfter( const char*, std::size_t ) { return false; }
+};
+struct FlushEachLine { // Each complete line is sent at once (a log, which must reach the server line by line)
+	static const bool INLINE_WRITES = false; // Each write must be checked for '\n'
+	static bool flushAfter( const char *s, std::size_t n ) { return std::memchr( s, '\n', n ) != nullptr; }
+};
+
+/* The streambuf with SocketBufferBase, a buffer of BufferSize bytes (the size of the TCP segments the data are sent in),
+ * the Transport (see SocketTransport) and the FlushPolicy (see FlushWhenFull).
+ * It's header-only, so the fast path of the writes, which fit in the buffer, is compiled into the caller's code
+ * for the given configuration; the rest of the logic is shared by all configurations (FileViaSocket.cpp).
+ * With FlushPolicy::INLINE_WRITES, the buffer is the put area of the streambuf while the session allows it
+ * (see inlineWritesAllowed()). Characters are then stored by the inline code of std::streambuf (sputc()),
+ * and overflow() is called only when the buffer is full. */
+template<int BufferSize = SocketBufferBase::DEFAULT_BUFF_SIZE, class Transport = SocketTransport,
+         class FlushPolicy = FlushWhenFull>
+class BasicSocketBuffer final : public std::streambuf, public SocketBufferBase {
 public:
-	/* SOCKET_BUFF_SIZE is length of the array we use as buffer before sending the data via the socket.
-	 * Ideally it should be equal to the max. number of bytes sent in a TCP packet.
-	 * I tested using Wireshark that on FreeRTOS on Xilinx Zynq (using lwIP 2.1.3) 1446 bytes of data are sent
-	 * in one TCP packet. On Ubuntu 22.04 it's 1448 bytes and on Windows 11 it's 1460 bytes of data. */
-#ifdef __WIN32__
-	static int const SOCKET_BUFF_SIZE = 1460;
-#elif defined(__linux__)
-	static int const SOCKET_BUFF_SIZE = 1448;
-#else // If not Windows nor Linux, we assume FreeRTOS with lwIP
-	static int const SOCKET_BUFF_SIZE = 1446;
-#endif
-
-	SocketBuffer() : std::streambuf() {}
-	SocketBuffer( const std::string &serverIP, unsigned short port ) : std::streambuf() {
+	static int const SOCKET_BUFF_SIZE = BufferSize;
+	static_assert( BufferSize >= 2, "The buffer must hold at least two bytes" );
+
+	BasicSocketBuffer() : SocketBufferBase( Storage, BufferSize ) {}
+	BasicSocketBuffer( const std::string &serverIP, unsigned short port ) : SocketBufferBase( Storage, BufferSize ) {
 		open( serverIP, port );
 	}
-	~SocketBuffer() override { close(); }
-
-	void open( const std::string &ip, unsigned short port );
-	void close();
+	~BasicSocketBuffer() override { close(); } // The data are sent while our buffer and transport still exist
 
 protected:
+	/* This method is called when ostream wants to write a sequence of characters. */
+	std::streamsize xsputn( const char_type* s, std::streamsize n ) override {
+		if( n < epptr() - pptr() ) { // The fast path: the data fit in the put area (which is empty when not in use)
+			std::memcpy( pptr(), s, std::size_t(n) );
+			pbump( int(n) );
+			return n;
+		}
+		std::streamsize written = putChars( s, n );
+		if( written > 0 && FlushPolicy::flushAfter( s, std::size_t(written) ) )
+			flushImplicit();
+		return written;
+	}
+
 	/* This method is called when ostream wants to write one character
 	 * or to explicitly flush the buffer.*/
-	int overflow( int c ) override;
-
-	/* This method is called when ostream wants to write a sequence of characters. */
-	std::streamsize xsputn( const char_type* s, std::streamsize n ) override;
+	int_type overflow( int_type c ) override {
+		int result = putChar( c );
+		if( c != traits_type::eof() && result != traits_type::eof() ) {
+			char ch = char(c);
+			if( FlushPolicy::flushAfter( &ch, 1 ) )
+				flushImplicit();
+		}
+		return result;
+	}
 
 	/* This method is called when ostream wants to explicitly flush the buffer. */
-	int sync() override;
+	int sync() override {
+		return flush();
+	}
 
-private:
-	int Socket = -1;  // The IP socket file descriptor; value <0 means that the socket is closed
-	char buffer[SOCKET_BUFF_SIZE] = {}; // Buffer for writes to the socket
-	int bytesInBuffer{0};               // Number of bytes stored in the buffer
-}; //class SocketBuffer
-
-/* FileViaSocket is a simple descendant of ostream.
- * It is set to use our SocketBuffer streambuf. */
-class FileViaSocket : public std::ostream {
-public:
-	FileViaSocket() : std::ostream( &Buff ) {}
-	FileViaSocket( const std::string &serverIP, unsigned short port ) : std::ostream( &Buff ) {
-		Buff.open( serverIP, port );
+	long transportSend( int socket, const char *data, std::size_t len ) override {
+		return Transport::send( socket, data, len );
 	}
 
+	// Takes the characters stored in the put area over to bytesInBuffer, and stops using the put area
+	void releasePutArea() override {
+		if( pbase() ) {
+			bytesInBuffer = int( pptr() - pbase() );
+			setp( nullptr, nullptr );
+		}
+	}
+
+	// Makes the free part of the buffer the put area, when the session allows it
+	void armPutArea() override {
+		if( ! FlushPolicy::INLINE_WRITES || ! inlineWritesAllowed() )
+			return; // Our code must see each byte
+		/* The put area ends one byte before the end of the buffer, so overflow() is called for the character,
+		 * which fills the buffer, and sends the buffer. */
+		setp( buffer, buffer + bufferSize - 1 );
+		pbump( bytesInBuffer );
+	}
+
+private:
+	char Storage[BufferSize] = {}; // Buffer for writes to the socket
+}; //class BasicSocketBuffer
+
+/* SocketBuffer is the default configuration: the buffer of one TCP segment, send() of the platform,
+ * the data are sent when the buffer is full or on flush(). */
+using SocketBuffer = BasicSocketBuffer<>;
+
+/* FileViaSocketBase is a simple descendant of ostream, which forwards the settings to the SocketBufferBase.
+ * The ostream used by the application is BasicFileViaSocket (or FileViaSocket, its default configuration),
+ * which owns the streambuf. */
+class FileViaSocketBase : public std::ostream, public FileViaSocketErrors {
+public:
 	void open( const std::string &ip, unsigned short port ) {
 		Buff.open( ip, port );
 	}
+	void open( const std::vector<SocketBufferBase::Receiver> &pool, const std::string &key ) {
+		Buff.open( pool, key );
+	}
+	const std::string &serverIP() const {
+		return Buff.serverIP();
+	}
+	unsigned short serverPort() const {
+		return Buff.serverPort();
+	}
+	/* Sets badbit when the remaining data weren't sent. */
 	void close() {
-		Buff.close();
+		if( Buff.close() != 0 )
+			setstate( std::ios_base::badbit );
+	}
+
+	void setCompression( SocketBufferBase::Compression mode ) {
+		Buff.setCompression( mode );
+	}
+	void setDictionary( const void *dictionary, std::size_t size ) {
+		Buff.setDictionary( dictionary, size );
+	}
+
+	void setLatencyMeasurement( bool enable ) {
+		Buff.setLatencyMeasurement( enable );
+	}
+	const LatencyHistogram &latency() const {
+		return Buff.latency();
+	}
+
+	const SocketBufferBase::Stats &stats() const {
+		return Buff.stats();
+	}
+	void setTimeAccounting( bool enable ) {
+		Buff.setTimeAccounting( enable );
+	}
+	std::string statsSummary() const {
+		return Buff.statsSummary();
+	}
+	void setSendBufferAutotune( bool enable, std::uint32_t maxBytes = 16*1024*1024 ) {
+		Buff.setSendBufferAutotune( enable, maxBytes );
+	}
+
+	void setNoDelay( bool enable ) {
+		Buff.setNoDelay( enable );
+	}
+	void setControlChannel( bool enable ) {
+		Buff.setControlChannel( enable );
+	}
+	RecordFilter &recordFilter() {
+		return Buff.recordFilter();
+	}
+	void setTimestamps( SocketBufferBase::TimestampFormat format, bool prefixEachRecord = false ) {
+		Buff.setTimestamps( format, prefixEachRecord );
+	}
+	unsigned verbosity() const {
+		return Buff.verbosity();
+	}
+	bool verbosityAllows( unsigned level ) const {
+		return Buff.verbosityAllows( level );
+	}
+	bool bulkPaused() const {
+		return Buff.bulkPaused();
+	}
+	unsigned flushIntervalMs() const {
+		return Buff.flushIntervalMs();
+	}
+	/* Sets badbit on a socket error (see SocketBufferBase::flushIfDue). */
+	FileViaSocketBase &flushIfDue() {
+		if( Buff.flushIfDue() != 0 )
+			setstate( std::ios_base::badbit );
+		return *this;
+	}
+
+	/* Streams totalBytes produced by the generator (see SocketBufferBase::writeFrom).
+	 * Sets badbit on a socket error. Returns the number of bytes produced. */
+	std::streamsize writeFrom( const SocketBufferBase::Generator &generator, std::streamsize totalBytes ) {
+		std::streamsize n = Buff.writeFrom( generator, totalBytes );
+		if( n < 0 )
+			setstate( std::ios_base::badbit );
+		return n;
 	}
 
 protected:
-	SocketBuffer Buff;
+	FileViaSocketBase( std::streambuf &streamBuff, SocketBufferBase &buff ) : std::ostream( &streamBuff ), Buff( buff ) {}
 
+	SocketBufferBase &Buff;
+}; //class FileViaSocketBase
+
+/* The ostream with BasicSocketBuffer<BufferSize, Transport, FlushPolicy>, e.g.,
+ * BasicFileViaSocket<8192, SocketTransport, FlushEachLine> log( "192.168.44.44", 65432 ); */
+template<int BufferSize = SocketBufferBase::DEFAULT_BUFF_SIZE, class Transport = SocketTransport,
+         class FlushPolicy = FlushWhenFull>
+class BasicFileViaSocket : public FileViaSocketBase {
 public:
-	/***** Definition of exceptions specific to the FileViaSocket *****/
-	class WrongServerIPFormatExc : public std::exception {
-	public:
-		WrongServerIPFormatExc() : message("Server IP was provided in a wrong format!") {}
-		explicit WrongServerIPFormatExc( std::string &m ) : message(m) {}
-
-		// Override the what() method to return a custom error message
-		[[nodiscard]] const char* what() const noexcept override {
-			return message.c_str();
-		}
-	private:
-		std::string message;
-	};
-	class SocketCreationErrorExc : public std::exception {
-	public:
-		explicit SocketCreationErrorExc( int errCode );
-		[[nodiscard]] const char* what() const noexcept override {
-			return message.c_str();
-		}
-	private:
-		std::string message;
-	};
-	class SocketConnectionErrorExc : public std::exception {
-	public:
-		explicit SocketConnectionErrorExc( int errCode );
-		[[nodiscard]] const char* what() const noexcept override {
-			return message.c_str();
-		}
-	private:
-		std::string message;
-	};
-}; //class FileViaSocket
+	BasicFileViaSocket() : FileViaSocketBase( Buffer, Buffer ) {}
+	BasicFileViaSocket( const std::string &serverIP, unsigned short port ) : FileViaSocketBase( Buffer, Buffer ) {
+		Buffer.open( serverIP, port );
+	}
+
+protected:
+	BasicSocketBuffer<BufferSize, Transport, FlushPolicy> Buffer;
+}; //class BasicFileViaSocket
+
+/* FileViaSocket is the ostream with the default configuration of the buffer (see SocketBuffer). */
+using FileViaSocket = BasicFileViaSocket<>;
+
+/* Manipulator writing the hardware timestamp (see SocketBufferBase::setTimestamps()) in the format
+ * configured for the stream (hex when none is configured or the stream isn't a FileViaSocket). */
+inline std::ostream &hwTimestamp( std::ostream &os )
+{
+	SocketBufferBase::TimestampFormat format = SocketBufferBase::TimestampFormat::Hex;
+	const SocketBufferBase *b = dynamic_cast<const SocketBufferBase*>( os.rdbuf() );
+	if( b && b->timestampFormat() != SocketBufferBase::TimestampFormat::None )
+		format = b->timestampFormat();
+	char timestamp[SocketBufferBase::MAX_TIMESTAMP_SIZE];
+	return os.write( timestamp, std::streamsize(SocketBufferBase::formatTimestamp( timestamp, format )) );
+} // hwTimestamp
+
+/* Manipulator writing the record "#FVS-STATS <SocketBufferBase::statsSummary()>" to the stream,
+ * so the statistics of the session land in the file on the server: f << streamStats;
+ * (Nothing is written when the stream isn't a FileViaSocket.) */
+inline std::ostream &streamStats( std::ostream &os )
+{
+	const SocketBufferBase *b = dynamic_cast<const SocketBufferBase*>( os.rdbuf() );
+	if( b ) {
+		std::string record = "#FVS-STATS " + b->statsSummary() + "\n";
+		os.write( record.data(), std::streamsize(record.size()) );
+	}
+	return os;
+} // streamStats
 
 
 #endif //FILEVIASOCKET_H
@@ -0,0 +1,307 @@
+/*
+This is the source file of the C API of FileViaSocket (see FileViaSocketC.h).
+Details are explained on GitHub: https://github.com/viktor-nikolov/lwIP-file-via-socket
+
+BSD 2-Clause License:
+
+Copyright (c) 2024 Viktor Nikolov
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+#include "FileViaSocketC.h"
+#include "SocketBufferBase.h" // Not FileViaSocket.h, which pulls in <ostream>
+#include <cstdarg>
+#include <cstdint>
+#include <cstring>
+#include <new>
+
+/* The C stream is SocketBufferBase with its buffer, without the streambuf and the ostream of FileViaSocket.
+ * The formatting is our own, so no iostreams, num_put nor locale facets are linked in. */
+struct fvs_stream final : public SocketBufferBase {
+	fvs_stream() : SocketBufferBase( Storage, DEFAULT_BUFF_SIZE ) {}
+	~fvs_stream() override { close(); } // The data are sent while our buffer still exists
+
+	char Storage[DEFAULT_BUFF_SIZE] = {}; // Buffer for writes to the socket
+};
+
+namespace {
+/* Writes the digits of v in the given base in front of end; returns the pointer to the first digit. */
+char *formatUnsigned( char *end, unsigned long long v, unsigned base, bool upperCase )
+{
+	const char *digits = upperCase ? "0123456789ABCDEF" : "0123456789abcdef";
+	do {
+		*--end = digits[v % base];
+		v /= base;
+	} while( v != 0 );
+	return end;
+} // formatUnsigned
+
+/* Collects the output of fvs_printf(), so the pieces of a record reach the stream by a few calls of putChars(). */
+class FormatBuffer {
+public:
+	explicit FormatBuffer( fvs_stream &stream ) : Stream( stream ) {}
+
+	/* Appends the data; returns false on a socket error. */
+	bool put( const char *s, std::size_t len ) {
+		if( used + len > sizeof(Text) ) {
+			if( ! flush() )
+				return false;
+			if( len > sizeof(Text) ) // Long strings go to the stream directly
+				return Stream.putChars( s, std::streamsize(len) ) == std::streamsize(len);
+		}
+		std::memcpy( Text + used, s, len );
+		used += len;
+		return true;
+	}
+
+	/* Appends count times the character c; returns false on a socket error. */
+	bool pad( char c, int count ) {
+		for( ; count > 0; count-- ) {
+			if( used == sizeof(Text) && ! flush() )
+				return false;
+			Text[used++] = c;
+		}
+		return true;
+	}
+
+	/* Writes the collected data to the stream; returns false on a socket error. */
+	bool flush() {
+		std::size_t len = used;
+		used = 0;
+		return len == 0 || Stream.putChars( Text, std::streamsize(len) ) == std::streamsize(len);
+	}
+
+private:
+	fvs_stream &Stream;
+	char Text[128];
+	std::size_t used{0};
+};
+
+enum class Length { Default, Short, Long, LongLong, Size };
+
+/* The printf subset of fvs_printf(). Returns the number of characters written, or -1. */
+int formatTo( fvs_stream &stream, const char *format, va_list args )
+{
+	FormatBuffer b( stream );
+	int written{0};
+	const char *p = format;
+	while( *p ) {
+		const char *text = p; // Text till the next conversion is copied verbatim
+		while( *p && *p != '%' )
+			p++;
+		if( ! b.put( text, std::size_t(p - text) ) )
+			return -1;
+		written += int(p - text);
+		if( *p == '\0' )
+			break;
+		p++; // The '%'
+
+		bool leftAlign{false}, zeroPad{false};
+		for( ;; p++ ) {
+			if( *p == '-' )
+				leftAlign = true;
+			else if( *p == '0' )
+				zeroPad = true;
+			else
+				break;
+		}
+		int width{0};
+		if( *p == '*' ) {
+			width = va_arg( args, int );
+			if( width < 0 ) {
+				leftAlign = true;
+				width = -width;
+			}
+			p++;
+		} else {
+			while( *p >= '0' && *p <= '9' )
+				width = width * 10 + (*p++ - '0');
+		}
+		int precision{-1};
+		if( *p == '.' ) {
+			p++;
+			precision = 0;
+			if( *p == '*' ) {
+				precision = va_arg( args, int );
+				p++;
+			} else {
+				while( *p >= '0' && *p <= '9' )
+					precision = precision * 10 + (*p++ - '0');
+			}
+		}
+		Length length{ Length::Default };
+		if( *p == 'h' ) {
+			length = Length::Short; // Promoted to int anyway
+			if( *++p == 'h' )
+				p++;
+		} else if( *p == 'l' ) {
+			length = Length::Long;
+			if( *++p == 'l' ) {
+				length = Length::LongLong;
+				p++;
+			}
+		} else if( *p == 'z' ) {
+			length = Length::Size;
+			p++;
+		}
+
+		char digits[24];                          // Enough for a 64-bit number in octal
+		char *digitsEnd = digits + sizeof(digits);
+		const char *prefix = "";                  // Sign or "0x"
+		bool number{true};
+		std::size_t len{1};                       // Length of the text, which isn't a number
+		char c;
+		switch( *p ) {
+			case 'd':
+			case 'i': {
+				long long v;
+				switch( length ) {
+					case Length::Long:     v = va_arg( args, long ); break;
+					case Length::LongLong: v = va_arg( args, long long ); break;
+					case Length::Size:     v = va_arg( args, std::ptrdiff_t ); break;
+					default:               v = va_arg( args, int ); break;
+				}
+				if( v < 0 )
+					prefix = "-";
+				text = formatUnsigned( digitsEnd, v < 0 ? 0ULL - (unsigned long long)v : (unsigned long long)v, 10, false );
+				break;
+			}
+			case 'u':
+			case 'x':
+			case 'X':
+			case 'o': {
+				unsigned long long v;
+				switch( length ) {
+					case Length::Long:     v = va_arg( args, unsigned long ); break;
+					case Length::LongLong: v = va_arg( args, unsigned long long ); break;
+					case Length::Size:     v = va_arg( args, std::size_t ); break;
+					default:               v = va_arg( args, unsigned ); break;
+				}
+				text = formatUnsigned( digitsEnd, v, *p == 'u' ? 10 : *p == 'o' ? 8 : 16, *p == 'X' );
+				break;
+			}
+			case 'p':
+				prefix = "0x";
+				text = formatUnsigned( digitsEnd, std::uintptr_t( va_arg( args, void* ) ), 16, false );
+				break;
+			case 'c':
+				c = char( va_arg( args, int ) );
+				text = &c;
+				number = false;
+				break;
+			case 's':
+				text = va_arg( args, const char* );
+				if( text == nullptr )
+					text = "(null)";
+				if( precision >= 0 ) { // At most precision characters
+					const void *nul = std::memchr( text, '\0', std::size_t(precision) );
+					len = nul ? std::size_t(static_cast<const char*>(nul) - text) : std::size_t(precision);
+				} else
+					len = std::strlen( text );
+				number = false;
+				break;
+			case '%':
+				text = "%";
+				number = false;
+				break;
+			default: // Unsupported conversion (e.g., floating point)
+				return -1;
+		}
+		p++;
+
+		if( number )
+			len = std::size_t(digitsEnd - text);
+
+		const std::size_t prefixLen = std::strlen( prefix );
+		const int padding = width - int(prefixLen + len);
+		if( ! leftAlign && ! (zeroPad && number) && ! b.pad( ' ', padding ) )
+			return -1;
+		if( ! b.put( prefix, prefixLen ) )
+			return -1;
+		if( ! leftAlign && zeroPad && number && ! b.pad( '0', padding ) )
+			return -1;
+		if( ! b.put( text, len ) )
+			return -1;
+		if( leftAlign && ! b.pad( ' ', padding ) )
+			return -1;
+		written += int(prefixLen + len) + (padding > 0 ? padding : 0);
+	}
+	return b.flush() ? written : -1;
+} // formatTo
+} // namespace
+
+int fvs_open( fvs_stream **stream, const char *serverIP, unsigned short port )
+{
+	*stream = nullptr;
+	fvs_stream *s = new (std::nothrow) fvs_stream;
+	if( s == nullptr )
+		return FVS_ERR_MEMORY;
+	int result{0};
+	try {
+		s->open( serverIP, port );
+	}
+	catch( const FileViaSocketErrors::WrongServerIPFormatExc& ) {
+		result = FVS_ERR_ADDRESS;
+	}
+	catch( const FileViaSocketErrors::SocketCreationErrorExc& ) {
+		result = FVS_ERR_SOCKET;
+	}
+	catch( const std::bad_alloc& ) {
+		result = FVS_ERR_MEMORY;
+	}
+	catch( const std::exception& ) {
+		result = FVS_ERR_CONNECT;
+	}
+	if( result != 0 ) {
+		delete s;
+		return result;
+	}
+	*stream = s;
+	return 0;
+} // fvs_open
+
+ptrdiff_t fvs_write( fvs_stream *stream, const void *data, size_t len )
+{
+	if( len > std::size_t(PTRDIFF_MAX) ) // The length wouldn't fit in the result
+		return -1;
+	return len == 0 || stream->putChars( static_cast<const char*>(data), std::streamsize(len) ) == std::streamsize(len)
+	       ? ptrdiff_t(len) : -1;
+} // fvs_write
+
+int fvs_printf( fvs_stream *stream, const char *format, ... )
+{
+	va_list args;
+	va_start( args, format );
+	int written = formatTo( *stream, format, args );
+	va_end( args );
+	return written;
+} // fvs_printf
+
+int fvs_flush( fvs_stream *stream )
+{
+	return stream->flush() == 0 ? 0 : -1;
+} // fvs_flush
+
+void fvs_close( fvs_stream *stream )
+{
+	if( stream == nullptr )
+		return;
+	stream->close();
+	delete stream;
+} // fvs_close
@@ -0,0 +1,75 @@
+/*
+This is the header file of the C API of FileViaSocket: writing a file on a remote system via an IP socket connection
+from C code, without the C++ iostreams.
+Details are explained on GitHub: https://github.com/viktor-nikolov/lwIP-file-via-socket
+
+BSD 2-Clause License:
+
+Copyright (c) 2024 Viktor Nikolov
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+#ifndef FILEVIASOCKETC_H
+#define FILEVIASOCKETC_H
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* The stream is the same buffering and transport code as the C++ class FileViaSocket (SocketBufferBase):
+ * the data are sent in TCP packets of the full size, when the buffer is full or on fvs_flush().
+ * A stream must be used by one task at a time. */
+typedef struct fvs_stream fvs_stream;
+
+/* Error codes returned by fvs_open() */
+#define FVS_ERR_ADDRESS  (-1) /* The server IP was provided in a wrong format */
+#define FVS_ERR_SOCKET   (-2) /* The socket couldn't be created */
+#define FVS_ERR_CONNECT  (-3) /* The connection to the server failed */
+#define FVS_ERR_MEMORY   (-4) /* Out of memory */
+
+/* Opens the connection to the server (e.g., "192.168.44.44", 65432) and stores the new stream to *stream.
+ * Returns 0 on success, or one of FVS_ERR_*. */
+int fvs_open( fvs_stream **stream, const char *serverIP, unsigned short port );
+
+/* Writes len bytes to the stream. Returns len, or -1 on a socket error (or when len exceeds PTRDIFF_MAX). */
+ptrdiff_t fvs_write( fvs_stream *stream, const void *data, size_t len );
+
+/* Writes formatted text to the stream. A subset of printf: the conversions %d %i %u %x %X %o %c %s %p %%,
+ * the flags '-' and '0', the width (also '*'), the precision of %s, and the length modifiers h, l, ll, z.
+ * Floating point isn't supported (it would pull in the floating point formatting of the C library).
+ * Returns the number of characters written, or -1 on a socket error or an unsupported conversion. */
+int fvs_printf( fvs_stream *stream, const char *format, ... )
+#ifdef __GNUC__
+	__attribute__(( format( printf, 2, 3 ) ))
+#endif
+	;
+
+/* Sends the data in the buffer to the server. Returns 0 on success, or -1 on a socket error. */
+int fvs_flush( fvs_stream *stream );
+
+/* Sends the remaining data, closes the connection (the file is complete on the server) and frees the stream. */
+void fvs_close( fvs_stream *stream );
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* FILEVIASOCKETC_H */
@@ -0,0 +1,175 @@
+/*
+This is the source file for the flight recorder, which keeps the newest data in RAM and sends them
+via the FileViaSocket ostream class only when a trigger occurs.
+Details are explained on GitHub: https://github.com/viktor-nikolov/lwIP-file-via-socket
+
+BSD 2-Clause License:
+
+Copyright (c) 2024 Viktor Nikolov
+
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+#include "FlightRecorderViaSocket.h"
+#include <algorithm>
+
+FlightRecorderBuffer::FlightRecorderBuffer( FileViaSocketBase &stream, const std::string &serverIP, unsigned short port,
+                                            std::size_t preTriggerBytes, std::size_t postTriggerBytes )
+	: Stream( stream ), ServerIP( serverIP ), ServerPort( port ), RingSize( std::max<std::size_t>( preTriggerBytes, 1 ) ),
+	  PostTriggerBytes( postTriggerBytes )
+{
+	Ring.reset( new char[RingSize] );
+	clearRing();
+} // FlightRecorderBuffer::FlightRecorderBuffer
+
+void FlightRecorderBuffer::clearRing()
+{
+	setp( Ring.get(), Ring.get() + RingSize );
+	Checked = Ring.get();
+	WrapsSinceCheck = 0;
+	Wrapped = false;
+} // FlightRecorderBuffer::clearRing
+
+std::size_t FlightRecorderBuffer::recordedBytes() const
+{
+	if( Uploading )
+		return 0;
+	return Wrapped ? RingSize : std::size_t(pptr() - Ring.get());
+} // FlightRecorderBuffer::recordedBytes
+
+FlightRecorderBuffer::int_type FlightRecorderBuffer::overflow( int_type c )
+{
+	if( Uploading )
+		sendStaged(); // The put area is full, or the window is complete (then we are recording again)
+	else { // The end of the ring; continue from its beginning
+		setp( Ring.get(), Ring.get() + RingSize );
+		Wrapped = true;
+		WrapsSinceCheck++;
+	}
+
+	if( traits_type::eq_int_type( c, traits_type::eof() ) )
+		return traits_type::not_eof( c );
+	*pptr() = traits_type::to_char_type( c );
+	pbump( 1 );
+	return c;
+} // FlightRecorderBuffer::overflow
+
+int FlightRecorderBuffer::sync()
+{
+	if( Uploading ) {
+		sendStaged();
+		if( Uploading )
+			Stream.flush();
+	} else
+		checkPredicate();
+	return 0;
+} // FlightRecorderBuffer::sync
+
+/* Passes the data written since the previous call to the predicate; calls trigger() when it returns true. */
+void FlightRecorderBuffer::checkPredicate()
+{
+	char *head = pptr();
+	char *ringEnd = Ring.get() + RingSize;
+	const char *part[2][2] = { { nullptr, nullptr }, { nullptr, nullptr } }; // Begin and end of up to two parts
+	if( WrapsSinceCheck == 0 )
+		part[0][0] = Checked, part[0][1] = head;
+	else if( WrapsSinceCheck == 1 && head <= Checked )
+		part[0][0] = Checked, part[0][1] = ringEnd, part[1][0] = Ring.get(), part[1][1] = head;
+	else // More than the ring size was written; the data still in the ring are passed
+		part[0][0] = head, part[0][1] = ringEnd, part[1][0] = Ring.get(), part[1][1] = head;
+	Checked = head;
+	WrapsSinceCheck = 0;
+
+	if( ! Predicate )
+		return;
+	for( auto &p : part )
+		if( p[1] != p[0] && Predicate( p[0], std::size_t(p[1] - p[0]) ) ) {
+			trigger();
+			return;
+		}
+} // FlightRecorderBuffer::checkPredicate
+
+bool FlightRecorderBuffer::trigger()
+{
+	if( Uploading )
+		return true;
+
+	Stream.clear();
+	try {
+		Stream.open( ServerIP, ServerPort );
+	}
+	catch( const std::exception& ) {
+		Failures++;
+		return false;
+	}
+
+	// The content of the ring, the oldest data first
+	char *head = pptr();
+	if( Wrapped )
+		Stream.write( head, Ring.get() + RingSize - head );
+	Stream.write( Ring.get(), head - Ring.get() );
+	if( ! Stream ) {
+		Stream.close();
+		Failures++;
+		return false;
+	}
+
+	// The ring is the staging buffer of the post-trigger data now
+	Uploading = true;
+	PostRemaining = PostTriggerBytes;
+	clearRing();
+	if( PostRemaining == 0 )
+		endUpload( true );
+	else
+		setp( Ring.get(), Ring.get() + std::min( RingSize, PostRemaining ) );
+	return true;
+} // FlightRecorderBuffer::trigger
+
+void FlightRecorderBuffer::sendStaged()
+{
+	std::size_t len = std::size_t(pptr() - pbase());
+	Stream.write( pbase(), std::streamsize(len) );
+	PostRemaining -= len;
+	if( ! Stream )
+		endUpload( false );
+	else if( PostRemaining == 0 )
+		endUpload( true );
+	else
+		setp( Ring.get(), Ring.get() + std::min( RingSize, PostRemaining ) );
+} // FlightRecorderBuffer::sendStaged
+
+void FlightRecorderBuffer::finishUpload()
+{
+	if( ! Uploading )
+		return;
+	std::size_t len = std::size_t(pptr() - pbase());
+	Stream.write( pbase(), std::streamsize(len) );
+	endUpload( bool(Stream) );
+} // FlightRecorderBuffer::finishUpload
+
+void FlightRecorderBuffer::endUpload( bool ok )
+{
+	Stream.close();
+	Uploading = false;
+	if( ok )
+		Uploads++;
+	else
+		Failures++;
+	clearRing();
+} // FlightRecorderBuffer::endUpload
@@ -0,0 +1,137 @@
+/*
+This is the header file for the flight recorder, which keeps the newest data in RAM and sends them
+via the FileViaSocket ostream class only when a trigger occurs.
+Details are explained on GitHub: https://github.com/viktor-nikolov/lwIP-file-via-socket
+
+BSD 2-Clause License:
+
+Copyright (c) 2024 Viktor Nikolov
+
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+#ifndef FLIGHTRECORDERVIASOCKET_H
+#define FLIGHTRECORDERVIASOCKET_H
+
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <ostream>
+#include <streambuf>
+#include <string>
+#include "FileViaSocket.h"
+
+/* The buffer of FlightRecorderViaSocket. While recording, the ring in RAM is the put area of the streambuf,
+ * so a write is a memcpy and there is no network activity at all. When the end of the ring is reached,
+ * we continue from its beginning, overwriting the oldest data.
+ *
+ * On a trigger, the content of the ring (the newest preTriggerBytes written, the oldest first) is sent to
+ * the receiver. The next postTriggerBytes written are forwarded to the receiver too, then the connection
+ * is closed and the recording continues with an empty ring. The data of one trigger are one session,
+ * i.e., one file on the server. */
+class FlightRecorderBuffer : public std::streambuf {
+public:
+	/* Predicate of the trigger. It's called on each flush (std::flush, std::endl, etc.) during the recording
+	 * with the data written since the previous flush. (When the ring wrapped around in between, it's called
+	 * for each of the two parts. When more than the size of the ring was written in between, only the data
+	 * still in the ring are passed.) */
+	using TriggerPredicate = std::function<bool( const char *data, std::size_t len )>;
+
+	FlightRecorderBuffer( FileViaSocketBase &stream, const std::string &serverIP, unsigned short port,
+	                      std::size_t preTriggerBytes, std::size_t postTriggerBytes );
+
+	FlightRecorderBuffer( const FlightRecorderBuffer& ) = delete;
+	FlightRecorderBuffer &operator=( const FlightRecorderBuffer& ) = delete;
+
+	/* Connects to the receiver and sends the content of the ring; the data written next are forwarded till
+	 * postTriggerBytes are sent. Returns false when the connection failed or the upload was aborted by
+	 * a socket error (the content of the ring is kept then). Has no effect while an upload is running.
+	 * Must be called by the task writing to the recorder. */
+	bool trigger();
+
+	void setTriggerPredicate( TriggerPredicate predicate ) { Predicate = std::move( predicate ); }
+
+	/* Ends a running upload before the whole post-trigger window was written: the post-trigger data written
+	 * so far are sent and the connection is closed. The data written next are recorded to the ring again. */
+	void finishUpload();
+
+	bool uploading() const { return Uploading; }
+	unsigned uploadCount() const { return Uploads; }        // Uploads completed
+	unsigned failedUploadCount() const { return Failures; } // Uploads, which failed by a socket error
+	std::size_t recordedBytes() const;                     // Bytes in the ring now
+
+protected:
+	int_type overflow( int_type c ) override;
+	int sync() override;
+
+private:
+	void checkPredicate();
+	void sendStaged(); // Sends the post-trigger data collected in the ring
+	void endUpload( bool ok );
+	void clearRing();
+
+	FileViaSocketBase &Stream;
+	const std::string ServerIP;
+	const unsigned short ServerPort;
+	std::unique_ptr<char[]> Ring;
+	const std::size_t RingSize;
+	const std::size_t PostTriggerBytes;
+	std::size_t PostRemaining{0};       // Bytes of the post-trigger window still to be forwarded
+	char *Checked{nullptr};             // Position in the ring, up to which the predicate has seen the data
+	unsigned WrapsSinceCheck{0};        // How many times the ring wrapped around since the predicate was called
+	bool Wrapped{false};                // The ring was filled at least once since it was cleared
+	bool Uploading{false};
+	unsigned Uploads{0};
+	unsigned Failures{0};
+	TriggerPredicate Predicate;
+}; //class FlightRecorderBuffer
+
+/* FlightRecorderViaSocket is an ostream recording to a ring in RAM; the data are sent to the receiver only
+ * when a trigger occurs (see FlightRecorderBuffer). The settings of the connection (compression, timestamps,
+ * etc.) are the settings of the FileViaSocket stream passed, which is opened for each upload. The stream
+ * mustn't be used for anything else.
+ *
+ * FileViaSocket upload;
+ * FlightRecorderViaSocket recorder( upload, "192.168.44.44", 65432, 8*1024*1024, 1024*1024 );
+ * recorder.setTriggerPredicate( []( const char *data, std::size_t len ) {
+ *     return std::string_view( data, len ).find( "ERROR" ) != std::string_view::npos; } );
+ * recorder << "sample " << i << std::endl; */
+class FlightRecorderViaSocket : public std::ostream {
+public:
+	FlightRecorderViaSocket( FileViaSocketBase &stream, const std::string &serverIP, unsigned short port,
+	                         std::size_t preTriggerBytes, std::size_t postTriggerBytes )
+		: std::ostream( &Buffer ), Buffer( stream, serverIP, port, preTriggerBytes, postTriggerBytes ) {}
+
+	~FlightRecorderViaSocket() { Buffer.finishUpload(); }
+
+	bool trigger() { return Buffer.trigger(); }
+	void setTriggerPredicate( FlightRecorderBuffer::TriggerPredicate predicate ) {
+		Buffer.setTriggerPredicate( std::move( predicate ) );
+	}
+	void finishUpload() { Buffer.finishUpload(); }
+	bool uploading() const { return Buffer.uploading(); }
+	unsigned uploadCount() const { return Buffer.uploadCount(); }
+	unsigned failedUploadCount() const { return Buffer.failedUploadCount(); }
+	std::size_t recordedBytes() const { return Buffer.recordedBytes(); }
+
+private:
+	FlightRecorderBuffer Buffer;
+}; //class FlightRecorderViaSocket
+
+#endif //FLIGHTRECORDERVIASOCKET_H
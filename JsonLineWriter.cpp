@@ -0,0 +1,232 @@
+/*
+This is the source file for the writer of structured events as JSON lines to the FileViaSocket ostream class.
+Details are explained on GitHub: https://github.com/viktor-nikolov/lwIP-file-via-socket
+
+BSD 2-Clause License:
+
+Copyright (c) 2024 Viktor Nikolov
+
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+#include "JsonLineWriter.h"
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+
+/* The scan for the characters to be escaped checks 16 bytes per step: with SSE2 on x86 (always available
+ * on x86-64) and with NEON on ARM (on Zynq-7000, the code must be compiled with -mfpu=neon, otherwise
+ * __ARM_NEON isn't defined and the scalar loop is used). */
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#   include <emmintrin.h>
+#   define FVS_JSON_SSE2
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#   include <arm_neon.h>
+#   define FVS_JSON_NEON
+#endif
+
+namespace {
+inline bool needsEscape( char c )
+{
+	return static_cast<unsigned char>( c ) < 0x20 || c == '"' || c == '\\';
+}
+
+/* Returns the length of the prefix of s, which doesn't need escaping. */
+std::size_t cleanPrefix( const char *s, std::size_t len )
+{
+	std::size_t i{0};
+#if defined(FVS_JSON_SSE2)
+	const __m128i quote = _mm_set1_epi8( '"' ), backslash = _mm_set1_epi8( '\\' ), control = _mm_set1_epi8( 0x1F );
+	for( ; i + 16 <= len; i += 16 ) {
+		__m128i v = _mm_loadu_si128( reinterpret_cast<const __m128i*>( s + i ) );
+		__m128i m = _mm_or_si128( _mm_or_si128( _mm_cmpeq_epi8( v, quote ), _mm_cmpeq_epi8( v, backslash ) ),
+		                          _mm_cmpeq_epi8( _mm_max_epu8( v, control ), control ) ); // v <= 0x1F (unsigned)
+		int bits = _mm_movemask_epi8( m );
+		if( bits != 0 ) {
+#   if defined(__GNUC__)
+			return i + std::size_t( __builtin_ctz( unsigned( bits ) ) );
+#   else
+			break; // The scalar loop finds the position in this block
+#   endif
+		}
+	}
+#elif defined(FVS_JSON_NEON)
+	const uint8x16_t quote = vdupq_n_u8( '"' ), backslash = vdupq_n_u8( '\\' ), space = vdupq_n_u8( 0x20 );
+	for( ; i + 16 <= len; i += 16 ) {
+		uint8x16_t v = vld1q_u8( reinterpret_cast<const std::uint8_t*>( s + i ) );
+		uint8x16_t m = vorrq_u8( vorrq_u8( vceqq_u8( v, quote ), vceqq_u8( v, backslash ) ), vcltq_u8( v, space ) );
+		uint8x8_t folded = vorr_u8( vget_low_u8( m ), vget_high_u8( m ) ); // (ARMv7 has no horizontal max)
+		if( vget_lane_u64( vreinterpret_u64_u8( folded ), 0 ) != 0 )
+			break; // The scalar loop finds the position in this block
+	}
+#endif
+	for( ; i < len; i++ )
+		if( needsEscape( s[i] ) )
+			return i;
+	return len;
+} // cleanPrefix
+} // namespace
+
+JsonLineWriter &JsonLineWriter::begin()
+{
+	put( '{' );
+	FirstField = true;
+	return *this;
+} // JsonLineWriter::begin
+
+void JsonLineWriter::end()
+{
+	reserve( 2 );
+	Text[Used++] = '}';
+	Text[Used++] = '\n';
+	spill();
+} // JsonLineWriter::end
+
+JsonLineWriter &JsonLineWriter::field( std::string_view key, std::string_view value )
+{
+	putKey( key );
+	putString( value );
+	return *this;
+} // JsonLineWriter::field
+
+JsonLineWriter &JsonLineWriter::field( std::string_view key, const char *value )
+{
+	if( value == nullptr )
+		return field( key, nullptr );
+	return field( key, std::string_view( value ) );
+} // JsonLineWriter::field
+
+JsonLineWriter &JsonLineWriter::field( std::string_view key, bool value )
+{
+	putKey( key );
+	if( value )
+		put( "true", 4 );
+	else
+		put( "false", 5 );
+	return *this;
+} // JsonLineWriter::field
+
+JsonLineWriter &JsonLineWriter::field( std::string_view key, double value )
+{
+	if( ! std::isfinite( value ) )
+		return field( key, nullptr );
+	putKey( key );
+	reserve( 32 ); // The shortest representation of a double has at most 24 characters
+#if defined(__cpp_lib_to_chars) // Floating point to_chars (since GCC 11)
+	Used = std::size_t( std::to_chars( Text + Used, Text + LINE_BUFFER_SIZE, value ).ptr - Text );
+#else
+	/* snprintf writes the decimal separator of the C locale (LC_NUMERIC), e.g. ',' in a German locale, which isn't
+	 * valid JSON; the separator (possibly of several bytes) is replaced by '.'. */
+	char *number = Text + Used;
+	int length = std::snprintf( number, LINE_BUFFER_SIZE - Used, "%.17g", value );
+	std::size_t end{0};
+	for( int i = 0; i < length; i++ ) {
+		char c = number[i];
+		if( ( c >= '0' && c <= '9' ) || c == '-' || c == '+' || c == 'e' )
+			number[end++] = c;
+		else if( end == 0 || number[end - 1] != '.' )
+			number[end++] = '.';
+	}
+	Used += end;
+#endif
+	return *this;
+} // JsonLineWriter::field
+
+JsonLineWriter &JsonLineWriter::field( std::string_view key, std::nullptr_t )
+{
+	putKey( key );
+	put( "null", 4 );
+	return *this;
+} // JsonLineWriter::field
+
+JsonLineWriter &JsonLineWriter::rawField( std::string_view key, std::string_view json )
+{
+	putKey( key );
+	put( json.data(), json.size() );
+	return *this;
+} // JsonLineWriter::rawField
+
+void JsonLineWriter::putKey( std::string_view key )
+{
+	if( ! FirstField )
+		put( ',' );
+	FirstField = false;
+	putString( key );
+	put( ':' );
+} // JsonLineWriter::putKey
+
+/* Writes s in quotes. The parts, which don't need escaping, are found by cleanPrefix() and copied by memcpy. */
+void JsonLineWriter::putString( std::string_view s )
+{
+	static const char HEX[] = "0123456789abcdef";
+	put( '"' );
+	const char *p = s.data();
+	std::size_t left = s.size();
+	while( left > 0 ) {
+		std::size_t clean = cleanPrefix( p, left );
+		put( p, clean );
+		p += clean;
+		left -= clean;
+		if( left == 0 )
+			break;
+
+		reserve( 6 );
+		char c = *p++;
+		left--;
+		Text[Used++] = '\\';
+		switch( c ) {
+			case '"':  Text[Used++] = '"'; break;
+			case '\\': Text[Used++] = '\\'; break;
+			case '\n': Text[Used++] = 'n'; break;
+			case '\r': Text[Used++] = 'r'; break;
+			case '\t': Text[Used++] = 't'; break;
+			case '\b': Text[Used++] = 'b'; break;
+			case '\f': Text[Used++] = 'f'; break;
+			default: // The other control characters
+				std::memcpy( Text + Used, "u00", 3 );
+				Text[Used + 3] = HEX[(unsigned char)c >> 4];
+				Text[Used + 4] = HEX[c & 0xF];
+				Used += 5;
+				break;
+		}
+	}
+	put( '"' );
+} // JsonLineWriter::putString
+
+void JsonLineWriter::put( const char *s, std::size_t len )
+{
+	if( Used + len > LINE_BUFFER_SIZE ) {
+		spill();
+		if( len > LINE_BUFFER_SIZE ) { // A long string goes to the stream directly
+			if( Stream.good() && Stream.rdbuf()->sputn( s, std::streamsize(len) ) != std::streamsize(len) )
+				Stream.setstate( std::ios_base::badbit );
+			return;
+		}
+	}
+	std::memcpy( Text + Used, s, len );
+	Used += len;
+} // JsonLineWriter::put
+
+void JsonLineWriter::spill()
+{
+	std::size_t len = Used;
+	Used = 0;
+	if( len > 0 && Stream.good() && Stream.rdbuf()->sputn( Text, std::streamsize(len) ) != std::streamsize(len) )
+		Stream.setstate( std::ios_base::badbit );
+} // JsonLineWriter::spill
@@ -0,0 +1,102 @@
+/*
+This is the header file for the writer of structured events as JSON lines to the FileViaSocket ostream class.
+Details are explained on GitHub: https://github.com/viktor-nikolov/lwIP-file-via-socket
+
+BSD 2-Clause License:
+
+Copyright (c) 2024 Viktor Nikolov
+
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+#ifndef JSONLINEWRITER_H
+#define JSONLINEWRITER_H
+
+#include <charconv>
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <string_view>
+#include <type_traits>
+
+/* JsonLineWriter writes events as JSON lines (one object per line) to a stream:
+ *
+ * JsonLineWriter json( f );
+ * json.begin().field( "t", timestamp ).field( "level", "warn" ).field( "msg", text ).end();
+ *
+ * writes {"t":1234,"level":"warn","msg":"..."} followed by '\n'. The line is composed in a small buffer
+ * and passed to the streambuf of the stream by one call (as a single write, so the record filter and the
+ * timestamps of FileViaSocket see the whole record). The ostream formatting isn't used at all: strings are
+ * escaped in bulk (16 bytes per step with SSE2 or NEON, see JsonLineWriter.cpp) and numbers are converted
+ * by std::to_chars. A line longer than the buffer is passed in parts.
+ *
+ * Strings are expected in UTF-8 and are copied as they are, except of '"', '\' and the control characters
+ * below 0x20, which are escaped. Non-finite floating point numbers are written as null (JSON has no NaN).
+ * Integer types (char included) are written as numbers. A socket error sets badbit on the stream. */
+class JsonLineWriter {
+public:
+	static const std::size_t LINE_BUFFER_SIZE = 512;
+
+	explicit JsonLineWriter( std::ostream &stream ) : Stream( stream ) {}
+
+	JsonLineWriter( const JsonLineWriter& ) = delete;
+	JsonLineWriter &operator=( const JsonLineWriter& ) = delete;
+
+	JsonLineWriter &begin();        // Starts an event
+	void end();                     // Ends the event and writes it to the stream (the stream isn't flushed)
+
+	JsonLineWriter &field( std::string_view key, std::string_view value );
+	JsonLineWriter &field( std::string_view key, const char *value ); // nullptr is written as null
+	JsonLineWriter &field( std::string_view key, bool value );
+	JsonLineWriter &field( std::string_view key, double value );
+	JsonLineWriter &field( std::string_view key, std::nullptr_t );
+	template<typename T, typename std::enable_if<std::is_integral<T>::value && !std::is_same<T, bool>::value, int>::type = 0>
+	JsonLineWriter &field( std::string_view key, T value ) {
+		putKey( key );
+		reserve( 24 ); // Enough for a 64-bit number with the sign
+		Used = std::size_t( std::to_chars( Text + Used, Text + LINE_BUFFER_SIZE, value ).ptr - Text );
+		return *this;
+	}
+	JsonLineWriter &field( std::string_view key, float value ) { return field( key, double( value ) ); }
+
+	/* The value is written as it is; it must be valid JSON (e.g., a nested object composed elsewhere). */
+	JsonLineWriter &rawField( std::string_view key, std::string_view json );
+
+private:
+	void putKey( std::string_view key );
+	void putString( std::string_view s );
+	void put( const char *s, std::size_t len );
+	void put( char c ) {
+		if( Used == LINE_BUFFER_SIZE )
+			spill();
+		Text[Used++] = c;
+	}
+	void reserve( std::size_t len ) { // Makes room for len bytes (len <= LINE_BUFFER_SIZE)
+		if( Used + len > LINE_BUFFER_SIZE )
+			spill();
+	}
+	void spill();                   // Passes the composed part of the line to the stream
+
+	std::ostream &Stream;
+	char Text[LINE_BUFFER_SIZE];
+	std::size_t Used{0};
+	bool FirstField{true};
+}; //class JsonLineWriter
+
+#endif //JSONLINEWRITER_H
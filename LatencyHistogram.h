@@ -0,0 +1,113 @@
+/*
+This is the header file of the latency histogram used by the SocketBuffer class.
+Details are explained on GitHub: https://github.com/viktor-nikolov/lwIP-file-via-socket
+
+BSD 2-Clause License:
+
+Copyright (c) 2024 Viktor Nikolov
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+#ifndef LATENCYHISTOGRAM_H
+#define LATENCYHISTOGRAM_H
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+
+/* LatencyHistogram collects latencies (in nanoseconds) into log-linear buckets: each power of two
+ * is split into 16 sub-buckets, so the reported percentiles have a relative error of max. 6.25 %.
+ * The histogram has a fixed size (about 2.4 KB), so recording a value never allocates memory. */
+class LatencyHistogram {
+public:
+	void record( std::uint64_t ns ) {
+		Buckets[ bucketIndex( ns ) ]++;
+		Count++;
+		if( ns > Max )
+			Max = ns;
+	}
+
+	void reset() {
+		for( auto &b : Buckets )
+			b = 0;
+		Count = 0;
+		Max = 0;
+	}
+
+	std::uint64_t count() const { return Count; }
+	std::uint64_t max() const { return Max; }
+
+	/* Returns the latency (in ns), which the given percentage of samples (e.g., 99.9) doesn't exceed. */
+	std::uint64_t percentile( double p ) const {
+		if( Count == 0 )
+			return 0;
+		std::uint64_t rank = std::uint64_t( p / 100.0 * double(Count) + 0.5 );
+		if( rank < 1 )
+			rank = 1;
+		std::uint64_t seen{0};
+		for( int i = 0; i < BUCKET_COUNT; i++ ) {
+			seen += Buckets[i];
+			if( seen >= rank ) {
+				std::uint64_t v = bucketValue( i );
+				return v < Max ? v : Max;
+			}
+		}
+		return Max;
+	}
+
+	/* Returns a one-line summary, e.g., "n=1000 p50=105.3us p99=230.0us p99.9=1010.0us max=2045.1us" */
+	std::string summary() const {
+		char s[160];
+		snprintf( s, sizeof(s), "n=%llu p50=%.1fus p99=%.1fus p99.9=%.1fus max=%.1fus",
+		          (unsigned long long)Count, percentile( 50 ) / 1000.0, percentile( 99 ) / 1000.0,
+		          percentile( 99.9 ) / 1000.0, Max / 1000.0 );
+		return s;
+	}
+
+private:
+	static const int SUB_BITS = 4;                                   // 16 sub-buckets per power of two
+	static const int MAX_EXPONENT = 40;                              // Values from 2^41 ns (36 min) up share the last bucket
+	static const int BUCKET_COUNT = (MAX_EXPONENT - SUB_BITS + 2) << SUB_BITS;
+
+	static int bucketIndex( std::uint64_t v ) {
+		if( v < (1u << SUB_BITS) ) // Small values have their own buckets
+			return int(v);
+		int exponent = 63 - __builtin_clzll( v );
+		if( exponent > MAX_EXPONENT )
+			return BUCKET_COUNT - 1;
+		int sub = int( (v >> (exponent - SUB_BITS)) & ((1u << SUB_BITS) - 1) );
+		return ((exponent - SUB_BITS + 1) << SUB_BITS) + sub;
+	}
+
+	// Middle of the range of values in the bucket
+	static std::uint64_t bucketValue( int index ) {
+		if( index < (1 << SUB_BITS) )
+			return std::uint64_t(index);
+		int exponent = (index >> SUB_BITS) + SUB_BITS - 1;
+		std::uint64_t sub = std::uint64_t( index & ((1 << SUB_BITS) - 1) );
+		std::uint64_t width = std::uint64_t(1) << (exponent - SUB_BITS);
+		return (((std::uint64_t(1) << SUB_BITS) + sub) << (exponent - SUB_BITS)) + width / 2;
+	}
+
+	std::uint32_t Buckets[BUCKET_COUNT] = {};
+	std::uint64_t Count{0};
+	std::uint64_t Max{0};
+}; //class LatencyHistogram
+
+#endif //LATENCYHISTOGRAM_H
@@ -0,0 +1,138 @@
+/*
+This is the implementation of the record filter used by the SocketBuffer class.
+Details are explained on GitHub: https://github.com/viktor-nikolov/lwIP-file-via-socket
+
+BSD 2-Clause License:
+
+Copyright (c) 2024 Viktor Nikolov
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+#include "RecordFilter.h"
+#include <cstring>
+
+void RecordFilter::setRepeatSuppression( bool enable, unsigned intervalMs )
+{
+	SuppressRepeats = enable;
+	IntervalNs = std::uint64_t(intervalMs ? intervalMs : 1) * 1000000ULL;
+	if( enable && Recent.empty() ) // The table is allocated only when it's needed
+		Recent.resize( RECENT_RECORDS );
+} // RecordFilter::setRepeatSuppression
+
+void RecordFilter::addSampling( const std::string &prefix, unsigned oneInN, unsigned maxPerSecond )
+{
+	Category c;
+	c.prefix = prefix;
+	c.oneInN = oneInN ? oneInN : 1;
+	c.maxPerSecond = maxPerSecond;
+	c.tokens = maxPerSecond;
+	Categories.push_back( c );
+} // RecordFilter::addSampling
+
+bool RecordFilter::accept( const char *record, std::size_t len, std::uint64_t nowNs, std::string &summaries )
+{
+	Statistics.records++;
+	if( nowNs >= nextSweepNs )
+		sweep( nowNs, summaries );
+
+	if( SuppressRepeats ) {
+		std::uint64_t h = 0xCBF29CE484222325ULL; // FNV-1a
+		for( std::size_t i = 0; i < len; i++ )
+			h = (h ^ (unsigned char)record[i]) * 0x100000001B3ULL;
+
+		// The records are remembered in sets of RECENT_WAYS entries selected by the hash
+		RecentRecord *set = &Recent[ ((h ^ (h >> 32)) % (RECENT_RECORDS / RECENT_WAYS)) * RECENT_WAYS ];
+		RecentRecord *victim = set;
+		for( unsigned w = 0; w < RECENT_WAYS; w++ ) {
+			RecentRecord &r = set[w];
+			if( r.hash == h && nowNs - r.windowStartNs < IntervalNs ) {
+				if( r.repeats++ == 0 ) { // We keep the text only for the records, which actually repeat
+					std::size_t textLen = len > 0 && record[len - 1] == '\n' ? len - 1 : len;
+					r.text.assign( record, textLen < MAX_SUMMARY_TEXT ? textLen : MAX_SUMMARY_TEXT );
+				}
+				Statistics.suppressed++;
+				return false;
+			}
+			// We replace the entry used longest ago, preferring the entries without repeats to summarize
+			if( (r.repeats == 0) != (victim->repeats == 0) ? r.repeats == 0 : r.windowStartNs < victim->windowStartNs )
+				victim = &r;
+		}
+		if( victim->repeats > 0 )
+			summarizeRepeats( *victim, summaries );
+		victim->hash = h;
+		victim->windowStartNs = nowNs;
+	}
+
+	if( ! Categories.empty() && ! sample( record, len, nowNs ) ) {
+		Statistics.sampledOut++;
+		return false;
+	}
+	return true;
+} // RecordFilter::accept
+
+bool RecordFilter::sample( const char *record, std::size_t len, std::uint64_t nowNs )
+{
+	for( Category &c : Categories ) {
+		if( len < c.prefix.size() || memcmp( record, c.prefix.data(), c.prefix.size() ) != 0 )
+			continue;
+
+		bool pass = c.seen++ % c.oneInN == 0;
+		if( pass && c.maxPerSecond > 0 ) {
+			c.tokens += double(nowNs - c.lastRefillNs) * c.maxPerSecond / 1e9;
+			if( c.tokens > c.maxPerSecond ) // The bucket holds at most one second worth of records
+				c.tokens = c.maxPerSecond;
+			c.lastRefillNs = nowNs;
+			if( c.tokens >= 1 )
+				c.tokens -= 1;
+			else
+				pass = false;
+		}
+		if( ! pass )
+			c.dropped++;
+		return pass;
+	}
+	return true; // The record doesn't belong to any sampled category
+} // RecordFilter::sample
+
+void RecordFilter::summarizeRepeats( RecentRecord &r, std::string &summaries )
+{
+	summaries += "[repeated " + std::to_string( r.repeats ) + " times] ";
+	summaries += r.text;
+	summaries += '\n';
+	r.repeats = 0;
+	Statistics.summaries++;
+} // RecordFilter::summarizeRepeats
+
+void RecordFilter::sweep( std::uint64_t nowNs, std::string &summaries, bool all )
+{
+	nextSweepNs = nowNs + IntervalNs;
+
+	for( RecentRecord &r : Recent )
+		if( r.repeats > 0 && (all || nowNs - r.windowStartNs >= IntervalNs) ) {
+			summarizeRepeats( r, summaries );
+			r.windowStartNs = nowNs; // Repeats in the next interval are suppressed again
+		}
+
+	for( Category &c : Categories )
+		if( c.dropped > 0 ) {
+			summaries += "[sampled out " + std::to_string( c.dropped ) + " records of category " + c.prefix + "]\n";
+			c.dropped = 0;
+			Statistics.summaries++;
+		}
+} // RecordFilter::sweep
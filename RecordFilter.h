@@ -0,0 +1,108 @@
+/*
+This is the header file for the record filter used by the SocketBuffer class (repeated-line suppression and sampling).
+Details are explained on GitHub: https://github.com/viktor-nikolov/lwIP-file-via-socket
+
+BSD 2-Clause License:
+
+Copyright (c) 2024 Viktor Nikolov
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+#ifndef RECORDFILTER_H
+#define RECORDFILTER_H
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <vector>
+
+/* RecordFilter decides which records (lines) are sent. It's used by SocketBuffer when filtering is enabled.
+ *
+ * Repeated-record suppression: we remember hashes of recent records. A record, which was already sent
+ * in the current interval, is suppressed and counted. When the interval elapses, a summary
+ * "[repeated N times] <record>" is sent instead of the suppressed records. So a record emitted thousands
+ * of times per second costs one line and one summary per interval.
+ *
+ * Sampling: records starting with a given prefix (a category, e.g., "DEBUG" or "[net]") are sampled:
+ * only each N-th record is sent, and/or at most a given number of records per second. The number of records
+ * dropped by sampling is reported in a summary "[sampled out N records of category <prefix>]" once per interval. */
+class RecordFilter {
+public:
+	struct Stats {
+		std::uint64_t records{0};    // Records seen by the filter
+		std::uint64_t suppressed{0}; // Records suppressed as repeated
+		std::uint64_t sampledOut{0}; // Records dropped by sampling
+		std::uint64_t summaries{0};  // Summaries produced
+	};
+
+	static const std::size_t MAX_SUMMARY_TEXT = 120; // Length of the record quoted in a summary
+
+	/* Enables suppression of repeated records; intervalMs is the interval of the summaries. */
+	void setRepeatSuppression( bool enable, unsigned intervalMs = 1000 );
+
+	/* Samples the records starting with prefix: only each oneInN-th record is sent (1 = all), and at most
+	 * maxPerSecond records per second (0 = no limit). The first matching category applies to a record. */
+	void addSampling( const std::string &prefix, unsigned oneInN, unsigned maxPerSecond = 0 );
+	void clearSampling() { Categories.clear(); }
+
+	/* The filter does anything (otherwise SocketBuffer bypasses it). */
+	bool active() const { return SuppressRepeats || ! Categories.empty(); }
+
+	/* Decides whether the record (including its terminating '\n') is sent. Summaries, which are due,
+	 * are appended to summaries (they should be sent before the record). nowNs is a monotonic time. */
+	bool accept( const char *record, std::size_t len, std::uint64_t nowNs, std::string &summaries );
+
+	/* Appends the summaries, which are due (or all pending summaries when all is true). */
+	void sweep( std::uint64_t nowNs, std::string &summaries, bool all = false );
+
+	const Stats &stats() const { return Statistics; }
+	void resetStats() { Statistics = Stats(); }
+
+private:
+	struct RecentRecord {
+		std::uint64_t hash{0};
+		std::uint64_t windowStartNs{0}; // Start of the interval, in which the record was sent
+		std::uint32_t repeats{0};       // Number of times the record was suppressed in the interval
+		std::string text;               // Start of the record (for the summary; stored on the first repeat)
+	};
+	struct Category {
+		std::string prefix;
+		unsigned oneInN;
+		unsigned maxPerSecond;
+		std::uint64_t seen{0};
+		double tokens{0};               // Token bucket of the rate cap
+		std::uint64_t lastRefillNs{0};
+		std::uint64_t dropped{0};       // Dropped since the last summary
+	};
+
+	void summarizeRepeats( RecentRecord &r, std::string &summaries );
+	bool sample( const char *record, std::size_t len, std::uint64_t nowNs );
+
+	static const unsigned RECENT_RECORDS = 256; // Number of recent records remembered
+	static const unsigned RECENT_WAYS = 4;      // Number of entries a record can be stored in
+
+	bool SuppressRepeats{false};
+	std::uint64_t IntervalNs{1000000000ULL};
+	std::vector<RecentRecord> Recent;
+	std::vector<Category> Categories;
+	std::uint64_t nextSweepNs{0};
+	Stats Statistics;
+}; //class RecordFilter
+
+#endif //RECORDFILTER_H
@@ -0,0 +1,117 @@
+/*
+This is the source file for the class streaming snapshots of a memory region via the FileViaSocket ostream class.
+Details are explained on GitHub: https://github.com/viktor-nikolov/lwIP-file-via-socket
+
+BSD 2-Clause License:
+
+Copyright (c) 2024 Viktor Nikolov
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+#include "SnapshotViaSocket.h"
+#include <cstring>
+
+namespace {
+// Helpers for writing numbers to the stream in little-endian byte order
+void putU16( std::ostream &s, std::uint16_t v ) {
+	char b[2] = { char(v), char(v >> 8) };
+	s.write( b, sizeof(b) );
+}
+void putU32( std::ostream &s, std::uint32_t v ) {
+	char b[4] = { char(v), char(v >> 8), char(v >> 16), char(v >> 24) };
+	s.write( b, sizeof(b) );
+}
+void putU64( std::ostream &s, std::uint64_t v ) {
+	putU32( s, std::uint32_t(v) );
+	putU32( s, std::uint32_t(v >> 32) );
+}
+} // namespace
+
+SnapshotViaSocket::SnapshotViaSocket( FileViaSocketBase &stream, const void *region, std::size_t regionSize,
+                                      std::size_t blockSize )
+	: Stream( stream ), Region( static_cast<const unsigned char*>(region) ), RegionSize( regionSize ),
+	  BlockSize( blockSize > 0 ? blockSize : DEFAULT_BLOCK_SIZE )
+{
+	BlockHashes.resize( (RegionSize + BlockSize - 1) / BlockSize );
+	NewHashes.resize( BlockHashes.size() );
+} // SnapshotViaSocket::SnapshotViaSocket
+
+/* 64-bit hash of a block. We process four independent 64-bit lanes per iteration, so the loop
+ * has no dependency between the lanes and the CPU (or the compiler's vectorizer) can overlap them.
+ * The hash is used only for change detection, it's not a cryptographic hash. */
+std::uint64_t SnapshotViaSocket::blockHash( const unsigned char *data, std::size_t len )
+{
+	const std::uint64_t PRIME = 0x9E3779B97F4A7C15ULL;
+	std::uint64_t h[4] = { 0x243F6A8885A308D3ULL, 0x13198A2E03707344ULL,
+	                       0xA4093822299F31D0ULL, 0x082EFA98EC4E6C89ULL };
+	std::size_t i = 0;
+	for( ; i + 32 <= len; i += 32 ) {
+		for( int lane = 0; lane < 4; lane++ ) {
+			std::uint64_t w;
+			memcpy( &w, data + i + 8*lane, sizeof(w) ); // memcpy avoids unaligned access issues
+			h[lane] = (h[lane] ^ w) * PRIME;
+			h[lane] ^= h[lane] >> 29;
+		}
+	}
+	std::uint64_t result = h[0] ^ (h[1] << 1) ^ (h[2] << 2) ^ (h[3] << 3) ^ len;
+	for( ; i < len; i++ ) // Remaining bytes of the block
+		result = (result ^ data[i]) * PRIME;
+	result ^= result >> 32;
+	return result;
+} // SnapshotViaSocket::blockHash
+
+std::size_t SnapshotViaSocket::sendSnapshot()
+{
+	const bool full = SendAll;
+
+	Stream.write( "FVSN", 4 );
+	char versionAndFlags[2] = { char(FORMAT_VERSION), char(full ? 1 : 0) };
+	Stream.write( versionAndFlags, sizeof(versionAndFlags) );
+	putU16( Stream, 0 );
+	putU32( Stream, SnapshotSeq );
+	putU64( Stream, RegionSize );
+	putU32( Stream, std::uint32_t(BlockSize) );
+
+	std::uint32_t blocksSent{0};
+	for( std::size_t i = 0; i < BlockHashes.size(); i++ ) {
+		std::size_t offset = i * BlockSize;
+		std::size_t len = RegionSize - offset < BlockSize ? RegionSize - offset : BlockSize;
+		std::uint64_t h = blockHash( Region + offset, len );
+
+		NewHashes[i] = h;
+		if( full || h != BlockHashes[i] ) {
+			putU64( Stream, offset );
+			putU32( Stream, std::uint32_t(len) );
+			Stream.write( reinterpret_cast<const char*>(Region + offset), std::streamsize(len) );
+			blocksSent++;
+		}
+	}
+
+	putU64( Stream, ~std::uint64_t(0) ); // End record
+	putU32( Stream, blocksSent );
+	Stream.flush(); // The receiver gets the complete snapshot now
+
+	SnapshotSeq++;
+	if( Stream ) { // The hashes describe what the receiver has only when the snapshot got through
+		BlockHashes.swap( NewHashes );
+		SendAll = false;
+	} else
+		SendAll = true; // The stream will be reopened; the receiver needs the whole region then
+	return blocksSent;
+} // SnapshotViaSocket::sendSnapshot
@@ -0,0 +1,81 @@
+/*
+This is the header file for the class streaming snapshots of a memory region via the FileViaSocket ostream class.
+Only blocks of the region, which changed since the previous snapshot, are sent.
+Details are explained on GitHub: https://github.com/viktor-nikolov/lwIP-file-via-socket
+
+BSD 2-Clause License:
+
+Copyright (c) 2024 Viktor Nikolov
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+#ifndef SNAPSHOTVIASOCKET_H
+#define SNAPSHOTVIASOCKET_H
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+#include "FileViaSocket.h"
+
+/* SnapshotViaSocket periodically sends a snapshot of a memory region (e.g., a register map
+ * or a histogram) to the FileViaSocket stream. The region is split into blocks. We keep a hash
+ * of each block and send only the blocks, which changed since the previous snapshot, together
+ * with their offsets. The first snapshot (and a snapshot after forceFull()) contains all blocks.
+ *
+ * The script snapshot_via_socket.py rebuilds the full snapshots from the received file.
+ *
+ * Format of a snapshot in the stream (all numbers are little-endian):
+ *   header:       "FVSN", u8 version, u8 flags (bit 0: full snapshot), u16 reserved,
+ *                 u32 snapshot sequence number, u64 region size, u32 block size
+ *   block record: u64 offset, u32 length, <length> bytes of data
+ *   end record:   u64 0xFFFFFFFFFFFFFFFF, u32 number of block records in the snapshot */
+class SnapshotViaSocket {
+public:
+	static const std::uint8_t FORMAT_VERSION = 1;
+	static const std::size_t DEFAULT_BLOCK_SIZE = 4096;
+
+	/* The region must stay valid for the whole life of the object.
+	 * The stream must be open when sendSnapshot() is called. */
+	SnapshotViaSocket( FileViaSocketBase &stream, const void *region, std::size_t regionSize,
+	                   std::size_t blockSize = DEFAULT_BLOCK_SIZE );
+
+	/* Sends the blocks changed since the previous snapshot and flushes the stream.
+	 * Returns the number of blocks sent. Sets badbit on the stream in case of a socket error;
+	 * the next snapshot is full then (the receiver may have missed any of the blocks). */
+	std::size_t sendSnapshot();
+
+	/* The next snapshot will contain all blocks (e.g., after the stream was reopened). */
+	void forceFull() { SendAll = true; }
+
+	std::uint32_t snapshotCount() const { return SnapshotSeq; }
+
+private:
+	static std::uint64_t blockHash( const unsigned char *data, std::size_t len );
+
+	FileViaSocketBase &Stream;
+	const unsigned char *Region;
+	std::size_t RegionSize;
+	std::size_t BlockSize;
+	std::vector<std::uint64_t> BlockHashes; // Hash of each block as sent in the previous snapshot
+	std::vector<std::uint64_t> NewHashes;   // Hashes of the snapshot being sent (kept only if it gets through)
+	std::uint32_t SnapshotSeq{0};           // Sequence number of the next snapshot
+	bool SendAll{true};                     // Send all blocks in the next snapshot
+}; //class SnapshotViaSocket
+
+#endif //SNAPSHOTVIASOCKET_H
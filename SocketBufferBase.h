@@ -0,0 +1,509 @@
+/*
+This is the header file of the core of FileViaSocket: the buffering and the sending of the data via an IP socket,
+without the C++ iostreams. It's included by FileViaSocket.h (the ostream) and by the C API (FileViaSocketC.cpp).
+Details are explained on GitHub: https://github.com/viktor-nikolov/lwIP-file-via-socket
+
+BSD 2-Clause License:
+
+Copyright (c) 2024 Viktor Nikolov
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+#ifndef SOCKETBUFFERBASE_H
+#define SOCKETBUFFERBASE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <exception>
+#include <functional>
+#include <iosfwd> // Only std::streamsize; no iostreams code is used
+#include <memory>
+#include <string>
+#include <vector>
+#include "BlockCompressor.h"
+#include "LatencyHistogram.h"
+#include "RecordFilter.h"
+
+/* FVS_LWIP selects the lwIP socket API. It's defined automatically if not Windows nor Linux (i.e., on FreeRTOS).
+ * The Linux build of the FreeRTOS demo (FreeRTOS POSIX port with lwIP) defines it on the command line. */
+#if !defined(__WIN32__) && !defined(__linux__) && !defined(FVS_LWIP)
+#   define FVS_LWIP
+#endif
+
+/* Exceptions raised by SocketBufferBase::open(). FileViaSocketBase inherits them, so the application catches,
+ * e.g., FileViaSocket::SocketConnectionErrorExc. */
+struct FileViaSocketErrors {
+	class WrongServerIPFormatExc : public std::exception {
+	public:
+		WrongServerIPFormatExc() : message("Server IP was provided in a wrong format!") {}
+		explicit WrongServerIPFormatExc( std::string &m ) : message(m) {}
+
+		// Override the what() method to return a custom error message
+		[[nodiscard]] const char* what() const noexcept override {
+			return message.c_str();
+		}
+	private:
+		std::string message;
+	};
+	class SocketCreationErrorExc : public std::exception {
+	public:
+		explicit SocketCreationErrorExc( int errCode );
+		[[nodiscard]] const char* what() const noexcept override {
+			return message.c_str();
+		}
+	private:
+		std::string message;
+	};
+	class SocketConnectionErrorExc : public std::exception {
+	public:
+		explicit SocketConnectionErrorExc( int errCode );
+		[[nodiscard]] const char* what() const noexcept override {
+			return message.c_str();
+		}
+	private:
+		std::string message;
+	};
+}; //struct FileViaSocketErrors
+
+/* SocketBufferBase is the core of the streambuf class which is used by the FileViaSocket ostream class.
+ * All logic of sending data over an IP socket is implemented in this class. The buffer itself, the transport
+ * and the flush policy are supplied by the template BasicSocketBuffer (FileViaSocket.h); SocketBuffer is its default
+ * configuration. The core doesn't depend on iostreams (it isn't a std::streambuf), so it's used also by the C API
+ * (FileViaSocketC.h), which includes only this header. */
+class SocketBufferBase {
+public:
+	/* DEFAULT_BUFF_SIZE is length of the array we use as buffer before sending the data via the socket.
+	 * Ideally it should be equal to the max. number of bytes sent in a TCP packet.
+	 * I tested using Wireshark that on FreeRTOS on Xilinx Zynq (using lwIP 2.1.3) 1446 bytes of data are sent
+	 * in one TCP packet. On Ubuntu 22.04 it's 1448 bytes and on Windows 11 it's 1460 bytes of data. */
+#ifdef __WIN32__
+	static int const DEFAULT_BUFF_SIZE = 1460;
+#elif defined(FVS_LWIP)
+	static int const DEFAULT_BUFF_SIZE = 1446;
+#else // Linux
+	static int const DEFAULT_BUFF_SIZE = 1448;
+#endif
+
+	SocketBufferBase( const SocketBufferBase& ) = delete;
+	SocketBufferBase &operator=( const SocketBufferBase& ) = delete;
+	virtual ~SocketBufferBase() { close(); }
+
+	void open( const std::string &ip, unsigned short port );
+	/* Sends the remaining data and closes the connection; returns 0, or -1 when the remaining data weren't sent. */
+	int close();
+
+	/* Writes one character (eof only flushes the data, as std::streambuf::overflow());
+	 * returns std::char_traits<char>::eof() on an error. */
+	int putChar( int c );
+	/* Writes n characters; returns the number of characters written (as std::streambuf::sputn()). */
+	std::streamsize putChars( const char *s, std::streamsize n );
+	/* Sends the data from the buffer; returns 0, or -1 on an error (as std::streambuf::pubsync()). */
+	int flush();
+
+	/* Receiver (server) in a pool of receivers */
+	struct Receiver {
+		std::string ip;
+		unsigned short port;
+	};
+
+	/* Opens the connection to one receiver of the pool. The receiver is chosen by consistent hashing
+	 * (rendezvous hashing) of the key, so a stream with the same key always goes to the same receiver,
+	 * and adding a receiver to the pool moves only the streams, which the new receiver takes over.
+	 * When the connection fails (or the receiver's address is wrong), the next receiver in the order given
+	 * by the hash is tried. The exception of the last receiver is raised when no receiver is reachable. */
+	void open( const std::vector<Receiver> &pool, const std::string &key );
+
+	// Address of the receiver, which we are (or were last) connected to
+	const std::string &serverIP() const { return ServerIP; }
+	unsigned short serverPort() const { return ServerPort; }
+
+	/* Generator is called by writeFrom() to produce data directly into our buffer.
+	 * It must write at most maxLen bytes to dest and return the number of bytes it wrote.
+	 * Returning 0 ends the transfer before totalBytes were produced. */
+	using Generator = std::function<std::size_t( char *dest, std::size_t maxLen )>;
+
+	/* Calls the generator repeatedly to fill the buffer, sending each full buffer to the socket,
+	 * until totalBytes were produced. No staging buffer is needed on the caller's side.
+	 * Returns the number of bytes produced, or -1 on a socket error.
+	 * When the server paused bulk transfers (see bulkPaused()), nothing is produced and 0 is returned;
+	 * the application calls writeFrom() again later (each call checks whether the server resumed the transfers). */
+	std::streamsize writeFrom( const Generator &generator, std::streamsize totalBytes );
+
+	/* Compression of the data sent via the socket. It applies to the sessions opened after the call.
+	 *   None     - data are sent verbatim (default; compatible with any server)
+	 *   Fast     - fast compression, for links slightly slower than the CPU
+	 *   Strong   - better compression ratio, for slow links
+	 *   Adaptive - the level is chosen per block by comparing the time blocked in send()
+	 *              with the time spent compressing (see BlockCompressor)
+	 *   Dictionary - fast compression against the static dictionary (see setDictionary()); for small
+	 *              flushed records, which the other levels can't compress (without a dictionary it's Fast)
+	 * Compressed sessions are sent in frames, which file_via_socket.py decodes automatically. */
+	enum class Compression { None, Fast, Strong, Adaptive, Dictionary };
+	void setCompression( Compression mode ) { CompressionMode = mode; }
+	Compression compression() const { return CompressionMode; }
+
+	/* The static dictionary of Compression::Dictionary, trained by train_dictionary.py on a sample of the records.
+	 * The data aren't copied: pass the array from the header generated by the script (FVS_DICTIONARY).
+	 * The server needs the same dictionary (file_via_socket.py --dict); the session tells it the dictionary's ID.
+	 * It applies to the sessions opened after the call. */
+	void setDictionary( const void *dictionary, std::size_t size ) {
+		DictionaryData = dictionary;
+		DictionarySize = size;
+	}
+
+	/* Measurement of the end-to-end latency, i.e., the time from writing data to the stream till the data
+	 * are written to the file by the server. It applies to the sessions opened after the call.
+	 * The session is sent in frames (as a compressed session is). A timestamp frame precedes each data frame;
+	 * the server echoes the timestamps back after writing the data to the file. The clock offset between
+	 * the client and the server is estimated from the round trips of the echoes. close() reads the remaining
+	 * echoes, waiting for the server to close the connection at most 2 seconds. */
+	void setLatencyMeasurement( bool enable );
+
+	/* Histogram of the end-to-end latencies of the current (or the last closed) session. */
+	const LatencyHistogram &latency() const {
+		static const LatencyHistogram empty;
+		return Latency ? *Latency : empty;
+	}
+
+	/* Statistics of the current (or the last closed) session. The TCP state is sampled from TCP_INFO
+	 * every TCP_INFO_INTERVAL_MS while sending; it's available only on Linux (zero elsewhere). */
+	struct Stats {
+		std::uint64_t dataBytes{0};       // Bytes of data, which left our buffer
+		std::uint64_t wireBytes{0};       // Bytes sent to the socket (after framing and compression)
+		std::uint64_t sendCalls{0};       // Number of calls of send()
+		std::uint64_t flushes{0};         // Number of flushes, which sent data
+
+		std::uint32_t tcpInfoSamples{0};  // Number of TCP_INFO samples taken
+		std::uint32_t rttUs{0};           // Smoothed round trip time
+		std::uint32_t rttVarUs{0};        // Round trip time variation
+		std::uint32_t cwnd{0};            // Congestion window (segments)
+		std::uint32_t mss{0};             // Sender's maximum segment size
+		std::uint32_t retransmits{0};     // Total number of retransmitted segments
+		std::uint64_t deliveryRate{0};    // Recent delivery rate (bytes per second)
+		std::uint32_t notSentBytes{0};    // Bytes in the send queue not sent yet
+		std::uint32_t unackedSegments{0}; // Segments sent and not acknowledged yet
+		std::uint32_t sendBufferBytes{0}; // Current SO_SNDBUF
+		std::uint32_t autotuneChanges{0}; // Number of times the autotuner enlarged SO_SNDBUF
+
+		// Time accounting (see setTimeAccounting()), in ticks of rawTimestamp()
+		std::uint64_t sessionTicks{0};    // Duration of the session (updated by each call of the stream)
+		std::uint64_t streamTicks{0};     // Time spent in the calls of the stream (writes, flushes), send() included
+		std::uint64_t sendTicks{0};       // Time spent in send()
+	};
+	static const unsigned TCP_INFO_INTERVAL_MS = 100;
+
+	const Stats &stats() const { return Statistics; }
+
+	/* Opt-in autotuning of the socket's send buffer (Linux only). On each TCP_INFO sample we estimate
+	 * the bandwidth-delay product (BDP) of the connection and enlarge SO_SNDBUF to twice the BDP,
+	 * up to maxBytes. (The kernel caps SO_SNDBUF at net.core.wmem_max, which may need to be raised.)
+	 * It applies to the sessions opened after the call. */
+	void setSendBufferAutotune( bool enable, std::uint32_t maxBytes = 16*1024*1024 ) {
+		AutotuneSendBuffer = enable;
+		AutotuneMaxBytes = maxBytes;
+	}
+
+	/* Disables Nagle's algorithm (TCP_NODELAY), so each flush is sent at once, even when the previous segment
+	 * wasn't acknowledged yet. It lowers the latency of small flushed records (otherwise a record may wait
+	 * for the delayed ACK of the server, i.e., up to tens of ms); it adds packets with little data.
+	 * It applies to the sessions opened after the call. */
+	void setNoDelay( bool enable ) { NoDelay = enable; }
+	bool noDelay() const { return NoDelay; }
+
+	/* Per-stream time accounting: the time spent in the calls of the stream (write(), operator<<, flush(), writeFrom())
+	 * and the part of it spent in send() are summed to stats().streamTicks and stats().sendTicks.
+	 * The difference is the CPU time the stream itself takes (copying, record filter, framing, compression).
+	 * With lwIP, the time in send() includes the processing by the tcpip thread and the waiting for free space
+	 * in the send buffer. The ticks are of rawTimestamp() (on Zynq, the global timer, as the FreeRTOS run-time stats).
+	 * It costs two reads of the counter per call, i.e., per character of a number formatted by operator<<,
+	 * so it's off by default. It applies to the sessions opened after the call. */
+	void setTimeAccounting( bool enable ) { TimeAccounting = enable; }
+
+	/* Usage of the resources of lwIP (LWIP_STATS), shared by all streams: the current use and the high-water mark.
+	 * It tells how close the application came to running out of the memory pools configured in lwipopts.h.
+	 * available is false when not using lwIP, or when lwIP is built without the statistics. */
+	struct NetworkUsage {
+		struct Resource {
+			std::uint32_t used{0};  // Currently used
+			std::uint32_t max{0};   // High-water mark
+			std::uint32_t avail{0}; // Size of the pool (0 when not known)
+			std::uint32_t err{0};   // Number of failed allocations
+		};
+		bool available{false};
+		Resource heap;        // lwIP heap, in bytes (MEM_SIZE)
+		Resource pbufPool;    // Pbufs with data for received packets (PBUF_POOL_SIZE)
+		Resource pbufRef;     // Pbufs referring to data (MEMP_NUM_PBUF)
+		Resource tcpSegments; // Queued TCP segments (MEMP_NUM_TCP_SEG)
+		Resource mailboxes;   // Mailboxes of the sockets and of the tcpip thread (the size isn't known)
+	};
+	static NetworkUsage networkUsage();
+
+	/* Returns a one-line summary of stats() and networkUsage(), e.g.,
+	 * "data=26000000 wire=26000000 sends=17982 flushes=1 stream=612.4ms send=575.1ms cpu=4.9% session=758.3ms
+	 *  heap=0/1460/131072/0 pbuf_pool=0/12/256/0 pbuf=0/0/16/0 tcp_seg=0/123/256/0 mbox=6/8/0/0"
+	 * (a resource is used/max/avail/err). The times are present only with the time accounting;
+	 * cpu is the share of the session spent in the stream outside send(). */
+	std::string statsSummary() const;
+
+	/* Control channel: the server can ask us to cut the volume of data at the source when it's overloaded
+	 * (see file_via_socket.py --overload_control), instead of the data being throttled by TCP flow control.
+	 * It applies to the sessions opened after the call; the session is sent in frames (as a compressed session is).
+	 * The requests of the server are read by a non-blocking recv() when we send data, i.e., they take effect
+	 * with a delay. They are reset to the defaults when a session is opened.
+	 *   verbosity()       - the highest log level the server wants to receive (VERBOSITY_ALL when not limited);
+	 *                       the application checks verbosityAllows() before writing a record of the given level
+	 *   bulkPaused()      - the server asks us to pause bulk transfers; writeFrom() sends nothing while paused
+	 *   flushIntervalMs() - explicit flushes are coalesced, so the data are sent at most once per the interval
+	 *                       (0 = each flush sends the data); the deferred data are sent by the next write, flush
+	 *                       or close() after the interval elapses, or by flushIfDue()
+	 * With the control channel, close() waits for the server to close the connection, at most 2 seconds. */
+	void setControlChannel( bool enable ) { ControlChannel = enable; }
+
+	/* Filter of the records (see RecordFilter): suppression of repeated records and sampling of categories.
+	 * A record is a line of text. When the filter is configured, the written data are collected till '\n',
+	 * and each complete record is passed to the filter. A record longer than MAX_RECORD_SIZE is sent unfiltered,
+	 * and so is an incomplete record when the application flushes the stream (unless the flush is deferred
+	 * by the flush interval) or closes it. The other flushes (of the flush interval, flushIfDue(), FlushEachLine)
+	 * leave it collected, so a record written in pieces is filtered as a whole. writeFrom() bypasses the filter.
+	 * Example: f.recordFilter().setRepeatSuppression( true, 1000 ); */
+	static const std::size_t MAX_RECORD_SIZE = 1024;
+	RecordFilter &recordFilter();
+
+	/* Cheap timestamps of the records: a raw value of a hardware counter (TSC on x86, CNTVCT on ARMv8,
+	 * the global timer on Zynq; the monotonic clock elsewhere) written as fixed-width text (16 hex digits
+	 * and a space) or binary (byte 0x1E followed by 8 bytes little-endian). It's much cheaper than formatting
+	 * the wall-clock time. Each session starts and ends with a calibration record
+	 * "#FVS-CAL <format> ticks=<hex> hz=<counter frequency> wall_ns=<Unix time in ns, 0 if unknown>",
+	 * which timestamp_via_socket.py uses to convert the values to the wall-clock time.
+	 * With prefixEachRecord, each record (line) gets the timestamp automatically; otherwise use the manipulator
+	 * hwTimestamp: f << hwTimestamp << "Temperature: " << t << '\n';
+	 * The binary format is for tools reading the records (a 0x0A byte may appear in the value).
+	 * It applies to the sessions opened after the call (open() latches it, so a session doesn't mix the formats). */
+	enum class TimestampFormat { None, Hex, Binary };
+	void setTimestamps( TimestampFormat format, bool prefixEachRecord = false ) {
+		TimestampsRequested = format;
+		PrefixRequested = prefixEachRecord && format != TimestampFormat::None;
+	}
+	// Format of the timestamps in the current (or the last closed) session
+	TimestampFormat timestampFormat() const { return Timestamps; }
+
+	static const std::size_t MAX_TIMESTAMP_SIZE = 17;
+	// Reads the hardware counter
+	static std::uint64_t rawTimestamp();
+	// Frequency of the hardware counter (on x86 measured over the time since the program started)
+	static std::uint64_t rawTimestampHz();
+	// Writes the current timestamp to dest (at least MAX_TIMESTAMP_SIZE bytes); returns its length
+	static std::size_t formatTimestamp( char *dest, TimestampFormat format );
+
+	// Sends the data by send() of the platform's socket API (see SocketTransport); returns the bytes sent or -1
+	static long socketSend( int socket, const char *data, std::size_t len );
+	static const unsigned VERBOSITY_ALL = 255;
+	unsigned verbosity() const { return Verbosity; }
+	bool verbosityAllows( unsigned level ) const { return level <= Verbosity; }
+	bool bulkPaused() const { return BulkPaused; }
+	unsigned flushIntervalMs() const { return FlushIntervalMs; }
+
+	/* Sends the data, which flush() deferred because of the flush interval, when the interval elapsed.
+	 * An application, which may stop writing for a long time, calls it periodically (e.g., from its idle loop),
+	 * so the data flushed last don't wait for the next write. Returns 0 on success, -1 on failure. */
+	int flushIfDue() { return FlushDeferred ? flushData( false ) : 0; }
+
+protected:
+	/* The buffer (bufferSize bytes) is owned by the derived class. */
+	SocketBufferBase( char *buffer, int bufferSize ) : buffer( buffer ), bufferSize( bufferSize ) {}
+
+	/* Sends the data to the connected socket; returns the number of bytes sent, or -1 on an error.
+	 * BasicSocketBuffer overrides it by its Transport. */
+	virtual long transportSend( int socket, const char *data, std::size_t len ) {
+		return socketSend( socket, data, len );
+	}
+
+	/* A derived class may store the characters to the free part of the buffer by its own inline code
+	 * (BasicSocketBuffer uses it as the put area of the streambuf). releasePutArea() takes such characters
+	 * over to bytesInBuffer; it's called on entry to each of our methods. armPutArea() is called on their exit. */
+	virtual void releasePutArea() {}
+	virtual void armPutArea() {}
+
+	/* Returns true when the session needs no per-byte processing (no record filter, timestamps, latency measurement,
+	 * control channel nor time accounting), so the characters may be stored without calling our methods. */
+	bool inlineWritesAllowed() const;
+
+	/* Flush by the FlushPolicy of BasicSocketBuffer (as flush(), but the incomplete record isn't sent). */
+	int flushImplicit() { return flushData( false ); }
+
+	char *const buffer;                 // Buffer for writes to the socket (owned by the derived class)
+	const int bufferSize;
+	int bytesInBuffer{0};               // Number of bytes stored in the buffer (except those in the put area)
+
+private:
+	/* Stores the data to the buffer, sending it to the socket when it's full. */
+	std::streamsize putData( const char *s, std::streamsize n );
+
+	/* Stores the records to the buffer (by putData()), prefixing each with a timestamp when it's configured. */
+	std::streamsize putRecords( const char *s, std::streamsize n );
+
+	/* Sends the calibration record of the timestamps (see setTimestamps()). */
+	bool putCalibration();
+
+	/* Passes the data to the record filter, and the records, which pass, to putRecords(). */
+	std::streamsize filterRecords( const char *s, std::streamsize n );
+
+	/* Sends the summaries of the filter, which are due (or all of them), and optionally the incomplete record. */
+	bool flushRecords( bool all, bool incomplete );
+
+	/* Implements flush(); a flush, which the application didn't ask for (explicit false), leaves the incomplete
+	 * record in the filter's collection (see recordFilter()). */
+	int flushData( bool explicitFlush );
+
+	/* Sends all data from the buffer and the block being framed (flush() may defer that, see flushIntervalMs()).
+	 * The cause (FvsFlushCause) is reported to the tracepoints (see SocketBufferTrace.h). */
+	int flushAll( int cause );
+
+	/* Flushes the data, which flush() deferred, when the flush interval elapsed. */
+	void flushDeferred() {
+		if( FlushDeferred )
+			flushData( false );
+	}
+
+	/* Sends the data to the socket, or to the block being framed when the session is compressed.
+	 * All data leaving our buffer go through this method. */
+	bool sendData( const char *data, std::streamsize len );
+
+	/* Compresses the block and sends it in a frame. */
+	bool sendBlock();
+
+	/* Calls send() and updates the statistics. All data are sent to the socket by this method. */
+	bool sendToSocket( const char *data, std::size_t len );
+
+	/* Closes the socket without sending anything (open() calls it when connecting failed). */
+	void closeSocket();
+
+	/* Samples TCP_INFO to the statistics and runs the send buffer autotuner. */
+	void sampleTcpInfo();
+
+	/* Remembers the time when the first byte is stored to the empty buffer (for the latency measurement). */
+	void noteFirstByte();
+
+	/* Reads messages the server sent to us (timestamp echoes, control requests). When wait is false, only data, which were
+	 * already received, are read. When wait is true, we read till the server closes the connection, or till deadlineNs
+	 * (monotonic clock) when it's not 0. */
+	void readServerMessages( bool wait, std::uint64_t deadlineNs = 0 );
+
+	/* Reads control requests of the server, at most once per CONTROL_POLL_INTERVAL_NS. */
+	void pollControl();
+
+	/* Computes the latency from a timestamp echo (all times in ns; the client's and the server's clock). */
+	void processEcho( std::uint64_t firstByteNs, std::uint64_t sendNs, std::uint64_t serverRecvNs,
+	                  std::uint64_t serverWrittenNs );
+
+	/* The put area (see releasePutArea()) is handed over to our code on entry to each of our methods,
+	 * and set up again on their exit. */
+	class PutAreaGuard {
+	public:
+		explicit PutAreaGuard( SocketBufferBase &b ) : Buff( b ) {
+			if( Buff.putAreaDepth++ == 0 )
+				Buff.releasePutArea();
+		}
+		~PutAreaGuard() {
+			if( --Buff.putAreaDepth == 0 )
+				Buff.armPutArea();
+		}
+	private:
+		SocketBufferBase &Buff;
+	};
+
+	int Socket = -1;  // The IP socket file descriptor; value <0 means that the socket is closed
+	std::string ServerIP;
+	unsigned short ServerPort{0};
+	int putAreaDepth{0};                // Nesting of our methods (e.g., putChar() calls flush())
+
+	Compression CompressionMode{ Compression::None };
+	bool Framed{false};                        // The current session is sent in frames
+	std::unique_ptr<BlockCompressor> Compressor;
+	std::vector<char> Block;                   // Data to be compressed, preceded by space for a frame header
+	std::size_t bytesInBlock{0};               // Number of bytes of data in the Block
+	std::vector<char> CompressedBlock;         // Frame with the compressed Block
+	const void *DictionaryData{nullptr};       // The static dictionary (see setDictionary())
+	std::size_t DictionarySize{0};
+	bool UseDictionary{false};                 // The current session is compressed against the dictionary
+
+	bool MeasureLatency{false};                // Latency measurement is requested for the next sessions
+	bool TrackLatency{false};                  // Latency is measured in the current session
+	std::unique_ptr<LatencyHistogram> Latency;
+	std::uint64_t bufferFirstByteNs{0};        // Time when the oldest byte in the buffer was written
+	std::uint64_t blockFirstByteNs{0};         // Time when the oldest byte in the Block was written
+	std::uint32_t timestampSeq{0};             // Sequence number of the timestamp frames
+	std::int64_t clockOffsetNs{0};             // Estimated server clock minus client clock
+	std::uint64_t bestRttNs{0};                // Round trip time of the echo the clock offset was taken from
+	char serverMessages[256] = {};             // Incomplete message received from the server
+	int bytesInServerMessages{0};
+
+	std::unique_ptr<RecordFilter> Filter;
+	std::string Record;                        // Incomplete record collected for the filter
+	std::string FilterSummaries;               // Summaries produced by the filter
+
+	TimestampFormat TimestampsRequested{ TimestampFormat::None }; // Requested for the next sessions
+	bool PrefixRequested{false};
+	TimestampFormat Timestamps{ TimestampFormat::None };          // Used in the current session
+	bool PrefixRecords{false};                 // Each record is prefixed with a timestamp
+	bool AtLineStart{true};                    // The next byte starts a record (tracked when timestamps are used)
+
+	bool ControlChannel{false};                // Control channel is requested for the next sessions
+	bool TrackControl{false};                  // The current session has the control channel
+	unsigned Verbosity{VERBOSITY_ALL};
+	bool BulkPaused{false};
+	unsigned FlushIntervalMs{0};
+	bool FlushDeferred{false};                 // flush() didn't send the data because of the flush interval
+	std::uint64_t lastFlushNs{0};              // Time when flush() last sent the data
+	std::uint64_t nextControlPollNs{0};        // Time when we next look for control requests
+
+	bool NoDelay{false};                       // TCP_NODELAY is set for the next sessions
+
+	bool TimeAccounting{false};                // Time accounting is requested for the next sessions
+	bool TrackTime{false};                     // Time is accounted in the current session
+	int accountingDepth{0};                    // Nesting of the accounted calls (e.g., putChar() calls flush())
+	std::uint64_t sessionStartTicks{0};
+
+	/* Adds the time of a call of the stream to the statistics (when the time accounting is on). */
+	class AccountedCall {
+	public:
+		explicit AccountedCall( SocketBufferBase &b ) : Buff( b ) {
+			if( Buff.TrackTime && Buff.accountingDepth++ == 0 )
+				Start = rawTimestamp();
+		}
+		~AccountedCall() {
+			if( Buff.TrackTime && --Buff.accountingDepth == 0 ) {
+				std::uint64_t now = rawTimestamp();
+				Buff.Statistics.streamTicks += now - Start;
+				Buff.Statistics.sessionTicks = now - Buff.sessionStartTicks;
+			}
+		}
+	private:
+		SocketBufferBase &Buff;
+		std::uint64_t Start{0};
+	};
+
+	Stats Statistics;
+	std::uint64_t nextTcpInfoNs{0};            // Time of the next TCP_INFO sample
+	bool AutotuneSendBuffer{false};
+	std::uint32_t AutotuneMaxBytes{0};
+}; //class SocketBufferBase
+
+#endif //SOCKETBUFFERBASE_H
@@ -0,0 +1,127 @@
+/*
+This is the header file with static tracepoints of the SocketBuffer (see FileViaSocket.h).
+Details are explained on GitHub: https://github.com/viktor-nikolov/lwIP-file-via-socket
+
+Tested (and ready for compilation) on FreeRTOS on AMD Xilinx Zynq SoC (Vitis 2023.1 toolchain),
+Windows 11 (MinGW toolchain) and Ubuntu 22.04 (gcc toolchain).
+
+BSD 2-Clause License:
+
+Copyright (c) 2024 Viktor Nikolov
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+#ifndef SOCKETBUFFERTRACE_H
+#define SOCKETBUFFERTRACE_H
+
+#include <cstddef>
+#include <cstdint>
+
+#if !defined(__WIN32__) && !defined(__linux__) && !defined(FVS_LWIP) // See FileViaSocket.h
+#   define FVS_LWIP
+#endif
+
+/* The tracepoints are compiled in only when FileViaSocket.cpp is compiled with -DFVS_TRACE:
+ *   Linux   - USDT probes of the provider "fvs" (header sys/sdt.h from the package systemtap-sdt-dev).
+ *             A probe, which no tracer is attached to, is a single nop instruction. See the bpftrace scripts
+ *             in the folder bpftrace.
+ *   FreeRTOS with lwIP (FVS_LWIP) - the events are stored to a ring in RAM (the newest FVS_TRACE_RING_SIZE events),
+ *             which can be read by a debugger (array fvsTraceRing) or copied by fvsTraceSnapshot().
+ *   Windows - no tracepoints.
+ * Probes and their arguments:
+ *   open( const char *ip, port )              - SocketBuffer::open() was called
+ *   connected( fd, const char *ip, port )     - the connection was established
+ *   flush( cause, bytes )                     - data leave the buffer; cause is one of FvsFlushCause
+ *   send_begin( fd, bytes ), send_end( fd, bytes, result ) - around each send() call
+ *   partial_send( fd, bytes, sent )           - send() sent only a part of the data
+ *   close( fd, dataBytes, wireBytes )         - the connection is being closed */
+enum FvsFlushCause {
+	FVS_FLUSH_FULL = 0,     // The buffer is full
+	FVS_FLUSH_DIRECT = 1,   // Data bigger than the buffer are sent without copying to the buffer
+	FVS_FLUSH_EXPLICIT = 2, // flush(), std::endl, etc.
+	FVS_FLUSH_DEFERRED = 3, // The flush deferred because of the flush interval (see SocketBuffer::flushIntervalMs())
+	FVS_FLUSH_CLOSE = 4     // The stream is being closed
+};
+
+#if defined(FVS_TRACE) && defined(FVS_LWIP) // FreeRTOS with lwIP: the trace ring
+
+#ifndef FVS_TRACE_RING_SIZE
+#   define FVS_TRACE_RING_SIZE 256 // Must be a power of two
+#endif
+
+enum FvsTraceProbe {
+	FVS_PROBE_OPEN = 0, FVS_PROBE_CONNECTED, FVS_PROBE_FLUSH, FVS_PROBE_SEND_BEGIN, FVS_PROBE_SEND_END,
+	FVS_PROBE_PARTIAL_SEND, FVS_PROBE_CLOSE
+};
+
+struct FvsTraceEvent {
+	std::uint64_t ticks;  // SocketBuffer::rawTimestamp() (on Zynq XTime_GetTime(), COUNTS_PER_SECOND ticks per second)
+	std::uint32_t a;      // The arguments of the probe following the fd (the IP address isn't stored)
+	std::uint32_t b;
+	std::uint16_t probe;  // FvsTraceProbe
+	std::int16_t fd;      // Socket, or -1
+};
+
+extern FvsTraceEvent fvsTraceRing[FVS_TRACE_RING_SIZE];
+extern volatile std::uint32_t fvsTraceCount; // Number of events recorded; the newest is fvsTraceRing[(fvsTraceCount-1) % size]
+
+void fvsTraceRecord( FvsTraceProbe probe, int fd, std::uint32_t a, std::uint32_t b );
+
+/* Copies up to max newest events to dest, the oldest first; returns the number of events copied.
+ * (An event recorded by another task during the copy may be torn.) */
+std::size_t fvsTraceSnapshot( FvsTraceEvent *dest, std::size_t max );
+
+#   define FVS_TRACE_OPEN( ip, port )                   fvsTraceRecord( FVS_PROBE_OPEN, -1, (port), 0 )
+#   define FVS_TRACE_CONNECTED( fd, ip, port )          fvsTraceRecord( FVS_PROBE_CONNECTED, (fd), (port), 0 )
+#   define FVS_TRACE_FLUSH( cause, bytes )              fvsTraceRecord( FVS_PROBE_FLUSH, -1, (cause), std::uint32_t(bytes) )
+#   define FVS_TRACE_SEND_BEGIN( fd, bytes )            fvsTraceRecord( FVS_PROBE_SEND_BEGIN, (fd), std::uint32_t(bytes), 0 )
+#   define FVS_TRACE_SEND_END( fd, bytes, result )      fvsTraceRecord( FVS_PROBE_SEND_END, (fd), std::uint32_t(bytes), std::uint32_t(result) )
+#   define FVS_TRACE_PARTIAL_SEND( fd, bytes, sent )    fvsTraceRecord( FVS_PROBE_PARTIAL_SEND, (fd), std::uint32_t(bytes), std::uint32_t(sent) )
+#   define FVS_TRACE_CLOSE( fd, dataBytes, wireBytes )  fvsTraceRecord( FVS_PROBE_CLOSE, (fd), std::uint32_t(dataBytes), std::uint32_t(wireBytes) )
+
+#elif defined(FVS_TRACE) && defined(__linux__) // USDT probes
+
+#   if defined(__has_include)
+#       if !__has_include(<sys/sdt.h>)
+#           error "FVS_TRACE needs sys/sdt.h (install the package systemtap-sdt-dev)"
+#       endif
+#   endif
+#   include <sys/sdt.h>
+
+#   define FVS_TRACE_OPEN( ip, port )                   DTRACE_PROBE2( fvs, open, (ip), int(port) )
+#   define FVS_TRACE_CONNECTED( fd, ip, port )          DTRACE_PROBE3( fvs, connected, int(fd), (ip), int(port) )
+#   define FVS_TRACE_FLUSH( cause, bytes )              DTRACE_PROBE2( fvs, flush, int(cause), std::int64_t(bytes) )
+#   define FVS_TRACE_SEND_BEGIN( fd, bytes )            DTRACE_PROBE2( fvs, send_begin, int(fd), std::int64_t(bytes) )
+#   define FVS_TRACE_SEND_END( fd, bytes, result )      DTRACE_PROBE3( fvs, send_end, int(fd), std::int64_t(bytes), std::int64_t(result) )
+#   define FVS_TRACE_PARTIAL_SEND( fd, bytes, sent )    DTRACE_PROBE3( fvs, partial_send, int(fd), std::int64_t(bytes), std::int64_t(sent) )
+#   define FVS_TRACE_CLOSE( fd, dataBytes, wireBytes )  DTRACE_PROBE3( fvs, close, int(fd), std::uint64_t(dataBytes), std::uint64_t(wireBytes) )
+
+#else // No tracepoints (the arguments are only evaluated to avoid warnings about unused variables)
+
+#   define FVS_TRACE_OPEN( ip, port )                   do { (void)(ip); (void)(port); } while( 0 )
+#   define FVS_TRACE_CONNECTED( fd, ip, port )          do { (void)(fd); (void)(ip); (void)(port); } while( 0 )
+#   define FVS_TRACE_FLUSH( cause, bytes )              do { (void)(cause); (void)(bytes); } while( 0 )
+#   define FVS_TRACE_SEND_BEGIN( fd, bytes )            do { (void)(fd); (void)(bytes); } while( 0 )
+#   define FVS_TRACE_SEND_END( fd, bytes, result )      do { (void)(fd); (void)(bytes); (void)(result); } while( 0 )
+#   define FVS_TRACE_PARTIAL_SEND( fd, bytes, sent )    do { (void)(fd); (void)(bytes); (void)(sent); } while( 0 )
+#   define FVS_TRACE_CLOSE( fd, dataBytes, wireBytes )  do { (void)(fd); (void)(dataBytes); (void)(wireBytes); } while( 0 )
+
+#endif
+
+#endif //SOCKETBUFFERTRACE_H
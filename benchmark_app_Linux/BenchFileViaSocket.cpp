@@ -0,0 +1,1487 @@
+/*
+Benchmark of the CPU efficiency of FileViaSocket: each scenario (writing chars, ints, small and big blocks,
+flushing after each line) runs with perf_event_open counters of the sending thread, and the cost is reported
+as cycles per byte and instructions per record, split between the user space (our buffering and ostream
+formatting) and the kernel (i.e., mostly the send() syscalls).
+In the latency mode (-l), it measures the time from writing and flushing a short message till its arrival
+at the built-in receiver, for several message sizes, with and without TCP_NODELAY.
+With -o, each scenario runs also with the out-of-line write path (each write calls SocketBufferBase),
+to show what the inline fast path of BasicSocketBuffer saves.
+In the baseline mode (-b), it sends the same data by raw TCP in the iperf2 protocol and by FileViaSocket
+to the same receiver (e.g., iperf -s), and reports the FileViaSocket throughput as a percentage of raw TCP
+and the difference in CPU time.
+In the filter mode (-f), it writes a noisy log (90 % the same error line, 5 % debug lines, 5 % unique lines)
+without and with the record filter (repeat suppression, sampling of the debug lines), reporting the time
+per record and the bytes sent.
+In the timestamp mode (-w), it writes records without a timestamp, with the hardware timestamp prefixed
+automatically, by the hwTimestamp manipulator and with the wall-clock time formatted by std::put_time,
+reporting the time per record.
+In the dictionary mode (-d), it splits a sample of records into flushes of the given sizes and compresses each
+flush as one frame by the Fast level and against a static dictionary (see train_dictionary.py), reporting
+the compression ratio and the CPU time per flush. No data are sent.
+Details are explained on GitHub: https://github.com/viktor-nikolov/lwIP-file-via-socket
+
+Tested (and ready for compilation) on Ubuntu 22.04 (gcc toolchain). Linux only (perf_event_open).
+
+BSD 2-Clause License:
+
+Copyright (c) 2024 Viktor Nikolov
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+#include <chrono>
+#include <algorithm>
+#include <thread>
+#include <atomic>
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
+#include <memory>
+#include <stdexcept>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cstdint>
+#include <ctime>
+#include "FileViaSocket.h"
+#include "JsonLineWriter.h"
+
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <sys/ioctl.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+
+static std::int64_t nowNs()
+{
+	return std::chrono::duration_cast<std::chrono::nanoseconds>( std::chrono::steady_clock::now().time_since_epoch() ).count();
+}
+
+/* Counters of the calling thread. Each counter is a separate perf event (not a group), so the kernel can
+ * multiplex them when there are not enough hardware counters; the values are scaled by the time the counter
+ * actually ran. A counter, which can't be opened (e.g., kernel counters with perf_event_paranoid > 1,
+ * or hardware counters in a VM), reports -1. */
+class PerfCounters {
+public:
+	enum Counter { CYCLES_USER, CYCLES_KERNEL, INSTRUCTIONS_USER, INSTRUCTIONS_KERNEL, CACHE_MISSES, CONTEXT_SWITCHES, COUNT };
+
+	PerfCounters() {
+		open( CYCLES_USER,         PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES,       true,  false );
+		open( CYCLES_KERNEL,       PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES,       false, true );
+		open( INSTRUCTIONS_USER,   PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS,     true,  false );
+		open( INSTRUCTIONS_KERNEL, PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS,     false, true );
+		open( CACHE_MISSES,        PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES,     true,  true );
+		open( CONTEXT_SWITCHES,    PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CONTEXT_SWITCHES, true,  true );
+	}
+	~PerfCounters() {
+		for( int fd : Fds )
+			if( fd >= 0 )
+				::close( fd );
+	}
+
+	void start() {
+		for( int fd : Fds )
+			if( fd >= 0 ) {
+				ioctl( fd, PERF_EVENT_IOC_RESET, 0 );
+				ioctl( fd, PERF_EVENT_IOC_ENABLE, 0 );
+			}
+	}
+
+	void stop() {
+		for( int i = 0; i < COUNT; i++ ) {
+			Values[i] = -1;
+			if( Fds[i] < 0 )
+				continue;
+			ioctl( Fds[i], PERF_EVENT_IOC_DISABLE, 0 );
+			std::uint64_t v[3]; // value, time enabled, time running
+			if( read( Fds[i], v, sizeof(v) ) == sizeof(v) && v[2] > 0 )
+				Values[i] = double( v[0] ) * double( v[1] ) / double( v[2] );
+		}
+	}
+
+	double value( Counter c ) const { return Values[c]; }
+	bool available( Counter c ) const { return Fds[c] >= 0; }
+
+private:
+	void open( Counter c, std::uint32_t type, std::uint64_t config, bool user, bool kernel ) {
+		perf_event_attr attr;
+		std::memset( &attr, 0, sizeof(attr) );
+		attr.size = sizeof(attr);
+		attr.type = type;
+		attr.config = config;
+		attr.disabled = 1;
+		attr.exclude_user = user ? 0 : 1;
+		attr.exclude_kernel = kernel ? 0 : 1;
+		attr.exclude_hv = 1;
+		attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+		// pid 0, cpu -1: the calling thread on any CPU (the receiver thread isn't counted)
+		Fds[c] = int( syscall( SYS_perf_event_open, &attr, 0, -1, -1, 0 ) );
+	}
+
+	int Fds[COUNT] = { -1, -1, -1, -1, -1, -1 };
+	double Values[COUNT] = {};
+}; //class PerfCounters
+
+/* Receiver, which accepts connections on the loopback and discards the data. It's used when no server
+ * address is given, so the benchmark measures the client, not the server script.
+ * It counts the bytes received in the current connection and notes the time of the last arrival
+ * (the latency mode waits for each message to arrive). Both are reset when a connection is accepted, so a client
+ * waits for its connection (see waitForConnection()) before it compares them with its own data.
+ * With bytesPerSecond > 0, it reads no faster than that, with a small receive buffer, so the TCP window
+ * throttles the client as a slow link would (the compression mode). */
+class DiscardingReceiver {
+public:
+	explicit DiscardingReceiver( double bytesPerSecond = 0 ) : Rate( bytesPerSecond ) {
+		Listener = socket( AF_INET, SOCK_STREAM, 0 );
+		if( Rate > 0 && Listener >= 0 ) { // Inherited by the accepted sockets
+			int size = THROTTLED_RCVBUF;
+			setsockopt( Listener, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size) );
+		}
+		sockaddr_in addr{};
+		addr.sin_family = AF_INET;
+		addr.sin_addr.s_addr = htonl( INADDR_LOOPBACK );
+		addr.sin_port = 0; // Any free port
+		socklen_t len = sizeof(addr);
+		if( Listener < 0 || bind( Listener, (sockaddr*)&addr, sizeof(addr) ) != 0 || listen( Listener, 4 ) != 0
+		    || getsockname( Listener, (sockaddr*)&addr, &len ) != 0 )
+			throw std::runtime_error( "Unable to start the receiver: " + std::string( std::strerror( errno ) ) );
+		Port = ntohs( addr.sin_port );
+		Thread = std::thread( &DiscardingReceiver::run, this );
+	}
+	~DiscardingReceiver() {
+		Stop = true;
+		shutdown( Listener, SHUT_RDWR ); // Wakes up accept()
+		Thread.join();
+		::close( Listener );
+	}
+
+	unsigned short port() const { return Port; }
+	std::uint64_t received() const { return Received.load( std::memory_order_acquire ); }
+	std::int64_t arrivalNs() const { return ArrivalNs.load( std::memory_order_relaxed ); }
+	// Number of connections accepted so far
+	unsigned connections() const { return Connections.load( std::memory_order_acquire ); }
+	// Waits till the receiver accepted the given number of connections (i.e., the counters are of the last one)
+	void waitForConnection( unsigned count ) const {
+		while( connections() < count )
+			std::this_thread::sleep_for( std::chrono::microseconds( 100 ) );
+	}
+
+private:
+	void run() {
+		std::vector<char> data( 256*1024 );
+		while( !Stop ) {
+			int s = accept( Listener, nullptr, nullptr );
+			if( s < 0 )
+				break;
+			Received.store( 0, std::memory_order_relaxed );
+			ArrivalNs.store( 0, std::memory_order_relaxed );
+			Connections.fetch_add( 1, std::memory_order_release );
+			const std::int64_t start = nowNs();
+			const std::size_t chunk = Rate > 0 ? THROTTLED_RCVBUF / 4 : data.size();
+			ssize_t n;
+			while( (n = recv( s, data.data(), chunk, 0 )) > 0 ) {
+				ArrivalNs.store( nowNs(), std::memory_order_relaxed );
+				const std::uint64_t total = Received.fetch_add( std::uint64_t( n ), std::memory_order_release ) + n;
+				if( Rate > 0 ) { // Sleep till the time, when a link of the given rate would have delivered the data
+					const std::int64_t due = start + std::int64_t( double( total ) / Rate * 1e9 );
+					const std::int64_t wait = due - nowNs();
+					if( wait > 0 )
+						std::this_thread::sleep_for( std::chrono::nanoseconds( wait ) );
+				}
+			}
+			::close( s );
+		}
+	}
+
+	static const int THROTTLED_RCVBUF = 64*1024;
+
+	double Rate;
+	int Listener{ -1 };
+	unsigned short Port{ 0 };
+	std::atomic<bool> Stop{ false };
+	std::atomic<std::uint64_t> Received{ 0 };
+	std::atomic<std::int64_t> ArrivalNs{ 0 };
+	std::atomic<unsigned> Connections{ 0 };
+	std::thread Thread;
+}; //class DiscardingReceiver
+
+/* Receiver of the pool mode: it accepts any number of concurrent connections and discards their data,
+ * all of them together no faster than the given rate (a capture host limited by its disk or NIC). */
+class PoolReceiver {
+public:
+	explicit PoolReceiver( double bytesPerSecond ) : Rate( bytesPerSecond ), StartNs( nowNs() ) {
+		Listener = socket( AF_INET, SOCK_STREAM, 0 );
+		int size = RCVBUF;
+		sockaddr_in addr{};
+		addr.sin_family = AF_INET;
+		addr.sin_addr.s_addr = htonl( INADDR_LOOPBACK );
+		addr.sin_port = 0; // Any free port
+		socklen_t len = sizeof(addr);
+		if( Listener < 0 || setsockopt( Listener, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size) ) != 0
+		    || bind( Listener, (sockaddr*)&addr, sizeof(addr) ) != 0 || listen( Listener, 64 ) != 0
+		    || getsockname( Listener, (sockaddr*)&addr, &len ) != 0 )
+			throw std::runtime_error( "Unable to start the receiver: " + std::string( std::strerror( errno ) ) );
+		Port = ntohs( addr.sin_port );
+		Thread = std::thread( &PoolReceiver::run, this );
+	}
+	~PoolReceiver() {
+		shutdown( Listener, SHUT_RDWR ); // Wakes up accept()
+		Thread.join();
+		::close( Listener );
+		for( std::thread &t : Connections ) // The clients closed their sessions already
+			t.join();
+	}
+
+	unsigned short port() const { return Port; }
+	std::uint64_t received() const { return Received.load( std::memory_order_acquire ); }
+	unsigned sessions() const { return Sessions.load( std::memory_order_relaxed ); }
+
+private:
+	void run() {
+		int s;
+		while( (s = accept( Listener, nullptr, nullptr )) >= 0 ) {
+			Sessions.fetch_add( 1, std::memory_order_relaxed );
+			Connections.emplace_back( &PoolReceiver::serve, this, s );
+		}
+	}
+	void serve( int s ) {
+		std::vector<char> data( RCVBUF / 4 );
+		ssize_t n;
+		while( (n = recv( s, data.data(), data.size(), 0 )) > 0 ) {
+			const std::uint64_t total = Received.fetch_add( std::uint64_t( n ), std::memory_order_release ) + n;
+			if( Rate > 0 ) { // Sleep till the time, when the receiver of the given rate would have taken the data
+				const std::int64_t wait = StartNs + std::int64_t( double( total ) / Rate * 1e9 ) - nowNs();
+				if( wait > 0 )
+					std::this_thread::sleep_for( std::chrono::nanoseconds( wait ) );
+			}
+		}
+		::close( s );
+	}
+
+	static const int RCVBUF = 64*1024;
+
+	double Rate;
+	std::int64_t StartNs;
+	int Listener{ -1 };
+	unsigned short Port{ 0 };
+	std::atomic<std::uint64_t> Received{ 0 };
+	std::atomic<unsigned> Sessions{ 0 };
+	std::thread Thread;
+	std::vector<std::thread> Connections; // Only the accepting thread touches it till the destructor
+}; //class PoolReceiver
+
+struct Options {
+	std::string       serverAddress{ "127.0.0.1" };
+	unsigned short    serverPort{ 0 };       // 0 = the built-in receiver
+	std::uint64_t     bytes{ 100*1000*1000 }; // Data written by each scenario (flush-heavy writes 1/16 of it)
+	SocketBuffer::Compression compression{ SocketBuffer::Compression::None };
+	bool              latency{ false };      // The latency mode
+	bool              baseline{ false };     // The baseline mode (raw TCP vs FileViaSocket)
+	bool              outOfLine{ false };    // The scenarios run also with OutOfLineFileViaSocket
+	bool              json{ false };         // The JSON mode (JsonLineWriter vs operator<<)
+	bool              filterBench{ false };  // The filter mode (the noisy log without and with the record filter)
+	bool              timestampBench{ false }; // The timestamp mode (the costs of the timestamps of the records)
+	bool              compressionBench{ false }; // The compression mode (the levels on a fast and on slow links)
+	bool              autotuneBench{ false }; // The autotune mode (the send buffer without and with the autotuning)
+	bool              poolBench{ false };    // The pool mode (sessions spread over a pool of receivers)
+	bool              bytesGiven{ false };   // -n was given
+	std::vector<double> linkRates{ 0, 100, 20 }; // Mbit/s of the links of the compression mode (0 = no limit)
+	bool              ratesGiven{ false };   // -r was given
+	std::string       dictionaryFile;        // The dictionary mode: the dictionary and the sample of the records
+	std::string       samplesFile;
+	bool              sizesGiven{ false };   // -m was given
+	unsigned          iterations{ 1000000 }; // Messages of each size in the latency mode, events in the JSON mode
+	bool              iterationsGiven{ false }; // -i was given
+	std::vector<std::size_t> messageSizes{ 16, 64, 256, 1024 };
+};
+
+/* The default configuration of the buffer without the inline writes: each write calls SocketBufferBase,
+ * as FileViaSocket did before BasicSocketBuffer (the scenarios marked by '*' with -o). */
+struct OutOfLineWrites {
+	static const bool INLINE_WRITES = false;
+	static bool flushAfter( const char*, std::size_t ) { return false; }
+};
+using OutOfLineFileViaSocket = BasicFileViaSocket<SocketBufferBase::DEFAULT_BUFF_SIZE, SocketTransport, OutOfLineWrites>;
+
+/* Scenario writes about the given number of bytes to the stream and returns the number of records it wrote. */
+struct Scenario {
+	const char *name;
+	const char *record;  // What one record is
+	std::uint64_t (*run)( std::ostream &f, std::uint64_t bytes );
+};
+
+static const Scenario Scenarios[] = {
+	{ "char", "1 char", []( std::ostream &f, std::uint64_t bytes ) -> std::uint64_t {
+		for( std::uint64_t i = 0; i < bytes; i++ )
+			f << char( (i % 64 == 63) ? '\n' : 'A' + i % 26 );
+		return bytes;
+	} },
+	{ "int", "int and '\\n'", []( std::ostream &f, std::uint64_t bytes ) -> std::uint64_t {
+		std::uint64_t records = bytes / 11; // Values of 1000000000 and up have 10 digits
+		for( std::uint64_t i = 0; i < records; i++ )
+			f << 1000000000 + i << '\n';
+		return records;
+	} },
+	{ "small", "write() of 64 B", []( std::ostream &f, std::uint64_t bytes ) -> std::uint64_t {
+		static char line[64];
+		for( int i = 0; i < 64; i++ )
+			line[i] = (i == 63) ? '\n' : 'A' + i % 26;
+		std::uint64_t records = bytes / sizeof(line);
+		for( std::uint64_t i = 0; i < records; i++ )
+			f.write( line, sizeof(line) );
+		return records;
+	} },
+	{ "bulk", "write() of 64 KB", []( std::ostream &f, std::uint64_t bytes ) -> std::uint64_t {
+		static std::vector<char> block( 64*1024 );
+		for( std::size_t i = 0; i < block.size(); i++ )
+			block[i] = 'A' + i % 26;
+		std::uint64_t records = bytes / block.size();
+		for( std::uint64_t i = 0; i < records; i++ )
+			f.write( block.data(), std::streamsize( block.size() ) );
+		return records;
+	} },
+	{ "flush", "32 B line and flush", []( std::ostream &f, std::uint64_t bytes ) -> std::uint64_t {
+		std::uint64_t records = bytes / 16 / 32;
+		for( std::uint64_t i = 0; i < records; i++ )
+			f << "Temperature: 41 C, fan: 2000 rpm\n" << std::flush;
+		return records;
+	} },
+};
+
+static double threadCpuMs( bool kernel )
+{
+	rusage usage;
+	getrusage( RUSAGE_THREAD, &usage );
+	const timeval &t = kernel ? usage.ru_stime : usage.ru_utime;
+	return t.tv_sec * 1e3 + t.tv_usec / 1e3;
+}
+
+// Prints the value per unit, or "n/a" when the counter isn't available
+static void printPer( double value, double units, int width, int precision )
+{
+	if( value < 0 || units <= 0 )
+		std::cout << std::setw( width ) << "n/a";
+	else
+		std::cout << std::setw( width ) << std::fixed << std::setprecision( precision ) << value / units;
+}
+
+template<class Stream>
+static bool runScenario( const Options &options, const Scenario &scenario, const char *mark )
+{
+	PerfCounters counters;
+	Stream f;
+	f.setCompression( options.compression );
+	try {
+		f.open( options.serverAddress, options.serverPort );
+	}
+	catch( const std::exception& e ) {
+		std::cerr << "Error on opening the socket: " << e.what() << std::endl;
+		return false;
+	}
+
+	const double userMs = threadCpuMs( false ), kernelMs = threadCpuMs( true );
+	const auto start = std::chrono::steady_clock::now();
+	counters.start();
+	const std::uint64_t records = scenario.run( f, options.bytes );
+	f.flush();
+	counters.stop();
+	const double seconds = std::chrono::duration<double>( std::chrono::steady_clock::now() - start ).count();
+	const double userCpuMs = threadCpuMs( false ) - userMs, kernelCpuMs = threadCpuMs( true ) - kernelMs;
+	const double bytes = double( f.stats().dataBytes );
+	const double sendCalls = double( f.stats().sendCalls );
+	f.close();
+	if( !f ) {
+		std::cerr << "Error on sending the data of scenario " << scenario.name << std::endl;
+		return false;
+	}
+
+	std::cout << std::left << std::setw( 6 ) << (std::string( scenario.name ) + mark) << std::right;
+	printPer( counters.value( PerfCounters::CYCLES_USER ), bytes, 9, 2 );
+	printPer( counters.value( PerfCounters::CYCLES_KERNEL ), bytes, 9, 2 );
+	printPer( counters.value( PerfCounters::INSTRUCTIONS_USER ), double( records ), 9, 1 );
+	printPer( counters.value( PerfCounters::INSTRUCTIONS_KERNEL ), double( records ), 9, 1 );
+	printPer( counters.value( PerfCounters::CACHE_MISSES ), bytes / 1024, 9, 2 );
+	printPer( counters.value( PerfCounters::CONTEXT_SWITCHES ), 1, 8, 0 );
+	printPer( userCpuMs, 1, 8, 0 );
+	printPer( kernelCpuMs, 1, 8, 0 );
+	printPer( sendCalls, 1, 9, 0 );
+	printPer( bytes / 1e6, seconds, 8, 1 );
+	std::cout << "   " << records << " x " << scenario.record << std::endl;
+	return true;
+}
+
+/* Writes and flushes messages of the given size one by one; each is written after the previous one arrived
+ * at the receiver. The time from the write till the arrival, and the time spent in write() and flush()
+ * themselves, are collected to histograms. */
+static bool runLatency( const Options &options, const DiscardingReceiver &receiver, std::size_t size, bool noDelay )
+{
+	FileViaSocket f;
+	f.setNoDelay( noDelay );
+	const unsigned connection = receiver.connections() + 1;
+	try {
+		f.open( options.serverAddress, options.serverPort );
+	}
+	catch( const std::exception& e ) {
+		std::cerr << "Error on opening the socket: " << e.what() << std::endl;
+		return false;
+	}
+	receiver.waitForConnection( connection ); // The counters of the previous session must not be compared
+
+	std::string message( size, 'A' );
+	message.back() = '\n';
+	LatencyHistogram arrival, flushCall;
+	const unsigned warmup = options.iterations / 100 + 10;
+	for( unsigned i = 0; i < warmup + options.iterations && f; i++ ) {
+		const std::int64_t start = nowNs();
+		f.write( message.data(), std::streamsize( size ) );
+		f.flush();
+		const std::int64_t flushed = nowNs();
+		const std::uint64_t expected = f.stats().wireBytes;
+		for( unsigned spins = 0; receiver.received() < expected; spins++ )
+			if( spins > 1000 ) // Let the receiver run when we share the CPU with it
+				std::this_thread::yield();
+		const std::int64_t arrived = receiver.arrivalNs();
+		if( i >= warmup && arrived >= start ) { // A sample before the start would be a measurement error; it's dropped
+			arrival.record( std::uint64_t( arrived - start ) );
+			flushCall.record( std::uint64_t( flushed - start ) );
+		}
+	}
+	f.close();
+	if( !f ) {
+		std::cerr << "Error on sending the messages" << std::endl;
+		return false;
+	}
+
+	std::cout << std::left << std::setw( 9 ) << (noDelay ? "nodelay" : "blocking") << std::right << std::setw( 6 ) << size
+	          << std::fixed << std::setprecision( 1 );
+	for( double p : { 50.0, 90.0, 99.0, 99.9, 99.99 } )
+		std::cout << std::setw( 9 ) << arrival.percentile( p ) / 1e3;
+	std::cout << std::setw( 10 ) << arrival.max() / 1e3
+	          << std::setw( 9 ) << flushCall.percentile( 50 ) / 1e3 << std::setw( 9 ) << flushCall.percentile( 99 ) / 1e3 << std::endl;
+	return true;
+}
+
+/* Header of an iperf2 TCP test (struct client_hdr of iperf2, lwiperf_settings_t of lwIP's lwiperf), which the
+ * client sends at the start of the data. All fields are big-endian 32-bit numbers. Flags 0 mean a plain test
+ * (no dual test, so the server doesn't connect back); amount > 0 is the number of bytes to send. */
+static const std::size_t IPERF_HEADER_SIZE = 24;
+static const std::size_t IPERF_BLOCK_SIZE = 128*1024; // The default length of the iperf2 writes (-l)
+
+static void putIperfHeader( char *dest, std::uint64_t bytes, unsigned short port )
+{
+	const std::uint32_t fields[6] = { 0,                         // flags
+	                                  1,                         // numThreads
+	                                  port,                      // mPort
+	                                  std::uint32_t( IPERF_BLOCK_SIZE ), // bufferlen
+	                                  0,                         // mWinBand
+	                                  std::uint32_t( std::min<std::uint64_t>( bytes, 0x7FFFFFFF ) ) }; // mAmount
+	for( int i = 0; i < 6; i++ ) {
+		std::uint32_t value = htonl( fields[i] );
+		std::memcpy( dest + 4*i, &value, 4 );
+	}
+}
+
+/* Result of one bulk transfer of the baseline mode */
+struct BulkResult {
+	double seconds{ 0 };
+	double userCpuMs{ 0 }, kernelCpuMs{ 0 };
+	double cyclesUser{ -1 }, cyclesKernel{ -1 };
+	double sendCalls{ 0 };
+};
+
+/* Sends the block (which starts with the iperf header) repeatedly, till the given number of bytes is sent.
+ * Raw TCP: by send() of the whole block, like iperf. FileViaSocket: by write() of the whole block. */
+static bool runBulk( const Options &options, const std::vector<char> &block, bool raw, BulkResult &result )
+{
+	PerfCounters counters;
+	int s = -1;
+	FileViaSocket f;
+	if( raw ) {
+		sockaddr_in addr{};
+		addr.sin_family = AF_INET;
+		addr.sin_port = htons( options.serverPort );
+		s = socket( AF_INET, SOCK_STREAM, 0 );
+		if( s < 0 || inet_pton( AF_INET, options.serverAddress.c_str(), &addr.sin_addr ) != 1
+		    || connect( s, (sockaddr*)&addr, sizeof(addr) ) != 0 ) {
+			std::cerr << "Error on connecting the raw TCP socket: " << std::strerror( errno ) << std::endl;
+			if( s >= 0 )
+				::close( s );
+			return false;
+		}
+	}
+	else {
+		try {
+			f.open( options.serverAddress, options.serverPort );
+		}
+		catch( const std::exception& e ) {
+			std::cerr << "Error on opening the socket: " << e.what() << std::endl;
+			return false;
+		}
+	}
+
+	const double userMs = threadCpuMs( false ), kernelMs = threadCpuMs( true );
+	const std::int64_t start = nowNs();
+	counters.start();
+	bool success = true;
+	for( std::uint64_t sent = 0; sent < options.bytes && success; sent += block.size() ) {
+		if( raw ) {
+			for( std::size_t done = 0; done < block.size(); ) { // send() may send only a part of the block
+				ssize_t n = send( s, block.data() + done, block.size() - done, 0 );
+				result.sendCalls++;
+				if( n <= 0 ) {
+					success = false;
+					break;
+				}
+				done += std::size_t( n );
+			}
+		}
+		else
+			success = bool( f.write( block.data(), std::streamsize( block.size() ) ) );
+	}
+	if( !raw )
+		success = success && f.flush();
+	counters.stop();
+	result.seconds = double( nowNs() - start ) / 1e9;
+	result.userCpuMs = threadCpuMs( false ) - userMs;
+	result.kernelCpuMs = threadCpuMs( true ) - kernelMs;
+	result.cyclesUser = counters.value( PerfCounters::CYCLES_USER );
+	result.cyclesKernel = counters.value( PerfCounters::CYCLES_KERNEL );
+	if( raw )
+		::close( s );
+	else {
+		result.sendCalls = double( f.stats().sendCalls );
+		f.close();
+	}
+	if( !success )
+		std::cerr << "Error on sending the data by " << (raw ? "raw TCP" : "FileViaSocket") << std::endl;
+	return success;
+}
+
+static void printBulk( const char *name, const BulkResult &r, double bytes )
+{
+	std::cout << std::left << std::setw( 14 ) << name << std::right;
+	printPer( bytes / 1e6, r.seconds, 9, 1 );
+	printPer( r.userCpuMs, 1, 9, 0 );
+	printPer( r.kernelCpuMs, 1, 8, 0 );
+	printPer( r.cyclesUser, bytes, 9, 2 );
+	printPer( r.cyclesKernel, bytes, 8, 2 );
+	printPer( r.sendCalls, 1, 10, 0 );
+	std::cout << std::endl;
+}
+
+/* The baseline mode: raw TCP first, then FileViaSocket, the same data to the same receiver */
+static bool runBaseline( const Options &options, bool builtInReceiver )
+{
+	std::vector<char> block( IPERF_BLOCK_SIZE );
+	for( std::size_t i = 0; i < block.size(); i++ )
+		block[i] = 'A' + i % 26;
+	const std::uint64_t blocks = (options.bytes + block.size() - 1) / block.size();
+	putIperfHeader( block.data(), blocks * block.size(), options.serverPort );
+	const double bytes = double( blocks * block.size() );
+
+	std::cout << "Raw TCP (iperf2 protocol) vs FileViaSocket: " << bytes / 1e6 << " MB in writes of "
+	          << block.size() / 1024 << " KB to " << options.serverAddress << ":" << options.serverPort
+	          << (builtInReceiver ? " (built-in receiver)" : "") << std::endl
+	          << "                              CPU ms    cycles/byte     send()" << std::endl
+	          << "                   MB/s     user  kernel     user  kernel     calls" << std::endl;
+	BulkResult raw, fvs;
+	if( !runBulk( options, block, true, raw ) )
+		return false;
+	printBulk( "raw TCP", raw, bytes );
+	if( !runBulk( options, block, false, fvs ) )
+		return false;
+	printBulk( "FileViaSocket", fvs, bytes );
+
+	const double rawCpuMs = raw.userCpuMs + raw.kernelCpuMs, fvsCpuMs = fvs.userCpuMs + fvs.kernelCpuMs;
+	std::cout << std::fixed << std::setprecision( 1 ) << "FileViaSocket achieved " << raw.seconds / fvs.seconds * 100
+	          << " % of the raw TCP throughput; CPU time " << std::showpos << fvsCpuMs - rawCpuMs << " ms ("
+	          << (fvsCpuMs - rawCpuMs) * 1e3 / (bytes / 1e6) << " us per MB";
+	if( rawCpuMs > 0 )
+		std::cout << ", " << (fvsCpuMs / rawCpuMs - 1) * 100 << " %";
+	std::cout << std::noshowpos << ")" << std::endl;
+	return true;
+}
+
+/* Sends the data in one session with the send buffer autotuning off or on. The time runs till close() returns;
+ * with the control channel, close() waits till the server closed the connection after receiving all the data
+ * (the data still in the socket buffers would count otherwise). Prints the throughput and the last TCP_INFO sample. */
+static bool runAutotuneSession( const Options &options, const std::vector<char> &block, bool autotune )
+{
+	FileViaSocket f;
+	f.setSendBufferAutotune( autotune );
+	f.setControlChannel( true );
+	try {
+		f.open( options.serverAddress, options.serverPort );
+	}
+	catch( const std::exception& e ) {
+		std::cerr << "Error on opening the socket: " << e.what() << std::endl;
+		return false;
+	}
+
+	const std::int64_t start = nowNs();
+	for( std::uint64_t sent = 0; sent < options.bytes && f; sent += block.size() )
+		f.write( block.data(), std::streamsize( block.size() ) );
+	f.flush();
+	const SocketBufferBase::Stats stats = f.stats();
+	const bool success = bool( f );
+	f.close();
+	const double seconds = double( nowNs() - start ) / 1e9;
+	if( !success ) {
+		std::cerr << "Error on sending the data with the autotuning " << (autotune ? "on" : "off") << std::endl;
+		return false;
+	}
+
+	std::cout << std::left << std::setw( 10 ) << (autotune ? "on" : "off") << std::right << std::fixed
+	          << std::setprecision( 1 ) << std::setw( 7 ) << double( stats.dataBytes ) / 1e6 / seconds
+	          << std::setw( 9 ) << stats.rttUs / 1000.0
+	          << std::setprecision( 0 ) << std::setw( 11 ) << stats.sendBufferBytes / 1024.0
+	          << std::setw( 9 ) << stats.autotuneChanges << std::setw( 12 ) << stats.retransmits << std::endl;
+	return true;
+}
+
+/* The autotune mode: the same data without and with the send buffer autotuning, to a server behind a link
+ * with a high RTT (see rtt_bench.sh) */
+static bool runAutotune( const Options &options )
+{
+	std::vector<char> block( 64*1024 );
+	for( std::size_t i = 0; i < block.size(); i++ )
+		block[i] = 'A' + i % 26;
+
+	std::cout << "Send buffer autotuning: " << double( options.bytes ) / 1e6 << " MB to "
+	          << options.serverAddress << ":" << options.serverPort << std::endl
+	          << "autotune   MB/s   RTT ms  SNDBUF KB  changes  retransmits" << std::endl;
+	for( bool autotune : { false, true } )
+		if( !runAutotuneSession( options, block, autotune ) )
+			return false;
+	return true;
+}
+
+/* The sessions of the pool mode; each one is written by its own thread, as by the boards of a farm */
+static const unsigned POOL_SESSIONS = 64;
+
+/* Sends the data by POOL_SESSIONS sessions placed on the receivers by their keys and waits till the receivers
+ * got all of them. Returns the throughput in MB/s (0 on an error). */
+static double runPoolRound( const Options &options, const std::vector<std::unique_ptr<PoolReceiver>> &receivers )
+{
+	std::vector<SocketBufferBase::Receiver> pool;
+	for( const auto &r : receivers )
+		pool.push_back( { "127.0.0.1", r->port() } );
+	std::vector<char> block( 64*1024 );
+	for( std::size_t i = 0; i < block.size(); i++ )
+		block[i] = 'A' + i % 26;
+
+	const std::uint64_t perSession = options.bytes / POOL_SESSIONS;
+	std::atomic<bool> success{ true };
+	std::vector<std::thread> threads;
+	const std::int64_t start = nowNs();
+	for( unsigned i = 0; i < POOL_SESSIONS; i++ )
+		threads.emplace_back( [&, i]() {
+			FileViaSocket f;
+			try {
+				f.open( pool, "board-" + std::to_string( i ) );
+			}
+			catch( const std::exception& e ) {
+				std::cerr << "Error on opening the socket: " << e.what() << std::endl;
+				success = false;
+				return;
+			}
+			for( std::uint64_t sent = 0; sent < perSession && f; sent += block.size() )
+				f.write( block.data(), std::streamsize( block.size() ) );
+			f.flush();
+			if( !f )
+				success = false;
+			f.close();
+		} );
+	for( std::thread &t : threads )
+		t.join();
+	std::uint64_t received = 0;
+	while( success && received < POOL_SESSIONS * ((perSession + block.size() - 1) / block.size() * block.size()) ) {
+		std::this_thread::sleep_for( std::chrono::microseconds( 200 ) ); // The data in the socket buffers must arrive
+		received = 0;
+		for( const auto &r : receivers )
+			received += r->received();
+	}
+	if( !success )
+		return 0;
+	return double( received ) / 1e6 / ( double( nowNs() - start ) / 1e9 );
+}
+
+/* The pool mode: the same sessions spread over 1, 2, 4 and 8 receivers, each limited to the rate given by -r,
+ * and the cost of the failover, when a receiver of the pool is down */
+static bool runPool( const Options &options )
+{
+	const double rate = options.linkRates.empty() ? 0 : options.linkRates[0] * 1e6 / 8;
+	std::cout << "Receiver pool: " << double( options.bytes ) / 1e6 << " MB by " << POOL_SESSIONS
+	          << " sessions to receivers on the loopback, each taking ";
+	if( rate > 0 )
+		std::cout << rate * 8 / 1e6 << " Mbit/s";
+	else
+		std::cout << "data without a limit";
+	std::cout << std::endl << "receivers  sessions/receiver     MB/s  speedup" << std::endl;
+	double single = 0;
+	for( unsigned count : { 1u, 2u, 4u, 8u } ) {
+		std::vector<std::unique_ptr<PoolReceiver>> receivers;
+		try {
+			for( unsigned i = 0; i < count; i++ )
+				receivers.emplace_back( new PoolReceiver( rate ) );
+		}
+		catch( const std::exception& e ) {
+			std::cerr << e.what() << std::endl;
+			return false;
+		}
+		const double mbs = runPoolRound( options, receivers );
+		if( mbs == 0 )
+			return false;
+		if( count == 1 )
+			single = mbs;
+		unsigned least = POOL_SESSIONS, most = 0;
+		for( const auto &r : receivers ) {
+			least = std::min( least, r->sessions() );
+			most = std::max( most, r->sessions() );
+		}
+		std::cout << std::setw( 9 ) << count << std::setw( 12 ) << least << " - " << std::left << std::setw( 6 ) << most
+		          << std::right << std::fixed << std::setprecision( 1 ) << std::setw( 9 ) << mbs
+		          << std::setprecision( 2 ) << std::setw( 9 ) << mbs / single << std::endl;
+	}
+
+	/* Failover: the keys are placed on 4 receivers, then one of them goes down. The keys of the other receivers
+	 * must stay where they were, the keys of the stopped one move and pay for the refused connect. */
+	const unsigned KEYS = 200;
+	std::vector<std::unique_ptr<PoolReceiver>> receivers;
+	std::vector<SocketBufferBase::Receiver> pool;
+	try {
+		for( unsigned i = 0; i < 4; i++ ) {
+			receivers.emplace_back( new PoolReceiver( 0 ) );
+			pool.push_back( { "127.0.0.1", receivers.back()->port() } );
+		}
+	}
+	catch( const std::exception& e ) {
+		std::cerr << e.what() << std::endl;
+		return false;
+	}
+	std::vector<unsigned short> placement( KEYS );
+	FileViaSocket f;
+	double openUs[2] = { 0, 0 };   // Total time of open() of the keys, which stayed and which moved
+	unsigned opens[2] = { 0, 0 }, wrong = 0;
+	try {
+		for( unsigned k = 0; k < KEYS; k++ ) {
+			f.open( pool, "board-" + std::to_string( k ) );
+			placement[k] = f.serverPort();
+			f.close();
+		}
+		receivers[0].reset(); // The port refuses the connections now
+		for( unsigned k = 0; k < KEYS; k++ ) {
+			const std::int64_t start = nowNs();
+			f.open( pool, "board-" + std::to_string( k ) );
+			const double us = double( nowNs() - start ) / 1e3;
+			const bool moved = placement[k] == pool[0].port;
+			if( moved == (f.serverPort() == placement[k]) ) // A kept key must stay, a moved one must move
+				wrong++;
+			openUs[moved] += us;
+			opens[moved]++;
+			f.close();
+		}
+	}
+	catch( const std::exception& e ) {
+		std::cerr << "Error on opening the socket: " << e.what() << std::endl;
+		return false;
+	}
+	std::cout << "Failover with 1 of 4 receivers down, " << KEYS << " keys: " << opens[1] << " moved, "
+	          << wrong << " misplaced; open() took " << std::setprecision( 1 ) << openUs[0] / std::max( opens[0], 1u )
+	          << " us (kept), " << openUs[1] / std::max( opens[1], 1u ) << " us (moved)" << std::endl;
+	return wrong == 0;
+}
+
+/* Log lines of a controller (about 55 bytes each), with varying numbers, for the compression mode */
+static std::string makeLogLines( std::size_t bytes )
+{
+	static const char *LEVELS[] = { "DEBUG", "INFO ", "INFO ", "WARN " };
+	std::string text;
+	text.reserve( bytes + 128 );
+	std::uint32_t seed = 12345;
+	char line[128];
+	for( unsigned i = 0; text.size() < bytes; i++ ) {
+		seed = seed * 1103515245 + 12345;
+		const unsigned r = seed >> 8;
+		int len = std::snprintf( line, sizeof(line), "%02u:%02u:%02u.%03u %s fan[%u]: speed %u rpm, temp %u.%u C\n",
+		                         (i / 3600000) % 24, (i / 60000) % 60, (i / 1000) % 60, i % 1000, LEVELS[r % 4],
+		                         r % 8, 1200 + r % 900, 35 + r % 20, r % 10 );
+		text.append( line, std::size_t( len ) );
+	}
+	return text;
+}
+
+/* Sends the log lines compressed by the given mode and waits till the receiver got all wire bytes.
+ * Prints the data throughput, the wire/data ratio and the CPU time of the client. */
+static bool runCompressionMode( const Options &options, const DiscardingReceiver &receiver, const std::string &text,
+                                SocketBuffer::Compression mode, const char *name )
+{
+	FileViaSocket f;
+	f.setCompression( mode );
+	const unsigned connection = receiver.connections() + 1;
+	try {
+		f.open( options.serverAddress, receiver.port() );
+	}
+	catch( const std::exception& e ) {
+		std::cerr << "Error on opening the socket: " << e.what() << std::endl;
+		return false;
+	}
+	receiver.waitForConnection( connection );
+
+	const std::size_t WRITE_SIZE = 4096;
+	const double userMs = threadCpuMs( false ), kernelMs = threadCpuMs( true );
+	const std::int64_t start = nowNs();
+	for( std::uint64_t sent = 0; sent < options.bytes && f; ) {
+		const std::size_t pos = std::size_t( sent % (text.size() - WRITE_SIZE) );
+		f.write( text.data() + pos, WRITE_SIZE );
+		sent += WRITE_SIZE;
+	}
+	f.flush();
+	const std::uint64_t wire = f.stats().wireBytes;
+	while( receiver.received() < wire && f ) // The data in the socket buffers must arrive too
+		std::this_thread::sleep_for( std::chrono::microseconds( 200 ) );
+	const double seconds = double( nowNs() - start ) / 1e9;
+	const double cpuMs = threadCpuMs( false ) - userMs + threadCpuMs( true ) - kernelMs;
+	const double data = double( f.stats().dataBytes );
+	f.close();
+	if( !f ) {
+		std::cerr << "Error on sending the data compressed by " << name << std::endl;
+		return false;
+	}
+
+	std::cout << std::left << std::setw( 10 ) << name << std::right << std::fixed
+	          << std::setprecision( 1 ) << std::setw( 9 ) << data / 1e6 / seconds
+	          << std::setprecision( 3 ) << std::setw( 11 ) << double( wire ) / data
+	          << std::setprecision( 0 ) << std::setw( 9 ) << cpuMs << std::endl;
+	return true;
+}
+
+/* The compression mode: the same log lines by each compression mode, over the loopback without a limit
+ * and through the throttled receiver (a slow link) */
+static bool runCompression( const Options &options )
+{
+	const std::string text = makeLogLines( 4*1024*1024 );
+	const std::pair<SocketBuffer::Compression, const char*> modes[] = {
+		{ SocketBuffer::Compression::None, "none" }, { SocketBuffer::Compression::Fast, "fast" },
+		{ SocketBuffer::Compression::Strong, "strong" }, { SocketBuffer::Compression::Adaptive, "adaptive" } };
+
+	std::cout << "Compression: " << double( options.bytes ) / 1e6 << " MB of log lines to the built-in receiver" << std::endl;
+	for( double mbit : options.linkRates ) {
+		std::unique_ptr<DiscardingReceiver> receiver;
+		try {
+			receiver.reset( new DiscardingReceiver( mbit * 1e6 / 8 ) );
+		}
+		catch( const std::exception& e ) {
+			std::cerr << e.what() << std::endl;
+			return false;
+		}
+		if( mbit > 0 )
+			std::cout << "Link " << mbit << " Mbit/s";
+		else
+			std::cout << "Loopback without a limit";
+		std::cout << std::endl << "mode      data MB/s  wire/data   CPU ms" << std::endl;
+		for( const auto &m : modes )
+			if( !runCompressionMode( options, *receiver, text, m.first, m.second ) )
+				return false;
+	}
+	return true;
+}
+
+/* An event of the JSON mode. Every 8th message contains characters, which must be escaped. */
+struct JsonEvent {
+	std::uint64_t ts;
+	unsigned seq;
+	const char *level;
+	double temperature;
+	std::string message;
+	bool ok;
+};
+
+static std::vector<JsonEvent> makeJsonEvents()
+{
+	static const char *LEVELS[] = { "debug", "info", "warn", "error" };
+	std::vector<JsonEvent> events( 1024 );
+	for( std::size_t i = 0; i < events.size(); i++ ) {
+		JsonEvent &e = events[i];
+		e.ts = 1700000000000000ULL + i * 1250;
+		e.seq = unsigned( i );
+		e.level = LEVELS[i % 4];
+		e.temperature = 40.0 + double( (i * 37) % 1000 ) / 64;
+		e.message = "Fan controller " + std::to_string( i % 16 ) + ": speed adjusted to " + std::to_string( 1200 + i % 900 )
+		            + " rpm after the temperature of the sensor changed";
+		if( i % 8 == 0 )
+			e.message += " (config \"C:\\fvs\\fan.cfg\",\n\tline " + std::to_string( i ) + ")";
+		e.ok = i % 3 != 0;
+	}
+	return events;
+}
+
+/* Writes s as a JSON string character by character by operator<< (the hand-rolled way JsonLineWriter is compared with) */
+static void streamJsonString( std::ostream &f, const std::string &s )
+{
+	f << '"';
+	for( char c : s )
+		switch( c ) {
+			case '"':  f << "\\\""; break;
+			case '\\': f << "\\\\"; break;
+			case '\n': f << "\\n"; break;
+			case '\r': f << "\\r"; break;
+			case '\t': f << "\\t"; break;
+			default:
+				if( (unsigned char)c < 0x20 )
+					f << "\\u00" << "0123456789abcdef"[(unsigned char)c >> 4] << "0123456789abcdef"[c & 0xF];
+				else
+					f << c;
+		}
+	f << '"';
+}
+
+/* Writes the events as JSON lines to a new session by JsonLineWriter or by operator<<; returns false on an error. */
+static bool runJsonWriter( const Options &options, const std::vector<JsonEvent> &events, bool writer )
+{
+	FileViaSocket f;
+	f.setCompression( options.compression );
+	try {
+		f.open( options.serverAddress, options.serverPort );
+	}
+	catch( const std::exception& e ) {
+		std::cerr << "Error on opening the socket: " << e.what() << std::endl;
+		return false;
+	}
+	f << std::setprecision( 17 ); // Round trip of the doubles, as by to_chars
+	JsonLineWriter json( f );
+
+	const double userMs = threadCpuMs( false );
+	const std::int64_t start = nowNs();
+	for( unsigned i = 0; i < options.iterations; i++ ) {
+		const JsonEvent &e = events[i % events.size()];
+		if( writer )
+			json.begin().field( "ts", e.ts ).field( "seq", e.seq ).field( "level", e.level )
+			    .field( "temp", e.temperature ).field( "msg", e.message ).field( "ok", e.ok ).end();
+		else {
+			f << "{\"ts\":" << e.ts << ",\"seq\":" << e.seq << ",\"level\":";
+			streamJsonString( f, e.level );
+			f << ",\"temp\":" << e.temperature << ",\"msg\":";
+			streamJsonString( f, e.message );
+			f << ",\"ok\":" << (e.ok ? "true" : "false") << "}\n";
+		}
+	}
+	f.flush();
+	const double ns = double( nowNs() - start );
+	const double userCpuMs = threadCpuMs( false ) - userMs;
+	const double bytes = double( f.stats().dataBytes );
+	f.close();
+	if( !f ) {
+		std::cerr << "Error on sending the events" << std::endl;
+		return false;
+	}
+
+	std::cout << std::left << std::setw( 16 ) << (writer ? "JsonLineWriter" : "operator<<") << std::right;
+	printPer( ns, options.iterations, 9, 1 );
+	printPer( bytes, options.iterations, 9, 1 );
+	printPer( userCpuMs, 1, 9, 0 );
+	printPer( bytes / 1e6, ns / 1e9, 9, 1 );
+	std::cout << std::endl;
+	return true;
+}
+
+/* The JSON mode: the same events by operator<< with escaping character by character, then by JsonLineWriter */
+static bool runJson( const Options &options, bool builtInReceiver )
+{
+	const std::vector<JsonEvent> events = makeJsonEvents();
+	std::cout << "JSON lines: " << options.iterations << " events of 6 fields to " << options.serverAddress << ":"
+	          << options.serverPort << (builtInReceiver ? " (built-in receiver)" : "") << std::endl
+	          << "                 ns/event  B/event  user ms     MB/s" << std::endl;
+	return runJsonWriter( options, events, false ) && runJsonWriter( options, events, true );
+}
+
+/* Noisy log of the filter mode: 90 % the same error line, 5 % debug lines (sampled by the filter) and 5 % unique lines,
+ * in a pseudo-random order. Returns the text; ends holds the end of each record. */
+static std::string makeNoisyLog( unsigned records, std::vector<std::size_t> &ends )
+{
+	std::string text;
+	ends.clear();
+	ends.reserve( records );
+	std::uint32_t seed = 12345;
+	char line[128];
+	for( unsigned i = 0; i < records; i++ ) {
+		seed = seed * 1103515245 + 12345;
+		const unsigned r = (seed >> 8) % 100;
+		int len;
+		if( r < 90 )
+			len = std::snprintf( line, sizeof(line), "ERROR i2c bus 1: NACK from device 0x48\n" );
+		else if( r < 95 )
+			len = std::snprintf( line, sizeof(line), "DEBUG adc ch %u raw %u\n", i % 8, (seed >> 12) % 4096 );
+		else
+			len = std::snprintf( line, sizeof(line), "INFO request %u done in %u us\n", i, (seed >> 16) % 1000 );
+		text.append( line, std::size_t( len ) );
+		ends.push_back( text.size() );
+	}
+	return text;
+}
+
+/* Writes the records one by one (as a logger does), without or with the record filter. */
+static bool runFilterWriter( const Options &options, const std::string &text, const std::vector<std::size_t> &ends,
+                             bool filter )
+{
+	FileViaSocket f;
+	if( filter ) {
+		f.recordFilter().setRepeatSuppression( true, 1000 );
+		f.recordFilter().addSampling( "DEBUG", 10 );
+	}
+	try {
+		f.open( options.serverAddress, options.serverPort );
+	}
+	catch( const std::exception& e ) {
+		std::cerr << "Error on opening the socket: " << e.what() << std::endl;
+		return false;
+	}
+
+	const double userMs = threadCpuMs( false );
+	const std::int64_t start = nowNs();
+	std::size_t begin = 0;
+	for( std::size_t end : ends ) {
+		f.write( text.data() + begin, std::streamsize( end - begin ) );
+		begin = end;
+	}
+	f.flush();
+	const double ns = double( nowNs() - start );
+	const double userCpuMs = threadCpuMs( false ) - userMs;
+	f.close(); // The remaining summaries of the filter are sent
+	if( !f ) {
+		std::cerr << "Error on sending the records" << std::endl;
+		return false;
+	}
+	const double records = double( ends.size() );
+
+	std::cout << std::left << std::setw( 16 ) << (filter ? "filter" : "no filter") << std::right;
+	printPer( ns, records, 9, 1 );
+	printPer( userCpuMs, 1, 9, 0 );
+	printPer( double( f.stats().dataBytes ), 1e6, 10, 2 );
+	printPer( double( f.stats().wireBytes ), 1e6, 10, 2 );
+	std::cout << std::endl;
+	return true;
+}
+
+/* The filter mode: the noisy log without and with the record filter */
+static bool runFilter( const Options &options, bool builtInReceiver )
+{
+	std::vector<std::size_t> ends;
+	const std::string text = makeNoisyLog( options.iterations, ends );
+	std::cout << "Record filter: " << options.iterations << " records (" << std::fixed << std::setprecision( 1 )
+	          << double( text.size() ) / 1e6 << " MB) to " << options.serverAddress << ":" << options.serverPort
+	          << (builtInReceiver ? " (built-in receiver)" : "") << std::endl
+	          << "                ns/record  user ms  data MB   wire MB" << std::endl;
+	return runFilterWriter( options, text, ends, false ) && runFilterWriter( options, text, ends, true );
+}
+
+/* Timestamps of the records in the timestamp mode */
+enum class RecordTimestamp { None, Prefix, Manipulator, PutTime };
+
+/* Writes the records (a short line with two integers, as a logger does) with the given timestamp.
+ * Returns the time per record in ns, or a negative value on an error. */
+static double runTimestampWriter( const Options &options, RecordTimestamp timestamp, const char *name, double baseNs )
+{
+	FileViaSocket f;
+	if( timestamp == RecordTimestamp::Prefix )
+		f.setTimestamps( SocketBufferBase::TimestampFormat::Hex, true );
+	else if( timestamp == RecordTimestamp::Manipulator )
+		f.setTimestamps( SocketBufferBase::TimestampFormat::Hex );
+	try {
+		f.open( options.serverAddress, options.serverPort );
+	}
+	catch( const std::exception& e ) {
+		std::cerr << "Error on opening the socket: " << e.what() << std::endl;
+		return -1;
+	}
+
+	const double userMs = threadCpuMs( false );
+	const std::int64_t start = nowNs();
+	for( unsigned i = 0; i < options.iterations; i++ ) {
+		if( timestamp == RecordTimestamp::Manipulator )
+			f << hwTimestamp;
+		else if( timestamp == RecordTimestamp::PutTime ) {
+			const auto now = std::chrono::system_clock::now();
+			const std::time_t t = std::chrono::system_clock::to_time_t( now );
+			std::tm tm;
+			localtime_r( &t, &tm );
+			const auto us = std::chrono::duration_cast<std::chrono::microseconds>( now.time_since_epoch() ).count() % 1000000;
+			f << std::put_time( &tm, "%Y-%m-%d %H:%M:%S" ) << '.' << std::setfill( '0' ) << std::setw( 6 ) << us
+			  << std::setfill( ' ' ) << ' ';
+		}
+		f << "sensor " << (i % 8) << " value " << i << '\n';
+	}
+	f.flush();
+	const double ns = double( nowNs() - start ) / double( options.iterations );
+	const double userCpuMs = threadCpuMs( false ) - userMs;
+	const double bytes = double( f.stats().dataBytes );
+	f.close();
+	if( !f ) {
+		std::cerr << "Error on sending the records" << std::endl;
+		return -1;
+	}
+
+	std::cout << std::left << std::setw( 14 ) << name << std::right;
+	printPer( ns, 1, 10, 1 );
+	if( timestamp == RecordTimestamp::None )
+		std::cout << std::setw( 10 ) << "-";
+	else
+		std::cout << std::setw( 10 ) << std::fixed << std::setprecision( 1 ) << ns - baseNs;
+	printPer( userCpuMs, 1, 9, 0 );
+	printPer( bytes, options.iterations, 9, 1 );
+	std::cout << std::endl;
+	return ns;
+}
+
+/* The timestamp mode: the same records without a timestamp and with each kind of it */
+static bool runTimestamps( const Options &options, bool builtInReceiver )
+{
+	std::cout << "Timestamps: " << options.iterations << " records to " << options.serverAddress << ":"
+	          << options.serverPort << (builtInReceiver ? " (built-in receiver)" : "") << std::endl
+	          << "               ns/record     added  user ms  B/record" << std::endl;
+	const double baseNs = runTimestampWriter( options, RecordTimestamp::None, "none", 0 );
+	return baseNs >= 0
+	    && runTimestampWriter( options, RecordTimestamp::Prefix, "auto-prefix", baseNs ) >= 0
+	    && runTimestampWriter( options, RecordTimestamp::Manipulator, "hwTimestamp", baseNs ) >= 0
+	    && runTimestampWriter( options, RecordTimestamp::PutTime, "put_time", baseNs ) >= 0;
+}
+
+static bool readFile( const std::string &name, std::string &content )
+{
+	std::ifstream in( name, std::ios::binary );
+	if( !in )
+		return false;
+	content.assign( std::istreambuf_iterator<char>( in ), std::istreambuf_iterator<char>() );
+	return true;
+}
+
+/* The dictionary mode: the records of the sample are grouped into flushes of at least the given size,
+ * each flush is compressed as one frame (as the stream does for a flushed buffer). */
+static bool runDictionary( const Options &options )
+{
+	std::string dictionary, samples;
+	if( !readFile( options.dictionaryFile, dictionary ) || !readFile( options.samplesFile, samples ) ) {
+		std::cerr << "Error: Unable to read the dictionary or the samples" << std::endl;
+		return false;
+	}
+	const std::size_t FRAME_RAW_OVERHEAD = 5, FRAME_LZ4_OVERHEAD = 9; // The frame headers (see FileViaSocket.cpp)
+	const int PASSES = 5;
+
+	std::cout << "Dictionary " << options.dictionaryFile << " (" << dictionary.size() << " bytes), samples "
+	          << options.samplesFile << " (" << samples.size() << " bytes)" << std::endl
+	          << "flush size  flushes   wire/data ratio     ns per flush" << std::endl
+	          << "                       fast      dict     fast      dict" << std::endl;
+	std::vector<char> out( BlockCompressor::maxCompressedSize( BlockCompressor::MAX_BLOCK_SIZE ) );
+	for( std::size_t size : options.messageSizes ) {
+		std::vector<std::pair<std::size_t, std::size_t>> flushes; // Offset and length in the samples
+		for( std::size_t pos = 0; pos < samples.size(); ) {
+			std::size_t end = pos;
+			while( end < samples.size() && end - pos < size ) { // Whole records till the size is reached
+				std::size_t eol = samples.find( '\n', end );
+				end = eol == std::string::npos ? samples.size() : eol + 1;
+			}
+			if( end - pos > BlockCompressor::MAX_BLOCK_SIZE )
+				end = pos + BlockCompressor::MAX_BLOCK_SIZE;
+			flushes.emplace_back( pos, end - pos );
+			pos = end;
+		}
+
+		double ratio[2], nsPerFlush[2];
+		for( int useDictionary = 0; useDictionary < 2; useDictionary++ ) {
+			BlockCompressor compressor;
+			compressor.setDictionary( dictionary.data(), dictionary.size() );
+			std::uint64_t data{0}, wire{0};
+			const std::int64_t start = nowNs();
+			for( int pass = 0; pass < PASSES; pass++ )
+				for( const auto &f : flushes ) {
+					const char *src = samples.data() + f.first;
+					std::size_t n = useDictionary ? compressor.compressWithDictionary( src, f.second, out.data(), out.size() )
+					                              : compressor.compress( BlockCompressor::Level::Fast, src, f.second,
+					                                                     out.data(), out.size() );
+					data += f.second;
+					wire += n > 0 ? FRAME_LZ4_OVERHEAD + n : FRAME_RAW_OVERHEAD + f.second;
+				}
+			nsPerFlush[useDictionary] = double( nowNs() - start ) / double( PASSES * flushes.size() );
+			ratio[useDictionary] = double( wire ) / double( data );
+		}
+		std::cout << std::fixed << std::setw( 10 ) << size << std::setw( 9 ) << flushes.size()
+		          << std::setprecision( 3 ) << std::setw( 11 ) << ratio[0] << std::setw( 10 ) << ratio[1]
+		          << std::setprecision( 0 ) << std::setw( 9 ) << nsPerFlush[0] << std::setw( 10 ) << nsPerFlush[1] << std::endl;
+	}
+	return true;
+}
+
+static void printUsage()
+{
+	std::cerr << "usage: BenchFileViaSocket [-s SERVER_IP] [-p PORT] [-n MB] [-z none|fast|strong|adaptive] [-o]" << std::endl
+	          << "                          [char|int|small|bulk|flush ...]" << std::endl
+	          << "       BenchFileViaSocket -l [-i ITERATIONS] [-m SIZE,SIZE,...]" << std::endl
+	          << "       BenchFileViaSocket -b [-s SERVER_IP] [-p PORT] [-n MB]" << std::endl
+	          << "       BenchFileViaSocket -d DICTIONARY SAMPLES [-m SIZE,SIZE,...]" << std::endl
+	          << "       BenchFileViaSocket -c [-n MB] [-r MBIT,MBIT,...]" << std::endl
+	          << "       BenchFileViaSocket -t -s SERVER_IP [-p PORT] [-n MB]" << std::endl
+	          << "       BenchFileViaSocket -k [-n MB] [-r MBIT]" << std::endl
+	          << "       BenchFileViaSocket -j [-s SERVER_IP] [-p PORT] [-z COMPRESSION] [-i EVENTS]" << std::endl
+	          << "       BenchFileViaSocket -f [-s SERVER_IP] [-p PORT] [-i RECORDS]" << std::endl
+	          << "       BenchFileViaSocket -w [-s SERVER_IP] [-p PORT] [-i RECORDS]" << std::endl
+	          << std::endl
+	          << "  -s SERVER_IP    server to send the data to; defaults to the built-in receiver, which discards the data" << std::endl
+	          << "  -p PORT         server port; defaults to 65432 when -s is given" << std::endl
+	          << "  -n MB           megabytes written by each scenario; defaults to 100 (flush writes 1/16 of it)" << std::endl
+	          << "  -z COMPRESSION  compression of the sessions; defaults to none" << std::endl
+	          << "  -o              run each scenario also with the out-of-line write path (marked by '*')" << std::endl
+	          << "  scenarios       the scenarios to run; defaults to all of them" << std::endl
+	          << "  -l              latency mode: time from write and flush of a message till its arrival" << std::endl
+	          << "                  at the built-in receiver (blocking and TCP_NODELAY sessions)" << std::endl
+	          << "  -i ITERATIONS   messages of each size in the latency mode, events in the JSON mode; defaults to 1000000;" << std::endl
+	          << "                  records in the filter and timestamp modes; defaults to 2000000" << std::endl
+	          << "  -m SIZES        comma-separated message sizes in bytes; defaults to 16,64,256,1024" << std::endl
+	          << "  -b              baseline mode: the same data by raw TCP in the iperf2 protocol and by FileViaSocket;" << std::endl
+	          << "                  with -s, the port defaults to 5001 (iperf -s)" << std::endl
+	          << "  -d              dictionary mode: compression of the records in the file SAMPLES, flushed in SIZES bytes" << std::endl
+	          << "                  (defaults to 128,256,512,1024), without and with the dictionary (a .dict file created" << std::endl
+	          << "                  by train_dictionary.py; use records, which it wasn't trained on)" << std::endl
+	          << "  -c              compression mode: log lines by each compression level to the built-in receiver," << std::endl
+	          << "                  which reads at the link rates given by -r (Mbit/s, 0 = no limit; defaults to 0,100,20);" << std::endl
+	          << "                  -n defaults to 20 MB" << std::endl
+	          << "  -t              autotune mode: the data without and with the send buffer autotuning to the server" << std::endl
+	          << "                  file_via_socket.py behind a link with a high RTT (see rtt_bench.sh)" << std::endl
+	          << "  -k              pool mode: 64 sessions spread by their keys over 1, 2, 4 and 8 built-in receivers, each taking" << std::endl
+	          << "                  the data at the rate given by -r (Mbit/s, defaults to 100), and the failover of open()" << std::endl
+	          << "                  when a receiver is down; -n defaults to 50 MB" << std::endl
+	          << "  -j              JSON mode: the same events as JSON lines by operator<< and by JsonLineWriter" << std::endl
+	          << "  -f              filter mode: a noisy log (90 % the same error line, 5 % debug lines, 5 % unique lines)" << std::endl
+	          << "                  without and with the record filter" << std::endl
+	          << "  -w              timestamp mode: records without a timestamp, with the hardware timestamp (prefixed" << std::endl
+	          << "                  automatically and by hwTimestamp) and with the wall-clock time by std::put_time" << std::endl;
+}
+
+int main( int argc, char* argv[] )
+{
+	Options options;
+	bool serverGiven{ false };
+	std::vector<const Scenario*> selected;
+	for( int i = 1; i < argc; i++ ) {
+		const std::string arg{ argv[i] };
+		if( arg == "-l" ) {
+			options.latency = true;
+			continue;
+		}
+		if( arg == "-b" ) {
+			options.baseline = true;
+			continue;
+		}
+		if( arg == "-c" ) {
+			options.compressionBench = true;
+			continue;
+		}
+		if( arg == "-k" ) {
+			options.poolBench = true;
+			continue;
+		}
+		if( arg == "-t" ) {
+			options.autotuneBench = true;
+			continue;
+		}
+		if( arg == "-j" ) {
+			options.json = true;
+			continue;
+		}
+		if( arg == "-f" ) {
+			options.filterBench = true;
+			continue;
+		}
+		if( arg == "-w" ) {
+			options.timestampBench = true;
+			continue;
+		}
+		if( arg == "-o" ) {
+			options.outOfLine = true;
+			continue;
+		}
+		if( arg == "-d" && i + 2 < argc ) {
+			options.dictionaryFile = argv[++i];
+			options.samplesFile = argv[++i];
+			continue;
+		}
+		if( arg.size() == 2 && arg[0] == '-' && i + 1 < argc ) {
+			const char *value = argv[++i];
+			switch( arg[1] ) {
+				case 's': options.serverAddress = value;
+				          serverGiven = true;
+				          continue;
+				case 'p': options.serverPort = static_cast<unsigned short>( std::atoi( value ) ); continue;
+				case 'n': options.bytes      = static_cast<std::uint64_t>( std::atof( value ) * 1e6 );
+				          options.bytesGiven = true;
+				          continue;
+				case 'r':
+					options.ratesGiven = true;
+					options.linkRates.clear();
+					for( const char *p = value; *p; ) {
+						char *end;
+						double rate = std::strtod( p, &end );
+						if( end == p || rate < 0 )
+							break;
+						options.linkRates.push_back( rate );
+						p = (*end == ',') ? end + 1 : end;
+					}
+					continue;
+				case 'i': options.iterations = static_cast<unsigned>( std::atoi( value ) );
+				          options.iterationsGiven = true;
+				          continue;
+				case 'm':
+					options.sizesGiven = true;
+					options.messageSizes.clear();
+					for( const char *p = value; *p; ) {
+						char *end;
+						unsigned long size = std::strtoul( p, &end, 10 );
+						if( end == p || size == 0 )
+							break;
+						options.messageSizes.push_back( size );
+						p = (*end == ',') ? end + 1 : end;
+					}
+					continue;
+				case 'z':
+					if( std::strcmp( value, "fast" ) == 0 )
+						options.compression = SocketBuffer::Compression::Fast;
+					else if( std::strcmp( value, "strong" ) == 0 )
+						options.compression = SocketBuffer::Compression::Strong;
+					else if( std::strcmp( value, "adaptive" ) == 0 )
+						options.compression = SocketBuffer::Compression::Adaptive;
+					continue;
+				default:
+					printUsage();
+					return 1;
+			}
+		}
+		const Scenario *scenario = nullptr;
+		for( const Scenario &s : Scenarios )
+			if( arg == s.name )
+				scenario = &s;
+		if( scenario == nullptr ) {
+			printUsage();
+			return 1;
+		}
+		selected.push_back( scenario );
+	}
+	if( !options.dictionaryFile.empty() ) {
+		if( !options.sizesGiven )
+			options.messageSizes = { 128, 256, 512, 1024 };
+		return runDictionary( options ) ? 0 : 1;
+	}
+	if( options.compressionBench ) {
+		if( !options.bytesGiven )
+			options.bytes = 20*1000*1000;
+		return runCompression( options ) ? 0 : 1;
+	}
+	if( options.poolBench ) {
+		if( !options.bytesGiven )
+			options.bytes = 50*1000*1000;
+		if( !options.ratesGiven )
+			options.linkRates = { 100 };
+		return runPool( options ) ? 0 : 1;
+	}
+	if( options.autotuneBench ) {
+		if( !serverGiven ) {
+			std::cerr << "Error: The autotune mode needs a server behind a link with a high RTT (-s)" << std::endl;
+			return 1;
+		}
+		if( options.serverPort == 0 )
+			options.serverPort = 65432;
+		return runAutotune( options ) ? 0 : 1;
+	}
+	if( selected.empty() )
+		for( const Scenario &s : Scenarios )
+			selected.push_back( &s );
+	if( serverGiven && options.serverPort == 0 )
+		options.serverPort = options.baseline ? 5001   // The default port of iperf2
+		                                      : 65432; // The server script file_via_socket.py uses port 65432 by default.
+
+	std::unique_ptr<DiscardingReceiver> receiver;
+	if( options.serverPort == 0 ) {
+		try {
+			receiver.reset( new DiscardingReceiver );
+		}
+		catch( const std::exception& e ) {
+			std::cerr << e.what() << std::endl;
+			return 1;
+		}
+		options.serverPort = receiver->port();
+	}
+
+	if( options.latency ) {
+		if( !receiver ) {
+			std::cerr << "Error: The latency mode needs the built-in receiver (no -s)" << std::endl;
+			return 1;
+		}
+		std::cout << "Latency from write() till arrival (us), " << options.iterations << " messages of each size" << std::endl
+		          << "mode       size      p50      p90      p99    p99.9   p99.99       max  flush50  flush99" << std::endl;
+		for( bool noDelay : { false, true } )
+			for( std::size_t size : options.messageSizes )
+				if( !runLatency( options, *receiver, size, noDelay ) )
+					return 1;
+		return 0;
+	}
+
+	if( options.json )
+		return runJson( options, bool( receiver ) ) ? 0 : 1;
+
+	if( options.filterBench || options.timestampBench ) {
+		if( !options.iterationsGiven )
+			options.iterations = 2000000;
+		if( options.filterBench )
+			return runFilter( options, bool( receiver ) ) ? 0 : 1;
+		return runTimestamps( options, bool( receiver ) ) ? 0 : 1;
+	}
+
+	if( options.baseline ) {
+		if( options.compression != SocketBuffer::Compression::None ) {
+			std::cerr << "Error: The baseline mode sends uncompressed data (iperf servers don't understand the framing)" << std::endl;
+			return 1;
+		}
+		return runBaseline( options, bool( receiver ) ) ? 0 : 1;
+	}
+
+	PerfCounters probe;
+	if( !probe.available( PerfCounters::CYCLES_USER ) )
+		std::cerr << "Warning: hardware counters are not available (running in a VM?); only the CPU time is reported" << std::endl;
+	else if( !probe.available( PerfCounters::CYCLES_KERNEL ) )
+		std::cerr << "Warning: kernel counters are not available; set /proc/sys/kernel/perf_event_paranoid to 1 or less" << std::endl;
+
+	std::cout << "Sending to " << options.serverAddress << ":" << options.serverPort
+	          << (receiver ? " (built-in receiver)" : "") << std::endl
+	          << "        cycles/byte     instr/record  misses/  ctx     CPU ms      send()    MB/s" << std::endl
+	          << "         user   kernel    user   kernel     KB  switch    user  kernel   calls" << std::endl;
+	for( const Scenario *scenario : selected ) {
+		if( !runScenario<FileViaSocket>( options, *scenario, "" ) )
+			return 1;
+		if( options.outOfLine && !runScenario<OutOfLineFileViaSocket>( options, *scenario, "*" ) )
+			return 1;
+	}
+	if( options.outOfLine )
+		std::cout << "* out-of-line writes (each write calls SocketBufferBase)" << std::endl;
+
+	return 0;
+} // main
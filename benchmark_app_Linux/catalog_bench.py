@@ -0,0 +1,169 @@
+#!/usr/bin/env python3
+# This script measures the queries of catalog_query.py on a large catalog of sessions. It fills a catalog with the
+# schema of file_via_socket.py (parameter --catalog) with SESSIONS closed sessions of random clients, spread over
+# DAYS days, and a few open sessions, and reports the median and the longest time of the queries of catalog_query.py
+# (the time catalog_query.py prints, i.e., opening the catalog included).
+# For details see the GitHub repository https://github.com/viktor-nikolov/lwIP-file-via-socket
+#
+# Run the script with the command 'python3 catalog_bench.py [params]'. The catalog is kept, and the next run
+# measures it without filling it again, when it holds the same number of sessions.
+#
+# usage: catalog_bench [-h] [--catalog CATALOG] [--sessions SESSIONS] [--days DAYS] [--peers PEERS]
+#                      [--max_duration MAX_DURATION] [--queries QUERIES]
+#
+# options:
+#   -h, --help              Show help message and exit
+#   --catalog CATALOG       Catalog file; defaults to /tmp/catalog_bench.db
+#   --sessions SESSIONS     Number of sessions; defaults to 1000000
+#   --days DAYS             The sessions start within this number of days; defaults to 365
+#   --peers PEERS           Number of clients (IP addresses); defaults to 100
+#   --max_duration MAX_DURATION
+#                           Longest session in seconds (a query by time reads the sessions started up to
+#                           MAX_DURATION before the interval); defaults to 3600
+#   --queries QUERIES       Queries of each kind; defaults to 50
+#
+# BSD 2-Clause License:
+#
+# Copyright (c) 2024 Viktor Nikolov
+#
+# Redistribution and use in source and binary forms, with or without
+# modification, are permitted provided that the following conditions are met:
+# 1. Redistributions of source code must retain the above copyright notice, this
+#    list of conditions and the following disclaimer.
+# 2. Redistributions in binary form must reproduce the above copyright notice,
+#    this list of conditions and the following disclaimer in the documentation
+#    and/or other materials provided with the distribution.
+# THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+# AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+# IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+# DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+# FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+# DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+# SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+# CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+# OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+# OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+import argparse
+import ast
+import os
+import random
+import sqlite3
+import statistics
+import sys
+import time
+
+ROOT = os.path.join(os.path.dirname(os.path.abspath(__file__)), "..")
+sys.path.insert(0, ROOT)
+from catalog_query import find_sessions  # noqa: E402
+
+START = 1704067200.0  # 2024-01-01 00:00:00 UTC
+OPEN_SESSIONS = 10
+BATCH = 100000
+
+
+def catalog_schema():
+    # SessionCatalog.SCHEMA of file_via_socket.py (the script can't be imported, it starts the server)
+    with open(os.path.join(ROOT, "file_via_socket.py")) as f:
+        tree = ast.parse(f.read())
+    for node in ast.walk(tree):
+        if isinstance(node, ast.ClassDef) and node.name == "SessionCatalog":
+            for item in node.body:
+                if isinstance(item, ast.Assign) and item.targets[0].id == "SCHEMA":
+                    return ast.literal_eval(item.value)
+    raise RuntimeError("SessionCatalog.SCHEMA not found in file_via_socket.py")
+
+
+def fill(args):
+    # Closed sessions in the order of their start (as the script inserts them), then the open sessions at the end
+    db = sqlite3.connect(args.catalog)
+    db.execute("PRAGMA journal_mode=WAL")
+    db.executescript(catalog_schema())
+    rng = random.Random(1)
+    span = args.days * 86400.0
+    step = span / args.sessions
+    t0 = time.perf_counter()
+    for first in range(0, args.sessions, BATCH):
+        rows = []
+        for i in range(first, min(first + BATCH, args.sessions)):
+            start = START + i * step + rng.uniform(0, step)
+            duration = rng.uniform(1, args.max_duration)
+            peer = rng.randrange(args.peers)
+            rows.append((f"/home/user/test_data/via_socket_{i:07d}.txt", f"192.168.{peer // 250}.{peer % 250 + 1}",
+                         rng.randrange(49152, 65536), start, start + duration, rng.randrange(1 << 24),
+                         rng.randrange(1 << 24), f"{rng.getrandbits(256):064x}"))
+        with db:
+            db.executemany("INSERT INTO sessions (file, peer_ip, peer_port, start_time, end_time, bytes, wire_bytes, "
+                           "sha256) VALUES (?, ?, ?, ?, ?, ?, ?, ?)", rows)
+    with db:
+        db.executemany("INSERT INTO sessions (file, peer_ip, peer_port, start_time) VALUES (?, ?, ?, ?)",
+                       [(f"/home/user/test_data/via_socket_open_{i}.txt", f"192.168.0.{i + 1}", 50000 + i,
+                         START + span - i * 60) for i in range(OPEN_SESSIONS)])
+        db.execute("UPDATE meta SET value = ? WHERE key = 'max_duration'", (args.max_duration,))
+    db.close()
+    print(f"Filled in {time.perf_counter() - t0:.1f} s")
+
+
+def measure(name, args, query):
+    # query(rng) returns the arguments of find_sessions(); prints the times as catalog_query.py measures them
+    rng = random.Random(2)
+    times = []
+    found = []
+    for _ in range(args.queries):
+        params = query(rng)
+        t0 = time.perf_counter()
+        db = sqlite3.connect(f"file:{args.catalog}?mode=ro", uri=True)
+        rows = find_sessions(db, *params)
+        times.append((time.perf_counter() - t0) * 1000)
+        db.close()
+        found.append(len(rows))
+    print(f"{name:<34} {statistics.median(found):>8.0f} {statistics.median(times):>10.2f} {max(times):>9.2f}")
+
+
+def main():
+    parser = argparse.ArgumentParser(prog="catalog_bench", description='Queries of catalog_query.py on a large catalog')
+    parser.add_argument('--catalog', type=str, default="/tmp/catalog_bench.db",
+                        help='catalog file; defaults to /tmp/catalog_bench.db')
+    parser.add_argument('--sessions', type=int, default=1000000, help='number of sessions; defaults to 1000000')
+    parser.add_argument('--days', type=float, default=365,
+                        help='the sessions start within this number of days; defaults to 365')
+    parser.add_argument('--peers', type=int, default=100, help='number of clients (IP addresses); defaults to 100')
+    parser.add_argument('--max_duration', type=float, default=3600,
+                        help='longest session in seconds; defaults to 3600')
+    parser.add_argument('--queries', type=int, default=50, help='queries of each kind; defaults to 50')
+    args = parser.parse_args()
+
+    expected = args.sessions + OPEN_SESSIONS
+    try:
+        db = sqlite3.connect(f"file:{args.catalog}?mode=ro", uri=True)
+        count = db.execute("SELECT COUNT(*) FROM sessions").fetchone()[0]
+        db.close()
+    except sqlite3.Error:
+        count = None
+    if count != expected:
+        if os.path.exists(args.catalog):
+            os.remove(args.catalog)
+        fill(args)
+
+    span = args.days * 86400.0
+
+    def peer(rng):
+        return f"192.168.0.{rng.randrange(min(args.peers, 250)) + 1}"
+
+    def interval(length, by_peer):
+        # Queries of sessions running in a random interval of the given length, of a random client if by_peer
+        def query(rng):
+            t = START + rng.uniform(0, span - length)
+            return peer(rng) if by_peer else None, t, t + length, 1000
+        return query
+
+    print(f"{expected} sessions over {args.days:g} days, {args.peers} clients, sessions up to {args.max_duration:g} s\n"
+          f"query                              sessions  median ms    max ms")
+    measure("5 minutes (--from --to)", args, interval(300, False))
+    measure("an hour of a client (--peer)", args, interval(3600, True))
+    measure("a day of a client (--peer)", args, interval(86400, True))
+    measure("a day, first 1000 (--limit)", args, interval(86400, False))
+    measure("the last hour (--from)", args, lambda rng: (None, START + span - 3600, None, 1000))
+
+if __name__ == '__main__':
+    main()
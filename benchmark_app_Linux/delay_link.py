@@ -0,0 +1,155 @@
+#!/usr/bin/env python3
+# This script emulates a long-haul link in user space, for kernels without the netem qdisc (see rtt_bench.sh).
+# It connects the host to a network namespace by two TUN interfaces and forwards the IP packets between them.
+# Each packet is delayed by half of the round trip time in each direction, and the link rate is enforced
+# by the serialization time of the packets (a FIFO queue of a limited length with tail drop),
+# as 'tc qdisc ... netem delay ... rate ... limit ...' does.
+# For details see the GitHub repository https://github.com/viktor-nikolov/lwIP-file-via-socket
+#
+# Run the script as root with the command 'python3 delay_link.py [params]'. The namespace must exist
+# (ip netns add NETNS). The host side of the link is 10.200.0.1, the namespace side 10.200.0.2.
+# The script runs until it's terminated.
+#
+# usage: delay_link [-h] --netns NETNS --rtt_ms RTT_MS [--rate_mbit RATE_MBIT] [--limit LIMIT]
+#                   [--near_ip NEAR_IP] [--far_ip FAR_IP]
+#
+# options:
+#   -h, --help              Show help message and exit
+#   --netns NETNS           Network namespace of the far side
+#   --rtt_ms RTT_MS         Round trip time added by the link
+#   --rate_mbit RATE_MBIT   Link rate in Mbit/s; defaults to 0 (no limit)
+#   --limit LIMIT           Queue length in packets (as netem limit); defaults to 1000
+#   --near_ip NEAR_IP       Address of the host side; defaults to 10.200.0.1
+#   --far_ip FAR_IP         Address of the namespace side; defaults to 10.200.0.2
+#
+# BSD 2-Clause License:
+#
+# Copyright (c) 2024 Viktor Nikolov
+#
+# Redistribution and use in source and binary forms, with or without
+# modification, are permitted provided that the following conditions are met:
+# 1. Redistributions of source code must retain the above copyright notice, this
+#    list of conditions and the following disclaimer.
+# 2. Redistributions in binary form must reproduce the above copyright notice,
+#    this list of conditions and the following disclaimer in the documentation
+#    and/or other materials provided with the distribution.
+# THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+# AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+# IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+# DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+# FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+# DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+# SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+# CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+# OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+# OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+import argparse
+import collections
+import fcntl
+import os
+import select
+import signal
+import struct
+import subprocess
+import sys
+import time
+
+TUNSETIFF = 0x400454CA
+IFF_TUN = 0x0001
+IFF_NO_PI = 0x1000
+MAX_PACKET = 65536
+
+
+def open_tun(name):
+    fd = os.open('/dev/net/tun', os.O_RDWR | os.O_NONBLOCK)
+    fcntl.ioctl(fd, TUNSETIFF, struct.pack('16sH', name.encode(), IFF_TUN | IFF_NO_PI))
+    return fd
+
+
+def ip(*args, netns=None):
+    cmd = (['ip', 'netns', 'exec', netns] if netns else []) + ['ip'] + list(args)
+    subprocess.run(cmd, check=True)
+
+
+class Direction:
+    """One direction of the link: the packets wait in the FIFO till their delivery time."""
+    def __init__(self, src, dst, one_way_s, bytes_per_s, limit):
+        self.src, self.dst = src, dst
+        self.one_way_s = one_way_s
+        self.bytes_per_s = bytes_per_s
+        self.limit = limit
+        self.queue = collections.deque()  # (delivery time, packet)
+        self.last_departure = 0.0         # When the last queued packet leaves the serializer
+        self.drops = 0
+
+    def receive(self, now):
+        while True:
+            try:
+                packet = os.read(self.src, MAX_PACKET)
+            except BlockingIOError:
+                return
+            if self.bytes_per_s > 0:
+                # The packets waiting for the serializer form the queue, which the limit applies to
+                backlog = (self.last_departure - now) * self.bytes_per_s / 1500
+                if backlog >= self.limit:
+                    self.drops += 1
+                    continue
+                self.last_departure = max(now, self.last_departure) + len(packet) / self.bytes_per_s
+                due = self.last_departure + self.one_way_s
+            else:
+                due = now + self.one_way_s
+            self.queue.append((due, packet))
+
+    def deliver(self, now):
+        while self.queue and self.queue[0][0] <= now:
+            try:
+                os.write(self.dst, self.queue.popleft()[1])
+            except OSError:  # The interface's queue is full; the packet is lost as on a real link
+                self.drops += 1
+
+    def next_due(self):
+        return self.queue[0][0] if self.queue else None
+
+
+def main():
+    parser = argparse.ArgumentParser(description='User-space emulation of a link with delay and rate limit')
+    parser.add_argument('--netns', required=True, help='network namespace of the far side')
+    parser.add_argument('--rtt_ms', type=float, required=True, help='round trip time added by the link')
+    parser.add_argument('--rate_mbit', type=float, default=0, help='link rate in Mbit/s; 0 means no limit')
+    parser.add_argument('--limit', type=int, default=1000, help='queue length in packets (as netem limit)')
+    parser.add_argument('--near_ip', default='10.200.0.1')
+    parser.add_argument('--far_ip', default='10.200.0.2')
+    args = parser.parse_args()
+
+    near = open_tun('fvsnear')
+    far = open_tun('fvsfar')
+    ip('link', 'set', 'fvsfar', 'netns', args.netns)
+    ip('addr', 'add', args.near_ip + '/30', 'dev', 'fvsnear')
+    ip('link', 'set', 'fvsnear', 'up')
+    ip('addr', 'add', args.far_ip + '/30', 'dev', 'fvsfar', netns=args.netns)
+    ip('link', 'set', 'fvsfar', 'up', netns=args.netns)
+    ip('link', 'set', 'lo', 'up', netns=args.netns)
+
+    one_way = args.rtt_ms / 2000
+    rate = args.rate_mbit * 1e6 / 8
+    directions = [Direction(near, far, one_way, rate, args.limit), Direction(far, near, one_way, rate, args.limit)]
+    signal.signal(signal.SIGTERM, lambda *_: sys.exit(0))
+    print(f'Link {args.near_ip} <-> {args.far_ip} (netns {args.netns}): RTT {args.rtt_ms} ms, '
+          f'rate {args.rate_mbit or "unlimited"} Mbit/s', flush=True)
+    try:
+        while True:
+            dues = [d.next_due() for d in directions if d.next_due() is not None]
+            timeout = max(0.0, min(dues) - time.monotonic()) if dues else 1.0
+            readable, _, _ = select.select([near, far], [], [], timeout)
+            now = time.monotonic()
+            for d in directions:
+                if d.src in readable:
+                    d.receive(now)
+                d.deliver(now)
+    finally:
+        print(f'Dropped packets: {directions[0].drops} near->far, {directions[1].drops} far->near', flush=True)
+
+
+if __name__ == '__main__':
+    main()
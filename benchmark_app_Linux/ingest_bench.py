@@ -0,0 +1,189 @@
+#!/usr/bin/env python3
+# This script measures the sustained ingest of the server script file_via_socket.py with buffered writes and with
+# --direct_io. For each mode, it starts the script, sends the data by concurrent clients (each one a process sending
+# blocks of 64 KB by sendall()), and reports the throughput and the stalls of the clients: the longest sendall()
+# and the number of sendall() calls, which took longer than 100 ms (the server didn't read, e.g., because of the page
+# cache writeback). The throughput is given till the clients finished and till the data were on the disk (sync).
+# With --merge, it measures the merge of concurrent sessions (--merge of the script) instead: each session sends
+# timestamped lines, which interleave with the lines of the other sessions, and the script reports the merged lines
+# per second (till the merged file contained all lines).
+# For details see the GitHub repository https://github.com/viktor-nikolov/lwIP-file-via-socket
+#
+# Run the script with the command 'python3 ingest_bench.py [params]' (Linux). Write more data than the RAM,
+# so the page cache fills up; the files are deleted after each mode.
+#
+# usage: ingest_bench [-h] --path PATH [--gb GB] [--sessions SESSIONS] [--direct_io_threads DIRECT_IO_THREADS]
+#                     [--merge] [--lines LINES]
+#
+# options:
+#   -h, --help              Show help message and exit
+#   --path PATH             Directory for the files (on the disk to be measured; it must support O_DIRECT)
+#   --gb GB                 Gigabytes sent in each mode by all sessions together; defaults to 8
+#   --sessions SESSIONS     Number of concurrent sessions; defaults to 4 (40 with --merge)
+#   --direct_io_threads DIRECT_IO_THREADS
+#                           Number of writer threads for --direct_io; defaults to 4
+#   --merge                 Measure the merge of the sessions instead of the ingest
+#   --lines LINES           Lines sent by each session with --merge; defaults to 25000
+#
+# BSD 2-Clause License:
+#
+# Copyright (c) 2024 Viktor Nikolov
+#
+# Redistribution and use in source and binary forms, with or without
+# modification, are permitted provided that the following conditions are met:
+# 1. Redistributions of source code must retain the above copyright notice, this
+#    list of conditions and the following disclaimer.
+# 2. Redistributions in binary form must reproduce the above copyright notice,
+#    this list of conditions and the following disclaimer in the documentation
+#    and/or other materials provided with the distribution.
+# THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+# AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+# IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+# DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+# FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+# DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+# SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+# CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+# OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+# OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+import argparse
+import multiprocessing
+import os
+import socket
+import subprocess
+import sys
+import time
+
+SCRIPT = os.path.join(os.path.dirname(os.path.abspath(__file__)), "..", "file_via_socket.py")
+BLOCK_SIZE = 64 * 1024
+STALL_S = 0.1
+
+
+def client(port, total, results):
+    # Sends the data and puts (the longest sendall() in seconds, number of stalls) to the results
+    block = os.urandom(BLOCK_SIZE)
+    longest, stalls = 0.0, 0
+    with socket.create_connection(("127.0.0.1", port)) as conn:
+        for _ in range(total // BLOCK_SIZE):
+            start = time.monotonic()
+            conn.sendall(block)
+            took = time.monotonic() - start
+            longest = max(longest, took)
+            stalls += took > STALL_S
+    results.put((longest, stalls))
+
+
+def merge_lines(session, lines):
+    # Timestamped lines of a session; the timestamps of the sessions interleave (1 ms apart within a session)
+    base = 1711311504.0
+    return "".join(f"{base + i * 0.001 + session * 0.00001:.6f} session {session:02d} line {i} "
+                   f"temperature {20 + (i + session) % 30} C\n" for i in range(lines)).encode()
+
+
+def merge_client(port, data):
+    with socket.create_connection(("127.0.0.1", port)) as conn:
+        for pos in range(0, len(data), BLOCK_SIZE):
+            conn.sendall(data[pos:pos + BLOCK_SIZE])
+
+
+def run_merge(args):
+    # The sessions send their lines concurrently; the rate is given till the merged file contains all of them
+    path = os.path.join(args.path, "ingest_bench")
+    os.makedirs(path, exist_ok=True)
+    merged = os.path.join(args.path, "ingest_bench_merged.txt")
+    with socket.socket() as s:
+        s.bind(("127.0.0.1", 0))
+        port = s.getsockname()[1]
+    server = subprocess.Popen([sys.executable, SCRIPT, "--path", path, "--bind_ip", "127.0.0.1",
+                               "--bind_port", str(port), "--merge", merged],
+                              stdout=subprocess.DEVNULL, stderr=subprocess.STDOUT)
+    time.sleep(1)
+    data = [merge_lines(session, args.lines) for session in range(args.sessions)]
+    total = sum(len(d) for d in data)
+    clients = [multiprocessing.Process(target=merge_client, args=(port, d)) for d in data]
+    start = time.monotonic()
+    for c in clients:
+        c.start()
+    for c in clients:
+        c.join()
+    sent = time.monotonic() - start
+    while not os.path.exists(merged) or os.path.getsize(merged) < total:  # The merge lags behind the clients
+        time.sleep(0.01)
+    merged_time = time.monotonic() - start
+    server.terminate()
+    server.wait()
+    lines = args.lines * args.sessions
+    print(f"{args.sessions} sessions, {lines} lines ({total / 1e6:.1f} MB): sent in {sent:.2f} s, merged in "
+          f"{merged_time:.2f} s, {lines / merged_time / 1000:.0f} k lines/s", flush=True)
+    for f in os.listdir(path):
+        os.remove(os.path.join(path, f))
+    os.rmdir(path)
+    os.remove(merged)
+
+
+def run_mode(name, options, args):
+    path = os.path.join(args.path, "ingest_bench")
+    os.makedirs(path, exist_ok=True)
+    with socket.socket() as s:
+        s.bind(("127.0.0.1", 0))
+        port = s.getsockname()[1]
+    server = subprocess.Popen([sys.executable, SCRIPT, "--path", path, "--bind_ip", "127.0.0.1",
+                               "--bind_port", str(port)] + options,
+                              stdout=subprocess.DEVNULL, stderr=subprocess.STDOUT)
+    time.sleep(1)
+    per_session = int(args.gb * 1e9 / args.sessions) // BLOCK_SIZE * BLOCK_SIZE
+    results = multiprocessing.Queue()
+    clients = [multiprocessing.Process(target=client, args=(port, per_session, results)) for _ in range(args.sessions)]
+    start = time.monotonic()
+    for c in clients:
+        c.start()
+    stats = [results.get() for _ in clients]
+    for c in clients:
+        c.join()
+    sent = time.monotonic() - start
+    total = per_session * args.sessions
+    while sum(os.path.getsize(os.path.join(path, f)) for f in os.listdir(path)) < total:  # The server may lag
+        time.sleep(0.1)
+    time.sleep(1)  # The files are closed
+    os.sync()
+    synced = time.monotonic() - start
+    server.terminate()
+    server.wait()
+    for f in os.listdir(path):
+        os.remove(os.path.join(path, f))
+    os.rmdir(path)
+    print(f"{name:10} {total / 1e6 / sent:9.0f} {total / 1e6 / synced:9.0f} {max(s[0] for s in stats) * 1000:11.0f}"
+          f" {sum(s[1] for s in stats):9d}", flush=True)
+
+
+def main():
+    parser = argparse.ArgumentParser(prog="ingest_bench",
+                                     description='Sustained ingest of file_via_socket.py, buffered and with --direct_io, '
+                                                 'or the merge of concurrent sessions')
+    parser.add_argument('--path', type=str, required=True, help='directory for the files (on the disk to be measured)')
+    parser.add_argument('--gb', type=float, default=8, help='gigabytes sent in each mode; defaults to 8')
+    parser.add_argument('--sessions', type=int, help='number of concurrent sessions; defaults to 4 (40 with --merge)')
+    parser.add_argument('--direct_io_threads', type=int, default=4,
+                        help='number of writer threads for --direct_io; defaults to 4')
+    parser.add_argument('--merge', action='store_true', help='measure the merge of the sessions instead of the ingest')
+    parser.add_argument('--lines', type=int, default=25000,
+                        help='lines sent by each session with --merge; defaults to 25000')
+    args = parser.parse_args()
+    if args.merge:
+        args.sessions = args.sessions or 40
+        run_merge(args)
+        return
+    args.sessions = args.sessions or 4
+
+    print(f"{args.gb} GB by {args.sessions} sessions in blocks of {BLOCK_SIZE // 1024} KB to {args.path}\n"
+          f"               MB/s      MB/s     longest    stalls\n"
+          f"mode           sent    synced  sendall ms  > {STALL_S * 1000:.0f} ms", flush=True)
+    os.sync()
+    run_mode("buffered", [], args)
+    os.sync()
+    run_mode("direct_io", ["--direct_io", "--direct_io_threads", str(args.direct_io_threads)], args)
+
+
+if __name__ == '__main__':
+    main()
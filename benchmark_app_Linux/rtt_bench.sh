@@ -0,0 +1,78 @@
+#!/bin/bash
+# Measures the send buffer autotuning (BenchFileViaSocket -t) over links with round trip times of 1 to 200 ms.
+# The server file_via_socket.py runs in the network namespace fvs_rtt behind an emulated link: netem on a veth pair
+# when the kernel has the netem qdisc, the user-space emulator delay_link.py otherwise.
+# Details are explained on GitHub: https://github.com/viktor-nikolov/lwIP-file-via-socket
+#
+# usage: sudo ./rtt_bench.sh BENCH [RATE_MBIT [MB [RTT_MS ...]]]
+#   BENCH      the built BenchFileViaSocket
+#   RATE_MBIT  rate of the link; defaults to 100
+#   MB         megabytes sent in each session; defaults to 50
+#   RTT_MS     round trip times of the link; default to 1 10 50 100 200
+#
+# The socket buffers are capped by net.core.wmem_max and net.core.rmem_max (the send buffer set by the autotuner)
+# and by net.ipv4.tcp_wmem and net.ipv4.tcp_rmem (the kernel's own autotuning); raise them for big BDPs.
+#
+# BSD 2-Clause License, Copyright (c) 2024 Viktor Nikolov (see the file LICENSE)
+
+set -e
+BENCH=$(realpath "${1:?usage: $0 BENCH [RATE_MBIT [MB [RTT_MS ...]]]}")
+RATE=${2:-100}
+MB=${3:-50}
+shift $(( $# < 3 ? $# : 3 ))
+RTTS=${*:-1 10 50 100 200}
+
+NETNS=fvs_rtt
+NEAR_IP=10.200.0.1
+FAR_IP=10.200.0.2
+DIR=$(cd "$(dirname "$0")" && pwd)
+OUT=$(mktemp -d)
+LINK_PID=
+SERVER_PID=
+
+stop_link() {
+	[ -n "$SERVER_PID" ] && kill $SERVER_PID 2>/dev/null && wait $SERVER_PID 2>/dev/null || true
+	[ -n "$LINK_PID" ] && kill $LINK_PID 2>/dev/null && wait $LINK_PID 2>/dev/null || true
+	SERVER_PID= LINK_PID=
+	ip link del fvsnear 2>/dev/null || true
+}
+trap 'stop_link; ip netns del $NETNS 2>/dev/null; rm -rf "$OUT"' EXIT
+
+ip netns add $NETNS
+ip netns exec $NETNS ip link set lo up
+
+# Is netem available? (Its module may be missing, e.g., in containers and minimal kernels.)
+NETEM=0
+ip link add fvsnear type veth peer name fvsfar
+tc qdisc add dev fvsnear root netem delay 1ms 2>/dev/null && NETEM=1
+ip link del fvsnear
+
+for RTT in $RTTS; do
+	if [ $NETEM = 1 ]; then
+		# Half of the RTT in each direction, both directions limited to the rate
+		ip link add fvsnear type veth peer name fvsfar
+		ip link set fvsfar netns $NETNS
+		ip addr add $NEAR_IP/30 dev fvsnear
+		ip link set fvsnear up
+		ip netns exec $NETNS ip addr add $FAR_IP/30 dev fvsfar
+		ip netns exec $NETNS ip link set fvsfar up
+		HALF=$(awk "BEGIN { print $RTT / 2 }")
+		tc qdisc add dev fvsnear root netem delay ${HALF}ms rate ${RATE}mbit limit 10000
+		ip netns exec $NETNS tc qdisc add dev fvsfar root netem delay ${HALF}ms rate ${RATE}mbit limit 10000
+		LINK="netem"
+	else
+		python3 "$DIR/delay_link.py" --netns $NETNS --rtt_ms $RTT --rate_mbit $RATE --limit 10000 > "$OUT/link.log" &
+		LINK_PID=$!
+		while ! ip link show fvsnear > /dev/null 2>&1; do sleep 0.1; done
+		sleep 0.5
+		LINK="delay_link.py"
+	fi
+	ip netns exec $NETNS python3 "$DIR/../file_via_socket.py" --path "$OUT" --bind_ip $FAR_IP > /dev/null &
+	SERVER_PID=$!
+	sleep 1
+
+	echo "=== RTT $RTT ms, $RATE Mbit/s ($LINK)"
+	"$BENCH" -t -s $FAR_IP -n $MB
+	stop_link
+	rm -f "$OUT"/*.txt
+done
@@ -0,0 +1,141 @@
+# This script queries the catalog of sessions written by file_via_socket.py (parameter --catalog).
+# For details see the GitHub repository https://github.com/viktor-nikolov/lwIP-file-via-socket
+#
+# Run the script with the command 'python3 catalog_query.py [params] catalog'.
+#
+# usage: catalog_query [-h] [--peer PEER] [--from FROM] [--to TO] [--seek SEEK] [--limit LIMIT] catalog
+#
+# options:
+#   -h, --help              Show help message and exit
+#   --peer PEER             IP address of the client
+#   --from FROM             Sessions running at or after this time ("YYYY-MM-DD HH:MM[:SS]", "HH:MM[:SS]" today,
+#                           or Unix time)
+#   --to TO                 Sessions running at or before this time
+#   --seek SEEK             Print the offset in each file of the data received at this time (needs --catalog_index)
+#   --limit LIMIT           Max. number of sessions printed; defaults to 1000
+#
+# BSD 2-Clause License:
+#
+# Copyright (c) 2024 Viktor Nikolov
+#
+# Redistribution and use in source and binary forms, with or without
+# modification, are permitted provided that the following conditions are met:
+# 1. Redistributions of source code must retain the above copyright notice, this
+#    list of conditions and the following disclaimer.
+# 2. Redistributions in binary form must reproduce the above copyright notice,
+#    this list of conditions and the following disclaimer in the documentation
+#    and/or other materials provided with the distribution.
+# THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+# AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+# IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+# DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+# FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+# DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+# SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+# CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+# OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+# OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+import argparse
+import sqlite3
+import sys
+import time
+from datetime import datetime
+
+
+def parse_time(text):
+    # Returns Unix time of a date and time given in local time, time of today, or Unix time
+    try:
+        return float(text)
+    except ValueError:
+        pass
+    for fmt in ("%Y-%m-%d %H:%M:%S", "%Y-%m-%d %H:%M", "%Y-%m-%dT%H:%M:%S", "%Y-%m-%dT%H:%M"):
+        try:
+            return datetime.strptime(text, fmt).timestamp()
+        except ValueError:
+            pass
+    for fmt in ("%H:%M:%S", "%H:%M"):
+        try:
+            t = datetime.strptime(text, fmt).time()
+            return datetime.combine(datetime.now().date(), t).timestamp()
+        except ValueError:
+            pass
+    raise argparse.ArgumentTypeError(f"invalid time '{text}'")
+
+
+def format_time(t):
+    if t is None:
+        return "(open)".ljust(23)
+    return datetime.fromtimestamp(t).strftime("%Y-%m-%d %H:%M:%S.%f")[:23]
+
+
+def find_sessions(db, peer, time_from, time_to, limit):
+    # Sessions overlapping the interval <time_from, time_to>. The sessions are looked up by the index of start_time:
+    # a session running at time_from can't have started earlier than time_from - (the longest session duration).
+    # The open sessions are read from their partial index; with --peer, SQLite would otherwise scan all sessions
+    # of the client by the index of (peer_ip, start_time).
+    max_duration = db.execute("SELECT value FROM meta WHERE key = 'max_duration'").fetchone()[0]
+    start_low = time_from - max_duration if time_from is not None else None
+    conditions = []
+    params = []
+    if peer is not None:
+        conditions.append("peer_ip = ?")
+        params.append(peer)
+    if time_to is not None:
+        conditions.append("start_time <= ?")
+        params.append(time_to)
+    closed = list(conditions)
+    closed_params = list(params)
+    if time_from is not None:
+        closed += ["start_time >= ?", "end_time >= ?"]
+        closed_params += [start_low, time_from]
+    where_closed = " AND ".join(closed) if closed else "1"
+    where_open = " AND ".join(conditions + ["end_time IS NULL"])
+    query = (f"SELECT * FROM (SELECT id, file, peer_ip, peer_port, start_time, end_time, bytes, sha256 FROM sessions "
+             f"WHERE {where_closed} AND end_time IS NOT NULL "
+             f"UNION ALL SELECT id, file, peer_ip, peer_port, start_time, end_time, bytes, sha256 FROM sessions "
+             f"INDEXED BY sessions_open WHERE {where_open}) ORDER BY start_time LIMIT ?")
+    return db.execute(query, closed_params + params + [limit]).fetchall()
+
+
+def seek_offset(db, session_id, t):
+    # Offset of the last index entry at or before time t (reading the file from there doesn't skip data received at t)
+    row = db.execute("SELECT offset FROM offsets WHERE session = ? AND time <= ? ORDER BY time DESC LIMIT 1",
+                     (session_id, t)).fetchone()
+    return row[0] if row is not None else 0
+
+
+def main():
+    parser = argparse.ArgumentParser(prog="catalog_query",
+                                     description='Queries the catalog of sessions written by file_via_socket.py.')
+    parser.add_argument('catalog', type=str, help='catalog file (parameter --catalog of file_via_socket.py)')
+    parser.add_argument('--peer', type=str, help='IP address of the client')
+    parser.add_argument('--from', dest='time_from', type=parse_time,
+                        help='sessions running at or after this time ("YYYY-MM-DD HH:MM[:SS]", "HH:MM[:SS]" today, '
+                             'or Unix time)')
+    parser.add_argument('--to', dest='time_to', type=parse_time, help='sessions running at or before this time')
+    parser.add_argument('--seek', type=parse_time,
+                        help='print the offset in each file of the data received at this time (needs --catalog_index)')
+    parser.add_argument('--limit', type=int, default=1000, help='max. number of sessions printed; defaults to 1000')
+    args = parser.parse_args()
+
+    t0 = time.perf_counter()
+    try:
+        db = sqlite3.connect(f"file:{args.catalog}?mode=ro", uri=True)
+        rows = find_sessions(db, args.peer, args.time_from, args.time_to, args.limit)
+    except sqlite3.Error as e:
+        print(f"ERROR: Unable to read the catalog '{args.catalog}': {e}")
+        sys.exit(1)
+    for session_id, file, peer_ip, peer_port, start_time, end_time, size, sha256 in rows:
+        line = f"{format_time(start_time)}  {format_time(end_time)}  {peer_ip}:{peer_port:<5}  "
+        line += f"{size if size is not None else '-':>12}  {file}"
+        if args.seek is not None:
+            line += f"  offset {seek_offset(db, session_id, args.seek)}"
+        print(line)
+        if sha256 is not None:
+            print(f"    sha256 {sha256}")
+    print(f"{len(rows)} session(s) found in {(time.perf_counter() - t0) * 1000:.1f} ms")
+
+
+if __name__ == "__main__":
+    main()
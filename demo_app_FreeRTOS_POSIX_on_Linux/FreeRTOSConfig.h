@@ -0,0 +1,101 @@
+/*
+FreeRTOS configuration of the Linux build of the FreeRTOS demo (FreeRTOS POSIX port with lwIP on a tap interface).
+The values mirror the BSP of the Zynq demo (FreeRTOSConfig.h in freertos10_xilinx_domain/bsp), so the task priorities,
+time slicing and the 10 ms tick behave as on the board. Only the settings specific to the Zynq port are left out.
+Details are explained on GitHub: https://github.com/viktor-nikolov/lwIP-file-via-socket
+
+BSD 2-Clause License:
+
+Copyright (c) 2024 Viktor Nikolov
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+#ifndef FREERTOS_CONFIG_H
+#define FREERTOS_CONFIG_H
+
+#define configUSE_PREEMPTION 1
+#define configUSE_MUTEXES 1
+#define INCLUDE_xSemaphoreGetMutexHolder 1
+#define configUSE_RECURSIVE_MUTEXES 1
+#define configUSE_COUNTING_SEMAPHORES 1
+#define configUSE_TIMERS 1
+#define configUSE_IDLE_HOOK 0
+#define configUSE_TICK_HOOK 0
+#define configUSE_DAEMON_TASK_STARTUP_HOOK 0
+#define configUSE_MALLOC_FAILED_HOOK 1
+#define configUSE_TRACE_FACILITY 1
+#define configSUPPORT_STATIC_ALLOCATION 0
+#define configSUPPORT_DYNAMIC_ALLOCATION 1
+#define configUSE_16_BIT_TICKS 0
+#define configUSE_APPLICATION_TASK_TAG 0
+#define configUSE_CO_ROUTINES 0
+
+#define configTICK_RATE_HZ (100)   // As on the board; the simulator ticks by a host timer signal
+#define configMAX_PRIORITIES (8)
+#define configMAX_TASK_NAME_LEN 10
+#define configIDLE_SHOULD_YIELD 1
+#define configUSE_TIME_SLICING 1
+#define configUSE_PORT_OPTIMISED_TASK_SELECTION 0
+
+/* Each task is a host thread, whose stack is the task's stack. The depth is in words of StackType_t (8 bytes),
+ * and a host thread needs at least 16 kB. (The stacks of the threads created by sys_thread_new are scaled,
+ * see FVS_SIM_STACK_SCALE in sim_netif.c.) */
+#define configMINIMAL_STACK_SIZE ( ( unsigned short ) 4096 )
+#define configSTACK_DEPTH_TYPE uint32_t
+#define configTOTAL_HEAP_SIZE ( ( size_t ) ( 65536 ) ) // Not used, heap_3.c allocates by malloc()
+
+#define configTIMER_TASK_PRIORITY (configMAX_PRIORITIES - 1)
+#define configTIMER_QUEUE_LENGTH 10
+#define configTIMER_TASK_STACK_DEPTH ((configMINIMAL_STACK_SIZE) * 2)
+
+#define configUSE_QUEUE_SETS 1
+#define configUSE_TASK_NOTIFICATIONS 1
+#define configQUEUE_REGISTRY_SIZE 10
+#define configUSE_STATS_FORMATTING_FUNCTIONS 1
+#define configNUM_THREAD_LOCAL_STORAGE_POINTERS 0
+#define configGENERATE_RUN_TIME_STATS 0
+#define configUSE_TICKLESS_IDLE 0
+
+/* The stack overflow check of the board isn't reliable here: the host code (glibc, signal handlers)
+ * runs on the task's stack too. */
+#define configCHECK_FOR_STACK_OVERFLOW 0
+
+#define INCLUDE_vTaskPrioritySet             1
+#define INCLUDE_uxTaskPriorityGet            1
+#define INCLUDE_vTaskDelete                  1
+#define INCLUDE_vTaskCleanUpResources        1
+#define INCLUDE_vTaskSuspend                 1
+#define INCLUDE_vTaskDelayUntil              1
+#define INCLUDE_vTaskDelay                   1
+#define INCLUDE_eTaskGetState                1
+#define INCLUDE_xTimerPendFunctionCall       1
+#define INCLUDE_pcTaskGetTaskName            1
+#define INCLUDE_xTaskGetHandle               1
+#define INCLUDE_xTaskGetSchedulerState       1
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+void vApplicationAssert( const char *pcFileName, unsigned long ulLine ); // Defined in sim_netif.c
+#ifdef __cplusplus
+}
+#endif
+#define configASSERT( x ) if( ( x ) == 0 ) vApplicationAssert( __FILE__, __LINE__ )
+
+#endif // FREERTOS_CONFIG_H
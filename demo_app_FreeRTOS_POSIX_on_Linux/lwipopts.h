@@ -0,0 +1,134 @@
+/*
+lwIP options of the Linux build of the FreeRTOS demo (FreeRTOS POSIX port with lwIP on a tap interface).
+The values are copied from the BSP of the Zynq demo (lwipopts.h in freertos10_xilinx_domain/bsp), so lwIP
+behaves as on the board (buffer sizes, TCP window, thread priorities). The differences are marked by comments.
+Details are explained on GitHub: https://github.com/viktor-nikolov/lwIP-file-via-socket
+
+BSD 2-Clause License:
+
+Copyright (c) 2024 Viktor Nikolov
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+#ifndef __LWIPOPTS_H_
+#define __LWIPOPTS_H_
+
+#ifndef PROCESSOR_LITTLE_ENDIAN
+#define PROCESSOR_LITTLE_ENDIAN
+#endif
+
+#define SYS_LIGHTWEIGHT_PROT 1
+
+
+#define NO_SYS_NO_TIMERS 1
+
+#define DEFAULT_THREAD_PRIO 2
+#define TCPIP_THREAD_PRIO (2 + 1)
+#define TCPIP_THREAD_STACKSIZE 1024
+#define DEFAULT_TCP_RECVMBOX_SIZE 	200
+#define DEFAULT_ACCEPTMBOX_SIZE 	5
+#define TCPIP_MBOX_SIZE		200
+#define DEFAULT_UDP_RECVMBOX_SIZE 	100
+#define DEFAULT_RAW_RECVMBOX_SIZE	30
+#define LWIP_COMPAT_MUTEX 0
+#define LWIP_ALLOW_MEM_FREE_FROM_OTHER_CONTEXT 1
+
+#define LWIP_TCP_KEEPALIVE 0
+
+#define MEM_ALIGNMENT 64
+#define MEM_SIZE 131072
+#define MEMP_NUM_PBUF 16
+#define MEMP_NUM_UDP_PCB 4
+#define MEMP_NUM_TCP_PCB 32
+#define MEMP_NUM_TCP_PCB_LISTEN 8
+#define MEMP_NUM_TCP_SEG 256
+#define MEMP_NUM_SYS_TIMEOUT 8
+#define MEMP_NUM_NETBUF 8
+#define MEMP_NUM_NETCONN 16
+#define MEMP_NUM_TCPIP_MSG_API 16
+#define MEMP_NUM_TCPIP_MSG_INPKT 64
+
+#define MEMP_NUM_NETBUF     8
+#define MEMP_NUM_NETCONN    16
+#define MEMP_NUM_SYS_TIMEOUT 8
+#define PBUF_POOL_SIZE 256
+#define PBUF_POOL_BUFSIZE 1700
+#define PBUF_LINK_HLEN 16
+
+#define ARP_TABLE_SIZE 10
+#define ARP_QUEUEING 1
+
+#define ICMP_TTL 255
+
+#define IP_OPTIONS 0
+#define IP_FORWARD 0
+#define IP_REASSEMBLY 1
+#define IP_FRAG 1
+#define IP_REASS_MAX_PBUFS 128
+#define IP_FRAG_MAX_MTU 1500
+#define IP_DEFAULT_TTL 255
+#define LWIP_CHKSUM_ALGORITHM 3
+
+#define LWIP_UDP 1
+#define UDP_TTL 255
+#define LWIP_UDP_OPT_BLOCK_TX_TILL_COMPLETE 0
+
+#define LWIP_TCP 1
+#define TCP_MSS 1460
+#define TCP_SND_BUF 8192
+#define TCP_WND 2048
+#define TCP_TTL 255
+#define TCP_MAXRTX 12
+#define TCP_SYNMAXRTX 4
+#define TCP_QUEUE_OOSEQ 1
+#define TCP_SND_QUEUELEN   16 * TCP_SND_BUF/TCP_MSS
+/* The Ethernet MAC of Zynq computes the checksums (CHECKSUM_GEN_* and CHECKSUM_CHECK_* 0 in the BSP).
+ * The tap interface doesn't, so we keep the lwIP defaults (checksums computed by lwIP). */
+
+#define MEMP_SEPARATE_POOLS 1
+#define MEMP_NUM_FRAG_PBUF 256
+#define IP_OPTIONS_ALLOWED 0
+#define TCP_OVERSIZE TCP_MSS
+
+#define LWIP_DHCP 1
+#define DHCP_DOES_ARP_CHECK 0
+
+/* On Zynq, lwIP provides its own global errno (LWIP_PROVIDE_ERRNO). On the host, that would clash with errno
+ * of glibc; we use errno of glibc instead, which is thread-local, i.e., each task has its own. */
+#define LWIP_ERRNO_STDINCLUDE 1
+
+/* Xilinx's lwip/sys.h defines the lightweight protection only for ARM and MicroBlaze.
+ * sys_arch_protect and sys_arch_unprotect are implemented in sim_netif.c. */
+#define SYS_ARCH_DECL_PROTECT(lev) sys_prot_t lev
+#define SYS_ARCH_PROTECT(lev)      lev = sys_arch_protect()
+#define SYS_ARCH_UNPROTECT(lev)    sys_arch_unprotect(lev)
+
+#include <stdint.h>
+#ifdef __cplusplus
+extern "C" {
+#endif
+unsigned long sys_arch_protect( void );        // unsigned long is sys_prot_t of arch/sys_arch.h
+void sys_arch_unprotect( unsigned long lev );
+#ifdef __cplusplus
+}
+#endif
+
+typedef uint32_t u32; // The type of xil_types.h, which the Xilinx sys_arch.c uses
+
+#endif
@@ -0,0 +1,159 @@
+/*
+The platform part of the Linux build of the FreeRTOS demo (FreeRTOS POSIX port with lwIP on a tap interface).
+It replaces the parts of the Zynq BSP, which depend on the hardware: the lwIP network interface of the Ethernet MAC
+(xemac_add, xemacif_input_thread), the lwIP critical sections (sys_arch_protect) and the FreeRTOS hooks.
+Details are explained on GitHub: https://github.com/viktor-nikolov/lwIP-file-via-socket
+
+BSD 2-Clause License:
+
+Copyright (c) 2024 Viktor Nikolov
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "FreeRTOS.h"
+#include "task.h"
+#include "semphr.h"
+
+#include "lwip/sys.h"
+#include "lwip/pbuf.h"
+#include "lwip/tcpip.h"
+#include "lwip/etharp.h"
+#include "netif/ethernet.h"
+#include "netif/xadapter.h"
+#include "sim_tap.h"
+
+/* Multiplier of the stack sizes given to sys_thread_new (see __wrap_sys_thread_new) */
+#ifndef FVS_SIM_STACK_SCALE
+#   define FVS_SIM_STACK_SCALE 8
+#endif
+
+#define MAX_FRAME_SIZE 1518 // Ethernet frame of MTU 1500 with the header (14 bytes) and a VLAN tag
+
+static err_t low_level_output( struct netif *netif, struct pbuf *p )
+{
+	char frame[MAX_FRAME_SIZE];
+	(void)netif;
+	if( p->tot_len > sizeof(frame) )
+		return ERR_BUF;
+	pbuf_copy_partial( p, frame, p->tot_len, 0 );
+	if( sim_tap_write( frame, p->tot_len ) != 0 )
+		LINK_STATS_INC( link.drop );
+	return ERR_OK;
+} // low_level_output
+
+static err_t sim_netif_init( struct netif *netif )
+{
+	netif->name[0] = 't';
+	netif->name[1] = 'p';
+	netif->output = etharp_output;
+	netif->linkoutput = low_level_output;
+	netif->mtu = 1500;
+	netif->hwaddr_len = ETH_HWADDR_LEN;
+	memcpy( netif->hwaddr, netif->state, ETH_HWADDR_LEN ); // xemac_add passes the MAC address as the state
+	netif->state = NULL;
+	netif->flags = NETIF_FLAG_BROADCAST | NETIF_FLAG_ETHARP | NETIF_FLAG_LINK_UP;
+	return ERR_OK;
+} // sim_netif_init
+
+struct netif *xemac_add( struct netif *netif, ip_addr_t *ipaddr, ip_addr_t *netmask, ip_addr_t *gw,
+                         unsigned char *mac_ethernet_address, uintptr_t mac_baseaddr )
+{
+	(void)mac_baseaddr;
+	const char *tapName = getenv( "FVS_TAP" );
+	if( sim_tap_open( tapName != NULL ? tapName : "tap0" ) != 0 )
+		return NULL;
+	return netif_add( netif, ipaddr, netmask, gw, mac_ethernet_address, sim_netif_init, tcpip_input );
+} // xemac_add
+
+static SemaphoreHandle_t RxSemaphore = NULL; // Given by the "interrupt" when frames arrived
+
+static void tap_interrupt( int signal )
+{
+	(void)signal;
+	BaseType_t woken = pdFALSE;
+	if( RxSemaphore != NULL )
+		xSemaphoreGiveFromISR( RxSemaphore, &woken );
+	portYIELD_FROM_ISR( woken );
+} // tap_interrupt
+
+void xemacif_input_thread( struct netif *netif )
+{
+	/* As on Zynq, the thread runs at the priority given by the demo (DEFAULT_THREAD_PRIO) and waits for the semaphore
+	 * given by the interrupt of the Ethernet MAC. The simulator's interrupt is SIGIO of the tap interface.
+	 * Each wake-up passes all waiting frames to lwIP; the frames wait in the queue of the tap interface meanwhile
+	 * (like in the DMA ring of the MAC). */
+	RxSemaphore = xSemaphoreCreateBinary();
+	if( RxSemaphore == NULL || sim_tap_enable_interrupt( tap_interrupt ) != 0 )
+		abort();
+
+	char frame[MAX_FRAME_SIZE];
+	while( 1 ) {
+		int len = sim_tap_read( frame, sizeof(frame) );
+		if( len == 0 ) { // Frames arriving from now on give the semaphore, so none is missed
+			xSemaphoreTake( RxSemaphore, portMAX_DELAY );
+			continue;
+		}
+		struct pbuf *p = pbuf_alloc( PBUF_RAW, (u16_t)len, PBUF_POOL );
+		if( p == NULL ) { // Out of pbufs, the frame is dropped (the MAC would drop it too)
+			LINK_STATS_INC( link.memerr );
+			continue;
+		}
+		pbuf_take( p, frame, (u16_t)len );
+		if( netif->input( p, netif ) != ERR_OK )
+			pbuf_free( p );
+	}
+} // xemacif_input_thread
+
+/* Replaces sys_arch_raw.c of the Xilinx port, which masks the interrupts of the Cortex-A9 */
+sys_prot_t sys_arch_protect( void )
+{
+	taskENTER_CRITICAL();
+	return 1;
+} // sys_arch_protect
+
+void sys_arch_unprotect( sys_prot_t lev )
+{
+	(void)lev;
+	taskEXIT_CRITICAL();
+} // sys_arch_unprotect
+
+/* The demo gives sys_thread_new the stack sizes for Zynq (32-bit words). A task on the host needs much more
+ * (the words are 64-bit, and glibc and the C++ exception handling use more stack), so the program is linked with
+ * -Wl,--wrap=sys_thread_new and the stack sizes are scaled here. */
+sys_thread_t __real_sys_thread_new( const char *name, lwip_thread_fn thread, void *arg, int stacksize, int prio );
+
+sys_thread_t __wrap_sys_thread_new( const char *name, lwip_thread_fn thread, void *arg, int stacksize, int prio )
+{
+	return __real_sys_thread_new( name, thread, arg, stacksize * FVS_SIM_STACK_SCALE, prio );
+} // __wrap_sys_thread_new
+
+void vApplicationAssert( const char *pcFileName, unsigned long ulLine )
+{
+	printf( "Assertion failed in %s:%lu\r\n", pcFileName, ulLine );
+	abort();
+} // vApplicationAssert
+
+void vApplicationMallocFailedHook( void )
+{
+	printf( "Memory allocation by pvPortMalloc failed\r\n" );
+	abort();
+} // vApplicationMallocFailedHook
@@ -0,0 +1,87 @@
+/*
+Access to a tap interface of the host for the Linux build of the FreeRTOS demo (see sim_tap.h).
+Details are explained on GitHub: https://github.com/viktor-nikolov/lwIP-file-via-socket
+
+BSD 2-Clause License:
+
+Copyright (c) 2024 Viktor Nikolov
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.*/
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <net/if.h>
+#include <linux/if_tun.h>
+#include "sim_tap.h"
+
+static int TapFd = -1;
+
+int sim_tap_open( const char *name )
+{
+	TapFd = open( "/dev/net/tun", O_RDWR | O_NONBLOCK );
+	if( TapFd < 0 ) {
+		printf( "Unable to open /dev/net/tun: %s\r\n", strerror(errno) );
+		return -1;
+	}
+
+	struct ifreq ifr;
+	memset( &ifr, 0, sizeof(ifr) );
+	ifr.ifr_flags = IFF_TAP | IFF_NO_PI; // Ethernet frames without the packet information header
+	strncpy( ifr.ifr_name, name, IFNAMSIZ - 1 );
+	if( ioctl( TapFd, TUNSETIFF, &ifr ) < 0 ) {
+		printf( "Unable to attach to the tap interface %s: %s\r\n", name, strerror(errno) );
+		close( TapFd );
+		TapFd = -1;
+		return -1;
+	}
+	return 0;
+} // sim_tap_open
+
+int sim_tap_enable_interrupt( void (*handler)( int ) )
+{
+	/* SIGIO is a process-directed signal. The FreeRTOS POSIX port blocks the signals in all threads except the running
+	 * task (with its interrupts enabled), so the handler runs in the context of the running task, as an interrupt
+	 * handler does on the board, and it's held off by the critical sections the same way as the tick. */
+	struct sigaction action;
+	memset( &action, 0, sizeof(action) );
+	action.sa_handler = handler;
+	action.sa_flags = SA_RESTART; // The system calls of the interrupted task continue
+	sigfillset( &action.sa_mask );
+	if( sigaction( SIGIO, &action, NULL ) != 0 || fcntl( TapFd, F_SETOWN, getpid() ) != 0
+	    || fcntl( TapFd, F_SETFL, fcntl( TapFd, F_GETFL ) | O_ASYNC ) != 0 ) {
+		printf( "Unable to enable SIGIO of the tap interface: %s\r\n", strerror(errno) );
+		return -1;
+	}
+	return 0;
+} // sim_tap_enable_interrupt
+
+int sim_tap_read( void *frame, int maxLen )
+{
+	ssize_t len = read( TapFd, frame, maxLen );
+	return len > 0 ? (int)len : 0; // EAGAIN: no frame is waiting
+} // sim_tap_read
+
+int sim_tap_write( const void *frame, int len )
+{
+	return write( TapFd, frame, len ) == len ? 0 : -1;
+} // sim_tap_write
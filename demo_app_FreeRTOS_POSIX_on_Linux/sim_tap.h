@@ -0,0 +1,51 @@
+/*
+Access to a tap interface of the host for the Linux build of the FreeRTOS demo.
+It's kept apart from sim_netif.c, because the Linux network headers and the lwIP headers can't be included together.
+Details are explained on GitHub: https://github.com/viktor-nikolov/lwIP-file-via-socket
+
+BSD 2-Clause License:
+
+Copyright (c) 2024 Viktor Nikolov
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.*/
+#ifndef SIM_TAP_H
+#define SIM_TAP_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Opens the tap interface (non-blocking). Returns 0 on success, -1 on error (the reason is printed). */
+int sim_tap_open( const char *name );
+
+/* Makes the tap interface signal SIGIO, whenever a frame arrives, to the handler (the Ethernet interrupt).
+ * Returns 0 on success, -1 on error (the reason is printed). */
+int sim_tap_enable_interrupt( void (*handler)( int ) );
+
+/* Reads one Ethernet frame. Returns its length, or 0 when no frame is waiting. */
+int sim_tap_read( void *frame, int maxLen );
+
+/* Writes one Ethernet frame. Returns 0 on success, -1 on error (the frame is dropped). */
+int sim_tap_write( const void *frame, int len );
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // SIM_TAP_H
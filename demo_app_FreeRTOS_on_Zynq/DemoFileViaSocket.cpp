@@ -42,10 +42,27 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #include "FileViaSocket.h"
 
+/* Set IPERF_BASELINE to 1 to compare the bulk transfer with raw TCP. After the demo, the same amount of data
+ * is sent twice to an iperf2 server (run "iperf -s" on SERVER_ADDR): by lwIP netconn_write() in the iperf2
+ * protocol and by FileViaSocket. The throughput of both, and the CPU load when the BSP enables
+ * configGENERATE_RUN_TIME_STATS, are printed. */
+#ifndef IPERF_BASELINE
+#define IPERF_BASELINE 0
+#endif
+#if IPERF_BASELINE
+#include <cstring>
+#include "lwip/api.h"
+const unsigned short IPERF_PORT{ 5001 }; // The default port of iperf2
+#endif
+
 /* IP address and port of the server running the script file_via_socket.py.
  * The address must be provided in numberical form in a string, e.g., "192.168.44.10".*/
+#ifdef FVS_SERVER_ADDR // Set on the command line, e.g., -DFVS_SERVER_ADDR='"192.168.44.1"' (see the README)
+const std::string    SERVER_ADDR( FVS_SERVER_ADDR );
+#else
 const std::string    SERVER_ADDR( "###SERVER_ADDR is not set###" );
 //const std::string    SERVER_ADDR( "192.168.44.10" );
+#endif
 const unsigned short SERVER_PORT{ 65432 }; //The server script file_via_socket.py uses port 65432 by default.
 
 //Fallback IP address used when DHCP is not successful
@@ -57,7 +74,8 @@ const unsigned short SERVER_PORT{ 65432 }; //The server script file_via_socket.p
 #define STANDARD_THREAD_STACKSIZE 1024
 
 //Size of the stack (as number of 32bit words) for the thread, which sends data using FileViaSocket class
-#define SEND_DATA_THREAD_STACKSIZE 8000
+//(the thread doesn't keep any big data buffer on the stack because it uses FileViaSocket::writeFrom)
+#define SEND_DATA_THREAD_STACKSIZE 2048
 
 sys_thread_t network_init_thread_handle;
 static int complete_nw_thread;
@@ -148,6 +166,167 @@ static void network_thread(void *p)
 	return;
 } //network_thread
 
+#if IPERF_BASELINE
+const std::size_t IPERF_HEADER_SIZE{ 24 };
+const std::size_t IPERF_BLOCK_SIZE{ 16*1024 };
+
+/* Header of an iperf2 TCP test (lwiperf_settings_t of lwIP's lwiperf app): big-endian u32 flags, num_threads,
+ * remote_port, buffer_len, win_band and amount. Flags 0 mean a plain test (the server doesn't connect back);
+ * amount > 0 is the number of bytes. */
+static void put_iperf_header( char *dest, unsigned long long bytes )
+{
+	const u32_t fields[6] = { 0, 1, IPERF_PORT, IPERF_BLOCK_SIZE, 0,
+	                          u32_t( bytes < 0x7FFFFFFF ? bytes : 0x7FFFFFFF ) };
+	for( int i = 0; i < 6; i++ ) {
+		u32_t value = lwip_htonl( fields[i] );
+		memcpy( dest + 4*i, &value, 4 );
+	}
+}
+
+struct BulkResult {
+	std::uint64_t ticks{ 0 };    // Duration in ticks of SocketBuffer::rawTimestamp()
+	bool   cpuKnown{ false };    // The CPU times are known only with configGENERATE_RUN_TIME_STATS
+	u32_t  busy{ 0 }, total{ 0 }; // CPU time of all tasks except the idle task, and the elapsed time (run-time stats clock)
+};
+
+/* Reads the run-time stats counters: the sum over all tasks except the idle task, and the total time.
+ * The counters are 32-bit, so a test must be shorter than the wrap-around period of the run-time stats clock. */
+static bool cpu_busy_time( u32_t &busy, u32_t &total )
+{
+#if configGENERATE_RUN_TIME_STATS == 1
+	static TaskStatus_t tasks[16]; // Static, the stack of the thread is small
+	configRUN_TIME_COUNTER_TYPE totalTime;
+	UBaseType_t count = uxTaskGetSystemState( tasks, 16, &totalTime );
+	if( count == 0 ) // More tasks than the array can take
+		return false;
+#ifndef configIDLE_TASK_NAME
+#define configIDLE_TASK_NAME "IDLE" // The default of tasks.c
+#endif
+	u32_t idle{ 0 };
+	for( UBaseType_t i = 0; i < count; i++ )
+		if( strcmp( tasks[i].pcTaskName, configIDLE_TASK_NAME ) == 0 )
+			idle += tasks[i].ulRunTimeCounter;
+	busy = u32_t( totalTime ) - idle;
+	total = u32_t( totalTime );
+	return true;
+#else
+	(void)busy; (void)total;
+	return false;
+#endif
+}
+
+static void start_measurement( BulkResult &r )
+{
+	r.cpuKnown = cpu_busy_time( r.busy, r.total );
+	r.ticks = SocketBuffer::rawTimestamp();
+}
+
+static void stop_measurement( BulkResult &r )
+{
+	r.ticks = SocketBuffer::rawTimestamp() - r.ticks;
+	u32_t busy{ 0 }, total{ 0 };
+	r.cpuKnown = r.cpuKnown && cpu_busy_time( busy, total );
+	r.busy = busy - r.busy;
+	r.total = total - r.total;
+}
+
+/* Sends the iperf header and the given number of bytes by lwIP netconn_write(), i.e., the TCP stack without
+ * FileViaSocket. The data are copied to lwIP (NETCONN_COPY) as FileViaSocket's send() does,
+ * so the difference between the tests is the cost of FileViaSocket itself. */
+static bool raw_tcp_bulk( unsigned long long bytes, BulkResult &r )
+{
+	static char block[IPERF_BLOCK_SIZE];
+	for( std::size_t i = 0; i < IPERF_BLOCK_SIZE; i++ )
+		block[i] = 'A' + i % 26;
+	char header[IPERF_HEADER_SIZE];
+	put_iperf_header( header, bytes );
+
+	ip_addr_t server;
+	struct netconn *conn = netconn_new( NETCONN_TCP );
+	if( conn == NULL || !inet_aton( SERVER_ADDR.c_str(), &server ) || netconn_connect( conn, &server, IPERF_PORT ) != ERR_OK ) {
+		if( conn != NULL )
+			netconn_delete( conn );
+		return false;
+	}
+
+	start_measurement( r );
+	err_t err = netconn_write( conn, header, IPERF_HEADER_SIZE, NETCONN_COPY );
+	for( unsigned long long sent = 0; sent < bytes && err == ERR_OK; sent += IPERF_BLOCK_SIZE )
+		err = netconn_write( conn, block, bytes - sent < IPERF_BLOCK_SIZE ? bytes - sent : IPERF_BLOCK_SIZE, NETCONN_COPY );
+	stop_measurement( r );
+
+	netconn_close( conn );
+	netconn_delete( conn );
+	return err == ERR_OK;
+}
+
+/* The same data as raw_tcp_bulk, by FileViaSocket::writeFrom (as the bulk transfer of the demo) */
+static bool file_via_socket_bulk( unsigned long long bytes, BulkResult &r )
+{
+	char header[IPERF_HEADER_SIZE];
+	put_iperf_header( header, bytes );
+
+	FileViaSocket f;
+	try {
+		f.open( SERVER_ADDR, IPERF_PORT );
+	} catch( const std::exception& ) {
+		return false;
+	}
+
+	start_measurement( r );
+	f.write( header, IPERF_HEADER_SIZE );
+	unsigned position{ 0 };
+	f.writeFrom( [&position]( char *dest, std::size_t maxLen ) {
+	                 for( std::size_t i = 0; i < maxLen; i++ )
+	                     dest[i] = 'A' + position++ % 26;
+	                 return maxLen;
+	             },
+	             std::streamsize( bytes ) );
+	f.flush();
+	stop_measurement( r );
+
+	bool success = bool( f );
+	f.close();
+	return success;
+}
+
+static void print_bulk_result( const char *name, unsigned long long bytes, const BulkResult &r )
+{
+	const double seconds = double( r.ticks ) / double( SocketBuffer::rawTimestampHz() );
+	const unsigned mbps10 = unsigned( double( bytes ) * 8 / seconds / 1e5 ); // Mbps * 10
+	xil_printf( "%s %d.%d Mbps", name, mbps10 / 10, mbps10 % 10 );
+	if( r.cpuKnown && r.total > 0 )
+		xil_printf( ", CPU busy %d %%\r\n", unsigned( double( r.busy ) * 100 / r.total ) );
+	else
+		xil_printf( ", CPU busy n/a (configGENERATE_RUN_TIME_STATS is 0)\r\n" );
+}
+
+/* Runs raw TCP and then FileViaSocket with the same data to the iperf2 server and prints the comparison */
+static void iperf_baseline( unsigned long long bytes )
+{
+	xil_printf( "\r\nBaseline against raw TCP: %d kB to iperf2 server %s:%d\r\n", unsigned( bytes / 1000 ),
+	            SERVER_ADDR.c_str(), IPERF_PORT );
+	BulkResult raw, fvs;
+	if( !raw_tcp_bulk( bytes, raw ) ) {
+		xil_printf( "Raw TCP test failed (is iperf -s running?)\r\n" );
+		return;
+	}
+	print_bulk_result( "raw TCP:      ", bytes, raw );
+	vTaskDelay( pdMS_TO_TICKS( 50 ) ); // Let the server finish the previous test
+	if( !file_via_socket_bulk( bytes, fvs ) ) {
+		xil_printf( "FileViaSocket test failed\r\n" );
+		return;
+	}
+	print_bulk_result( "FileViaSocket:", bytes, fvs );
+
+	const unsigned percent10 = unsigned( double( raw.ticks ) * 1000 / double( fvs.ticks ) ); // Percent * 10
+	xil_printf( "FileViaSocket achieved %d.%d %% of the raw TCP throughput", percent10 / 10, percent10 % 10 );
+	if( raw.cpuKnown && fvs.cpuKnown && raw.busy > 0 ) // The same data, so the busy times compare the CPU time per byte
+		xil_printf( ", CPU time %d %% of raw TCP", unsigned( double( fvs.busy ) * 100 / raw.busy ) );
+	xil_printf( "\r\n" );
+}
+#endif // IPERF_BASELINE
+
 void demo_FileViaSocket_thread(void *p)
 {
 	bool WasOK{ false };
@@ -205,6 +384,8 @@ void demo_FileViaSocket_thread(void *p)
 
 	vTaskDelay( pdMS_TO_TICKS( 50 ) ); // Wait 50 ms
 
+	f.setTimeAccounting( true ); // We want to know how much time the bulk transfer takes in FileViaSocket and in lwIP
+
 	try {
 		f.open( SERVER_ADDR, SERVER_PORT ); // Open a new connection on the same object
 	} catch( const std::exception& e ) {
@@ -214,23 +395,33 @@ void demo_FileViaSocket_thread(void *p)
 		vTaskDelete(NULL); // We end this thread
 	}
 
-	// Prepare a buffer to be written to the server
-	const unsigned BUFF_SIZE{ 26*1000 }; /* Size of a buffer sent by one call of write().
-	                                        WARNING: Be sure you have big enough stack in this thread.
-	                                                 Set value of SEND_DATA_THREAD_STACKSIZE accordingly. */
-	const unsigned BUFFER_COUNT{ 1000 }; /* Number of times we sent the buffer.
+	const unsigned BUFF_SIZE{ 26*1000 }; /* Size of a block of data we generate. */
+	const unsigned BUFFER_COUNT{ 1000 }; /* Number of blocks we sent.
 	                                        Set this to a high number to perform bulk transfer test. */
-	char buffer[BUFF_SIZE];
-	for( unsigned i = 0; i < BUFF_SIZE; i++ )
-		buffer[i] = 'A' + i % 26; // Fill with repeated sequence from 'A' to 'Z'
 
 	/* Test of bulk data transfer.
-	 * On Zybo Z7 I achieved the transfer speed of about 340 Mbps */
-	for( unsigned i = 0; i < BUFFER_COUNT; i++ )
-		f.write( buffer, BUFF_SIZE ); // Write the whole buffer to the server
+	 * We don't prepare the data in a buffer on the stack. The generator writes data directly
+	 * to the internal buffer of FileViaSocket, chunk by chunk, therefore a small stack is enough.
+	 * (The 340 Mbps measured on Zybo Z7 were for write() of 26 KB blocks; build with IPERF_BASELINE
+	 * to measure this path against raw TCP.) */
+	unsigned position{ 0 }; // Position in the repeated sequence from 'A' to 'Z'
+	f.writeFrom( [&position]( char *dest, std::size_t maxLen ) {
+	                 for( std::size_t i = 0; i < maxLen; i++ )
+	                     dest[i] = 'A' + position++ % 26; // Fill with repeated sequence from 'A' to 'Z'
+	                 return maxLen;
+	             },
+	             std::streamsize(BUFF_SIZE) * BUFFER_COUNT );
 	f.close(); // The connection is closed, third file is created on the server
 
-	xil_printf( "Buffer sent. All done.\r\n");
+	xil_printf( "Buffer sent.\r\n");
+	/* The time spent in the stream and in send(), and the high-water marks of the lwIP pools (LWIP_STATS),
+	 * which tell how close we came to running out of pbufs and TCP segments.
+	 * (f << streamStats would write the same as a record to the file on the server.) */
+	xil_printf( "%s\r\n", f.statsSummary().c_str() );
+#if IPERF_BASELINE
+	iperf_baseline( (unsigned long long)BUFF_SIZE * BUFFER_COUNT );
+#endif
+	xil_printf( "All done.\r\n");
 	vTaskDelete(NULL); // All done, we end this thread
 } //demo_FileViaSocket_thread
 
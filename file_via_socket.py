@@ -6,6 +6,10 @@
 # Tested on Ubuntu 22.04 and Windows 11.
 #
 # usage: file_via_socket [-h] [--path PATH] [--prefix PREFIX] [--ext EXT] [--bind_ip BIND_IP] [--bind_port BIND_PORT]
+#                        [--merge MERGE] [--merge_delay MERGE_DELAY] [--merge_hex] [--merge_source] [--record]
+#                        [--direct_io] [--direct_io_threads DIRECT_IO_THREADS] [--memory_budget MEMORY_BUDGET]
+#                        [--overload_control VERBOSITY] [--catalog CATALOG] [--catalog_index CATALOG_INDEX]
+#                        [--dict FILE]
 #
 # options:
 #   -h, --help              Show help message and exit
@@ -14,6 +18,27 @@
 #   --ext EXT               Extension for the file name; defaults to "txt"
 #   --bind_ip BIND_IP       Local IP to bind the socket listener to; defaults to 0.0.0.0
 #   --bind_port BIND_PORT   Local port to listen to connection on; values: 1024..65535; defaults to 65432
+#   --merge MERGE           File, to which timestamped lines of all concurrent sessions are merged in timestamp order
+#   --merge_delay MERGE_DELAY
+#                           Max. time in seconds a line waits in the merge for older lines; defaults to 2.0
+#   --merge_hex             Timestamps at the start of the lines are hexadecimal numbers (decimal by default)
+#   --merge_source          Prepend the address of the client to each merged line
+#   --record                Record size and arrival time of each received chunk to a .rec file next to the data file
+#                           (for replay_app_Linux_or_Win)
+#   --direct_io             Write the files with O_DIRECT, bypassing the page cache (for huge captures; Linux only)
+#   --direct_io_threads DIRECT_IO_THREADS
+#                           Number of writer threads for --direct_io; defaults to 4
+#   --memory_budget MEMORY_BUDGET
+#                           Write the files in a separate thread, with at most MEMORY_BUDGET MB of received data waiting
+#                           to be written; the sessions share the budget and the disk fairly
+#   --overload_control VERBOSITY
+#                           When a half of the memory budget is used, ask the clients to lower the verbosity to VERBOSITY,
+#                           to pause bulk transfers and to flush at most every 100 ms (needs --memory_budget)
+#   --catalog CATALOG       SQLite file, to which the sessions are recorded (peer, time, size, hash); see catalog_query.py
+#   --catalog_index CATALOG_INDEX
+#                           Record the offset in the file of the data received every CATALOG_INDEX seconds to the catalog
+#   --dict FILE             Static dictionary (a .dict file created by train_dictionary.py) for the sessions compressed
+#                           against it; may be given several times
 #
 # BSD 2-Clause License:
 #
@@ -41,9 +66,52 @@ import ipaddress
 import socket
 import signal
 import argparse
+import struct
+import time
+import os
+import heapq
+import mmap
+import errno
+import hashlib
+import sqlite3
+import queue
+import threading
+from collections import deque
 from datetime import datetime
 from select import select
 
+try:
+    import lz4.block as lz4_block  # Optional; when installed, it speeds up decoding of compressed sessions
+    LZ4_ERRORS = (lz4_block.LZ4BlockError,)
+except ImportError:
+    lz4_block = None
+    LZ4_ERRORS = ()
+
+# Framing of compressed sessions sent by FileViaSocket (see SocketBuffer::setCompression)
+FRAME_MAGIC = b"\x89FVS\r\n\x1a\n"
+PREAMBLE_SIZE = 12                   # magic, u8 version, u8 flags, u16 reserved
+PREAMBLE_FLAG_ECHO = 0x01            # The client wants us to echo the timestamp frames
+PREAMBLE_FLAG_CONTROL = 0x02         # The client accepts control requests (see SocketBuffer::setControlChannel)
+FRAME_HEADER = struct.Struct("<BI")  # frame type, payload length
+FRAME_RAW = 0
+FRAME_LZ4 = 1
+FRAME_TIMESTAMP = 2
+FRAME_DICTIONARY = 3                 # ID of the static dictionary of the session (see SocketBuffer::setDictionary)
+FRAME_LZ4_DICT = 4                   # LZ4 frame compressed against the static dictionary
+MAX_DICTIONARY_SIZE = 32768          # The client uses only the last 32 KB of a longer dictionary
+MAX_BLOCK_SIZE = 16384               # Max. raw data in a frame (BlockCompressor::MAX_BLOCK_SIZE)
+MAX_FRAME_SIZE = 4 * MAX_BLOCK_SIZE  # A longer frame is rejected as corrupted (the client never sends one)
+TIMESTAMP_PAYLOAD = struct.Struct("<IQQ")  # sequence number, client's first byte time, client's send time
+# Messages we send to the client: message type, payload length, payload
+SERVER_MESSAGE_ECHO = 1
+ECHO_MESSAGE = struct.Struct("<BHIQQQQ")   # + sequence number, first byte time, send time, our receive time,
+                                           #   our time of writing to the file
+SERVER_MESSAGE_VERBOSITY = 2
+SERVER_MESSAGE_BULK_PAUSE = 3
+SERVER_MESSAGE_FLUSH_INTERVAL = 4
+CONTROL_MESSAGE_U8 = struct.Struct("<BHB")   # verbosity (highest log level), bulk pause (0/1)
+CONTROL_MESSAGE_U32 = struct.Struct("<BHI")  # flush interval (ms)
+
 
 def signal_handler(signum, frame):
     # Handler for Ctlr+C signal
@@ -79,6 +147,774 @@ def bytes2human_readable(bytes_val):
         return "{:} B".format(bytes_val)
 
 
+def dictionary_id(dictionary):
+    # ID of a static dictionary: FNV-1a hash of its data (as BlockCompressor::dictionaryId)
+    h = 2166136261
+    for b in dictionary[-MAX_DICTIONARY_SIZE:]:
+        h = ((h ^ b) * 16777619) & 0xFFFFFFFF
+    return h
+
+
+def lz4_decompress(src, raw_len, dictionary=b""):
+    # Decompress a block in the LZ4 block format; the matches may refer to the dictionary preceding the block
+    if raw_len > MAX_BLOCK_SIZE:
+        raise ValueError(f"corrupted LZ4 block (raw length {raw_len})")
+    if lz4_block is not None:
+        if dictionary:
+            return lz4_block.decompress(src, uncompressed_size=raw_len, dict=dictionary)
+        return lz4_block.decompress(src, uncompressed_size=raw_len)
+    dst = bytearray(dictionary)
+    i = 0
+    while i < len(src):
+        token = src[i]
+        i += 1
+        lit_len = token >> 4
+        if lit_len == 15:  # Length continues in the following bytes
+            while True:
+                b = src[i]
+                i += 1
+                lit_len += b
+                if b != 255:
+                    break
+        dst += src[i:i + lit_len]
+        i += lit_len
+        if i >= len(src):  # The last sequence contains only literals
+            break
+        offset = src[i] | (src[i + 1] << 8)
+        i += 2
+        match_len = token & 15
+        if match_len == 15:
+            while True:
+                b = src[i]
+                i += 1
+                match_len += b
+                if b != 255:
+                    break
+        match_len += 4
+        start = len(dst) - offset
+        if start < 0:
+            raise ValueError("corrupted LZ4 block (offset out of the data)")
+        if offset >= match_len:
+            dst += dst[start:start + match_len]
+        else:  # Overlapping match repeats the last 'offset' bytes
+            pattern = bytes(dst[start:])
+            dst += (pattern * (match_len // offset + 1))[:match_len]
+    if len(dst) - len(dictionary) != raw_len:
+        raise ValueError(f"corrupted LZ4 block (expected {raw_len} bytes, got {len(dst) - len(dictionary)})")
+    return bytes(dst[len(dictionary):])
+
+
+class FrameDecoder:
+    # Decodes frames of a framed session (compressed, or with latency measurement)
+    def __init__(self, preamble):
+        self.echo = bool(preamble[9] & PREAMBLE_FLAG_ECHO)  # The client wants the timestamps echoed
+        self.control = bool(preamble[9] & PREAMBLE_FLAG_CONTROL)  # The client accepts control requests
+        self.pending = bytearray()  # Received data, which don't form a complete frame yet
+        self.timestamp = None       # Timestamp frame, which precedes the next data frame
+        self.dictionary = None      # Static dictionary of the session (see --dict)
+
+    def feed(self, data, recv_ns):
+        # Yields (decoded data, timestamp) for all complete data frames received so far.
+        # The timestamp is (sequence number, first byte time, send time, our receive time) or None.
+        # A malformed frame raises ValueError, after the frames preceding it were yielded (the session is closed,
+        # the other sessions go on).
+        self.pending += data
+        pos = 0
+        try:
+            while len(self.pending) - pos >= FRAME_HEADER.size:
+                frame_type, length = FRAME_HEADER.unpack_from(self.pending, pos)
+                if length > MAX_FRAME_SIZE:  # We don't buffer whatever length a broken client sends
+                    raise ValueError(f"frame of {length} bytes (max. {MAX_FRAME_SIZE})")
+                if len(self.pending) - pos - FRAME_HEADER.size < length:
+                    break  # The frame is not complete yet
+                payload = bytes(self.pending[pos + FRAME_HEADER.size:pos + FRAME_HEADER.size + length])
+                pos += FRAME_HEADER.size + length
+                try:
+                    block = self.decode(frame_type, payload, recv_ns)
+                except (struct.error, IndexError) + LZ4_ERRORS as e:  # A truncated payload or a corrupted LZ4 block
+                    raise ValueError(f"malformed frame of type {frame_type}: {e}") from e
+                if block is not None:
+                    yield block, self.timestamp
+                    self.timestamp = None
+        finally:
+            del self.pending[:pos]
+
+    def decode(self, frame_type, payload, recv_ns):
+        # Returns the data of a data frame, or None for the other frames
+        if frame_type == FRAME_TIMESTAMP:
+            self.timestamp = TIMESTAMP_PAYLOAD.unpack_from(payload) + (recv_ns,)
+            return None
+        if frame_type == FRAME_RAW:
+            return payload
+        if frame_type == FRAME_LZ4:
+            raw_len = struct.unpack_from("<I", payload)[0]
+            return lz4_decompress(payload[4:], raw_len)
+        if frame_type == FRAME_DICTIONARY:
+            dict_id = struct.unpack_from("<I", payload)[0]
+            self.dictionary = dictionaries.get(dict_id)
+            if self.dictionary is None:
+                raise ValueError(f"unknown dictionary {dict_id:08x} (load it by --dict)")
+            return None
+        if frame_type == FRAME_LZ4_DICT:
+            if self.dictionary is None:
+                raise ValueError("dictionary frame missing")
+            raw_len = struct.unpack_from("<I", payload)[0]
+            return lz4_decompress(payload[4:], raw_len, self.dictionary)
+        raise ValueError(f"unknown frame type {frame_type}")
+
+
+class MergeInput:
+    # Records of one session waiting in the merge
+    def __init__(self, order, name):
+        self.order = order          # Tie-breaker for records with the same timestamp
+        self.name = name            # Prepended to the merged records when --merge_source is used
+        self.queue = deque()        # Records (timestamp, arrival time, line) not merged yet
+        self.partial = b""          # Incomplete line received so far
+        self.last_ts = None         # Timestamp of the last record received
+        self.last_arrival = 0.0     # Time when the last data were received (or when the session started)
+        self.closed = False
+
+
+class MergeSink:
+    # Bounded-delay k-way merge of timestamped records (lines) from concurrent sessions into one file.
+    # Each line starts with a timestamp. A heap holds the oldest pending record of each session.
+    # A record is written when no open session can send an older record anymore, i.e., when its timestamp
+    # is not greater than the watermark (the lowest "last seen" timestamp of the active sessions),
+    # or when it has waited for longer than max_delay seconds. A session, which didn't send anything
+    # for max_delay seconds, doesn't hold the watermark back.
+    def __init__(self, file_name, max_delay, hex_timestamps, add_source):
+        self.out = open(file_name, 'ab')
+        self.max_delay = max_delay
+        self.hex_timestamps = hex_timestamps
+        self.add_source = add_source
+        self.inputs = {}   # Session id -> MergeInput
+        self.heap = []     # (timestamp, order, session id) of the oldest record of each session with records
+        self.order = 0
+        self.records = 0   # Number of records written
+
+    def parse_timestamp(self, line):
+        token = line.split(maxsplit=1)[0] if line.strip() else b""
+        try:
+            return int(token, 16) if self.hex_timestamps else float(token)
+        except ValueError:
+            return None
+
+    def add_session(self, sid, name, now):
+        self.inputs[sid] = MergeInput(self.order, name)
+        self.inputs[sid].last_arrival = now
+        self.order += 1
+
+    def feed(self, sid, data, now):
+        inp = self.inputs[sid]
+        inp.last_arrival = now
+        lines = (inp.partial + data).split(b"\n")
+        inp.partial = lines.pop()  # The last element is an incomplete line (or empty)
+        for line in lines:
+            self.add_record(sid, inp, line + b"\n", now)
+
+    def end_session(self, sid, now):
+        inp = self.inputs[sid]
+        if inp.partial:
+            self.add_record(sid, inp, inp.partial + b"\n", now)
+            inp.partial = b""
+        inp.closed = True
+        if not inp.queue:
+            del self.inputs[sid]
+
+    def add_record(self, sid, inp, line, now):
+        ts = self.parse_timestamp(line)
+        if ts is None:  # A line without a timestamp (e.g., a continuation line) stays after the previous record
+            ts = inp.last_ts if inp.last_ts is not None else 0
+        elif inp.last_ts is not None and ts < inp.last_ts:  # We keep the order of records within a session
+            ts = inp.last_ts
+        inp.last_ts = ts
+        if self.add_source:
+            line = inp.name.encode() + b" " + line
+        if not inp.queue:
+            heapq.heappush(self.heap, (ts, inp.order, sid))
+        inp.queue.append((ts, now, line))
+
+    def emit(self, now):
+        # Writes all records, which can be written now
+        watermark = None
+        waiting = False  # An active session hasn't sent its first record yet, i.e., it can send anything
+        for inp in self.inputs.values():
+            if not inp.closed and now - inp.last_arrival < self.max_delay:
+                if inp.last_ts is None:
+                    waiting = True
+                elif watermark is None or inp.last_ts < watermark:
+                    watermark = inp.last_ts
+        written = False
+        while self.heap:
+            ts, order, sid = self.heap[0]
+            inp = self.inputs[sid]
+            _, arrival, line = inp.queue[0]
+            if (waiting or (watermark is not None and ts > watermark)) and now - arrival < self.max_delay:
+                break
+            heapq.heappop(self.heap)
+            inp.queue.popleft()
+            self.out.write(line)
+            self.records += 1
+            written = True
+            if inp.queue:
+                heapq.heappush(self.heap, (inp.queue[0][0], inp.order, sid))
+            elif inp.closed:
+                del self.inputs[sid]
+        if written:
+            self.out.flush()
+
+
+class DirectWriterPool:
+    # Pool of page-aligned buffers and of writer threads for files written with O_DIRECT.
+    # The received data are copied to a buffer of the pool. A full buffer is written by a writer thread,
+    # so the receiving loop never waits for the page cache writeback. When no buffer is free, the data wait
+    # in the backlog of the file, and the session isn't read till it gets a buffer (see DirectFile.drain()),
+    # i.e., the client is slowed down by TCP flow control. The waiting sessions get the free buffers in turn.
+    # A session keeps its partially filled buffer between the writes. When all the buffers are kept so and none
+    # is being written (more sessions than buffers), the fullest one is released: its aligned part is written,
+    # and the rest goes to the next buffer of its session. So the idle sessions don't starve the busy ones.
+    BUFFER_SIZE = 4 * 1024 * 1024
+    ALIGNMENT = 4096  # File offsets and lengths of O_DIRECT writes must be multiples of the logical block size
+
+    def __init__(self, threads, wait):
+        self.wait = wait  # The files are written by the WriteScheduler thread, which waits for a free buffer
+        self.free = queue.Queue()
+        for _ in range(4 * threads):
+            self.free.put(mmap.mmap(-1, self.BUFFER_SIZE))  # mmap memory is page-aligned
+        self.lock = threading.Condition()  # Guards the following, and the buffers of the files
+        self.holders = set()    # Files keeping a partially filled buffer
+        self.waiting = deque()  # Files waiting for a buffer; they get the free ones in turn
+        self.in_flight = 0      # Buffers being written
+        self.jobs = queue.Queue()
+        for _ in range(threads):
+            threading.Thread(target=self.run, daemon=True).start()
+
+    def run(self):
+        while True:
+            file, buffer, length, offset, pooled = self.jobs.get()
+            if buffer is None:  # All data of the file were submitted
+                file.finish(length)
+                continue
+            try:
+                with memoryview(buffer) as view:
+                    os.pwrite(file.fd, view[:length], offset)
+            except OSError as e:
+                file.error = e
+            if pooled:
+                self.free.put(buffer)
+            with self.lock:
+                self.in_flight -= 1
+                self.lock.notify_all()
+            file.done()
+
+    def take(self, file):
+        # Returns a free buffer, or None when there is none, or when other files wait for one longer
+        # (called with the lock held)
+        if file not in self.waiting:
+            self.waiting.append(file)
+        if self.waiting[0] is not file:
+            return None
+        try:
+            buffer = self.free.get_nowait()
+        except queue.Empty:
+            others = [f for f in self.holders if f is not file]
+            if self.in_flight > 0 or not others:
+                return None
+            max(others, key=lambda f: f.used).release()  # No buffer would come back otherwise
+            try:
+                buffer = self.free.get_nowait()
+            except queue.Empty:
+                return None
+        self.waiting.popleft()
+        return buffer
+
+
+class DirectFile:
+    # File written with O_DIRECT via DirectWriterPool; it has the methods of a binary file used by Session
+    def __init__(self, file_name, pool):
+        self.fd = os.open(file_name, os.O_WRONLY | os.O_CREAT | os.O_TRUNC | os.O_DIRECT, 0o644)
+        self.file_name = file_name
+        self.pool = pool
+        self.buffer = None  # Buffer being filled
+        self.used = 0       # Bytes in the buffer
+        self.offset = 0     # File offset of the buffer
+        self.tail = b""     # Unaligned rest of the released buffer; it starts the next buffer
+        self.backlog = bytearray()  # Data waiting for a free buffer
+        self.pending = 0    # Buffers submitted to the writer threads and not written yet
+        self.written = threading.Condition()
+        self.error = None   # OSError of a writer thread
+
+    def write(self, data):
+        if self.error is not None:
+            raise self.error
+        with self.pool.lock:
+            if self.backlog:  # The data must keep their order
+                self.backlog += data
+            else:
+                with memoryview(data) as view:
+                    rest = self.fill(view)
+                    self.backlog += rest
+                    rest.release()
+            if self.pool.wait:
+                while not self.drain():
+                    self.pool.lock.wait(0.1)
+
+    def drain(self):
+        # Moves the backlog to the buffers as long as some are free; returns True when no data are waiting
+        with self.pool.lock:
+            if self.backlog:
+                with memoryview(self.backlog) as view:
+                    rest = self.fill(view)
+                    moved = len(view) - len(rest)
+                    rest.release()
+                del self.backlog[:moved]
+            return not self.backlog
+
+    def fill(self, view):
+        # Copies the data to the buffers; returns the rest, for which no buffer is free
+        while view:
+            if self.buffer is None:
+                self.buffer = self.pool.take(self)
+                if self.buffer is None:
+                    return view
+                self.used = len(self.tail)
+                self.buffer[:self.used] = self.tail
+                self.tail = b""
+                self.pool.holders.add(self)
+            n = min(len(view), DirectWriterPool.BUFFER_SIZE - self.used)
+            self.buffer[self.used:self.used + n] = view[:n]
+            self.used += n
+            view = view[n:]
+            if self.used == DirectWriterPool.BUFFER_SIZE:
+                self.submit(self.used)
+        return view
+
+    def release(self):
+        # Gives the partially filled buffer back: the aligned part is written, the rest waits in the tail
+        aligned = self.used - self.used % DirectWriterPool.ALIGNMENT
+        self.tail = bytes(self.buffer[aligned:self.used])
+        if aligned:
+            self.submit(aligned)
+        else:
+            self.pool.holders.discard(self)
+            self.pool.free.put(self.buffer)
+            self.buffer = None
+            self.used = 0
+
+    def submit(self, length, pooled=True):
+        with self.written:
+            self.pending += 1
+        self.pool.holders.discard(self)
+        self.pool.in_flight += 1
+        self.pool.jobs.put((self, self.buffer, length, self.offset, pooled))
+        self.offset += length
+        self.buffer = None
+        self.used = 0
+
+    def done(self):
+        with self.written:
+            self.pending -= 1
+            self.written.notify_all()
+
+    def flush(self):
+        pass  # The data are written when the buffer is full, or by close()
+
+    def close(self):
+        # The tail is padded to the alignment and written. We don't wait for it: a writer thread truncates the file
+        # to its real size and closes it, when all its buffers are written (see finish()).
+        with self.pool.lock:
+            if self in self.pool.waiting:
+                self.pool.waiting.remove(self)
+            pooled = self.buffer is not None
+            if not pooled and (self.tail or self.backlog):  # We don't wait for a free buffer either
+                self.buffer = mmap.mmap(-1, -(-(len(self.tail) + len(self.backlog)) // DirectWriterPool.ALIGNMENT)
+                                        * DirectWriterPool.ALIGNMENT)
+                self.buffer[:len(self.tail)] = self.tail
+                self.buffer[len(self.tail):len(self.tail) + len(self.backlog)] = self.backlog
+                self.used = len(self.tail) + len(self.backlog)
+                self.tail = b""
+                self.backlog = bytearray()
+            size = self.offset + self.used
+            if self.used:
+                padded = -(-self.used // DirectWriterPool.ALIGNMENT) * DirectWriterPool.ALIGNMENT
+                self.buffer[self.used:padded] = bytes(padded - self.used)
+                self.submit(padded, pooled)
+            elif pooled:
+                self.pool.holders.discard(self)
+                self.pool.free.put(self.buffer)
+                self.buffer = None
+        self.pool.jobs.put((self, None, size, 0, False))
+
+    def finish(self, size):
+        # Called by a writer thread after close(); the buffers of the file are ahead of us in the queue
+        with self.written:
+            self.written.wait_for(lambda: self.pending == 0)
+        try:
+            if self.error is None:
+                os.ftruncate(self.fd, size)
+        except OSError as e:
+            self.error = e
+        os.close(self.fd)
+        if self.error is not None:
+            print(f"ERROR: Unable to write file '{self.file_name}': {self.error}")
+
+
+class WriteScheduler:
+    # Writes the received data of all sessions to their files in a separate thread, so a session waiting for the disk
+    # doesn't delay receiving of the other sessions.
+    # A global memory budget limits the data waiting to be written. A session, whose waiting data reached its fair share
+    # of the budget, isn't read (see readable()), i.e., its client is slowed down by TCP flow control.
+    # The waiting data are written in deficit round-robin order: each session with waiting data gets the same
+    # share of the disk bandwidth, regardless of the size of its chunks.
+    # The echoes of the latency measurement are sent by this thread too, when the data they follow are written.
+    QUANTUM = 64 * 1024      # Bytes a session may write in one round
+    MIN_SHARE = 64 * 1024    # A session may always have at least this much data waiting
+
+    def __init__(self, budget):
+        self.budget = budget
+        self.sessions = 0        # Number of open sessions
+        self.pending = 0         # Bytes waiting to be written in all sessions
+        self.active = deque()    # Sessions with data waiting, in round-robin order
+        self.lock = threading.Condition()
+        threading.Thread(target=self.run, daemon=True).start()
+
+    def share(self):
+        return max(self.budget // max(self.sessions, 1), self.MIN_SHARE)
+
+    def readable(self, session):
+        return session.pending < self.share()
+
+    def open(self, session):
+        with self.lock:
+            self.sessions += 1
+
+    def enqueue(self, session, data, echo=None):
+        # The echo (the timestamp of the block, see Session.send_echo()) is sent when the data are written
+        with self.lock:
+            session.queue.append((data, echo))
+            session.pending += len(data)
+            self.pending += len(data)
+            if not session.scheduled:
+                session.scheduled = True
+                self.active.append(session)
+                self.lock.notify()
+
+    def close(self, session):
+        # The file is closed when all its data are written
+        with self.lock:
+            self.sessions -= 1
+            session.closing = True
+            if session.scheduled:
+                return
+        self.close_file(session)
+
+    @staticmethod
+    def close_file(session):
+        try:
+            session.file.close()
+        except OSError as e:
+            print(f"ERROR: Unable to write file '{session.file_name}': {e}")
+        session.conn.close()
+
+    def run(self):
+        while True:
+            with self.lock:
+                while not self.active:
+                    self.lock.wait()
+                session = self.active.popleft()
+                session.deficit += self.QUANTUM
+            written = 0
+            while session.queue and len(session.queue[0][0]) <= session.deficit:
+                data, echo = session.queue.popleft()
+                session.deficit -= len(data)
+                written += len(data)
+                if session.error is None:
+                    try:
+                        session.file.write(data)
+                        if echo is not None:
+                            session.send_echo(echo)
+                    except OSError as e:
+                        session.error = e
+                        print(f"ERROR: Unable to write file '{session.file_name}': {e}")
+            with self.lock:
+                session.pending -= written
+                self.pending -= written
+                if session.queue:
+                    self.active.append(session)
+                    continue
+                session.scheduled = False
+                session.deficit = 0  # An idle session doesn't accumulate the right to write
+                closing = session.closing
+            if closing:
+                self.close_file(session)
+
+
+class SessionCatalog:
+    # SQLite catalog of the sessions (see catalog_query.py). A session is inserted when it starts (with end_time NULL)
+    # and updated when it ends. Optionally, the catalog holds a sparse index of the offsets in the file
+    # of the data received at a given time, for seeking in long sessions.
+    SCHEMA = """
+        CREATE TABLE IF NOT EXISTS sessions (
+            id INTEGER PRIMARY KEY,
+            file TEXT NOT NULL,
+            peer_ip TEXT NOT NULL,
+            peer_port INTEGER NOT NULL,
+            start_time REAL NOT NULL,  -- Unix time
+            end_time REAL,             -- NULL while the session is open
+            bytes INTEGER,
+            wire_bytes INTEGER,
+            sha256 TEXT
+        );
+        CREATE INDEX IF NOT EXISTS sessions_start ON sessions (start_time);
+        CREATE INDEX IF NOT EXISTS sessions_peer_start ON sessions (peer_ip, start_time);
+        CREATE INDEX IF NOT EXISTS sessions_open ON sessions (start_time) WHERE end_time IS NULL;
+        CREATE TABLE IF NOT EXISTS offsets (
+            session INTEGER NOT NULL,
+            time REAL NOT NULL,        -- Unix time of receiving the data at the offset
+            offset INTEGER NOT NULL,
+            PRIMARY KEY (session, time)
+        ) WITHOUT ROWID;
+        CREATE TABLE IF NOT EXISTS meta (
+            key TEXT PRIMARY KEY,
+            value REAL NOT NULL
+        );
+        INSERT OR IGNORE INTO meta VALUES ('max_duration', 0);
+        """
+
+    def __init__(self, file_name, index_interval):
+        self.db = sqlite3.connect(file_name)
+        self.db.execute("PRAGMA journal_mode=WAL")  # The catalog can be queried while the script is running
+        self.db.execute("PRAGMA synchronous=NORMAL")
+        self.db.executescript(self.SCHEMA)
+        self.index_interval = index_interval  # Seconds between the entries of the offset index; 0 = no index
+
+    def start_session(self, session):
+        with self.db:
+            cursor = self.db.execute("INSERT INTO sessions (file, peer_ip, peer_port, start_time) VALUES (?, ?, ?, ?)",
+                                     (os.path.abspath(session.file_name), session.addr[0], session.addr[1],
+                                      session.start_time))
+        session.catalog_id = cursor.lastrowid
+        session.hash = hashlib.sha256()
+        session.next_index_time = session.start_time
+
+    def add_data(self, session, data):
+        # Called before the data are appended to the file
+        session.hash.update(data)
+        if self.index_interval > 0 and data:
+            now = time.time()
+            if now >= session.next_index_time:
+                session.offset_index.append((session.catalog_id, now, session.data_total))
+                session.next_index_time = now + self.index_interval
+
+    def end_session(self, session):
+        end_time = time.time()
+        with self.db:
+            self.db.execute("UPDATE sessions SET end_time = ?, bytes = ?, wire_bytes = ?, sha256 = ? WHERE id = ?",
+                            (end_time, session.data_total, session.wire_total, session.hash.hexdigest(),
+                             session.catalog_id))
+            self.db.execute("UPDATE meta SET value = MAX(value, ?) WHERE key = 'max_duration'",
+                            (end_time - session.start_time,))
+            self.db.executemany("INSERT OR IGNORE INTO offsets VALUES (?, ?, ?)", session.offset_index)
+
+
+class OverloadControl:
+    # When the data waiting to be written (see WriteScheduler) exceed a half of the memory budget, we ask the clients
+    # with the control channel to cut the volume of data at the source: to lower the verbosity, to pause bulk
+    # transfers and to flush less often. When the waiting data drop below a tenth of the budget, the requests
+    # are withdrawn. (Clients without the control channel are throttled by TCP flow control only.)
+    HIGH_WATERMARK = 0.5
+    LOW_WATERMARK = 0.1
+
+    def __init__(self, verbosity, flush_interval_ms):
+        self.verbosity = verbosity
+        self.flush_interval_ms = flush_interval_ms
+        self.overloaded = False
+
+    def requests(self):
+        if self.overloaded:
+            return (CONTROL_MESSAGE_U8.pack(SERVER_MESSAGE_VERBOSITY, 1, self.verbosity) +
+                    CONTROL_MESSAGE_U8.pack(SERVER_MESSAGE_BULK_PAUSE, 1, 1) +
+                    CONTROL_MESSAGE_U32.pack(SERVER_MESSAGE_FLUSH_INTERVAL, 4, self.flush_interval_ms))
+        return (CONTROL_MESSAGE_U8.pack(SERVER_MESSAGE_VERBOSITY, 1, 255) +
+                CONTROL_MESSAGE_U8.pack(SERVER_MESSAGE_BULK_PAUSE, 1, 0) +
+                CONTROL_MESSAGE_U32.pack(SERVER_MESSAGE_FLUSH_INTERVAL, 4, 0))
+
+    def update(self, sessions):
+        load = writeScheduler.pending / writeScheduler.budget
+        if self.overloaded == (load > self.LOW_WATERMARK if self.overloaded else load > self.HIGH_WATERMARK):
+            return
+        self.overloaded = not self.overloaded
+        print(f"{'Overloaded' if self.overloaded else 'Not overloaded anymore'} "
+              f"({bytes2human_readable(writeScheduler.pending)} waiting to be written)")
+        for session in sessions:
+            session.send_control(self.requests())
+
+
+class Session:
+    # One client connection; the received data are written to a new file
+    def __init__(self, conn, addr, file_name):
+        self.conn = conn
+        self.addr = addr
+        self.file_name = file_name
+        self.file = open_output_file(file_name)
+        self.data_total = 0
+        self.wire_total = 0
+        self.head = b""      # Start of the session; it tells us whether the session is framed
+        self.decoder = None  # FrameDecoder of a framed session
+        self.start_ns = time.monotonic_ns()
+        self.capture = None  # Capture of the traffic shape (see --record)
+        if recordCapture:
+            self.capture = open(file_name + ".rec", 'w')
+            self.capture.write(f"# FVS capture 1\n# peer {addr[0]}:{addr[1]}\n"
+                               f"# arrival_us wire_bytes data_bytes\n")
+        self.queue = deque()   # Data waiting to be written by WriteScheduler
+        self.pending = 0       # Bytes in the queue
+        self.deficit = 0       # Bytes the session may write in the current round of WriteScheduler
+        self.scheduled = False  # The session is in the round-robin of WriteScheduler
+        self.closing = False
+        self.error = None
+        self.send_lock = threading.Lock()
+        if writeScheduler is not None:
+            writeScheduler.open(self)
+        self.start_time = time.time()
+        self.offset_index = []  # Entries of the offset index of SessionCatalog
+        if sessionCatalog is not None:
+            sessionCatalog.start_session(self)
+        if mergeSink is not None:
+            mergeSink.add_session(id(self), f"{addr[0]}:{addr[1]}", time.monotonic())
+        print(f"Got connection from {addr[0]}:{addr[1]}")
+
+    def readable(self):
+        if writeScheduler is not None:
+            return writeScheduler.readable(self)
+        return not isinstance(self.file, DirectFile) or self.file.drain()
+
+    def receive(self):
+        # Reads the data available on the connection. Returns False when the client disconnected.
+        try:
+            data = self.conn.recv(4096)
+            if not data:  # Empty data means that the client has disconnected
+                return False
+            recv_ns = time.monotonic_ns()
+            self.wire_total += len(data)
+            data_before = self.data_total
+            self.process(data, recv_ns)
+            if self.capture is not None:
+                # Arrival time in microseconds since the start of the session, bytes received, bytes of data
+                self.capture.write(f"{(recv_ns - self.start_ns) // 1000} {len(data)} "
+                                   f"{self.data_total - data_before}\n")
+            return True
+        except (ConnectionResetError, BrokenPipeError):
+            return False
+        except ValueError as e:
+            print(f"ERROR: Corrupted framed session from {self.addr[0]}:{self.addr[1]}: {e}")
+            return False
+        except OSError as e:
+            print(f"ERROR: Unable to write file '{self.file_name}': {e}")
+            return False
+
+    def process(self, data, recv_ns):
+        # Decodes the received data (when the session is framed) and writes them to the file
+        if self.head is not None:
+            self.head += data
+            if len(self.head) < PREAMBLE_SIZE and FRAME_MAGIC.startswith(self.head[:len(FRAME_MAGIC)]):
+                return  # We need more data to decide
+            if self.head.startswith(FRAME_MAGIC):
+                self.decoder = FrameDecoder(self.head)
+                data = self.head[PREAMBLE_SIZE:]
+                if overloadControl is not None and overloadControl.overloaded:
+                    self.send_control(overloadControl.requests())
+            else:
+                data = self.head
+            self.head = None
+        if self.decoder is None:
+            self.write(data)
+            return
+        for block, timestamp in self.decoder.feed(data, recv_ns):
+            echo = timestamp if self.decoder.echo else None
+            self.write(block, echo)
+
+    def send_echo(self, timestamp):
+        # Called when the block, which the timestamp precedes, was written to the file (by WriteScheduler's thread
+        # with --memory_budget). The data are handed over to the OS before we report the time.
+        self.file.flush()
+        self.send(ECHO_MESSAGE.pack(SERVER_MESSAGE_ECHO, ECHO_MESSAGE.size - 3, *timestamp, time.monotonic_ns()))
+
+    def send_control(self, requests):
+        if self.decoder is not None and self.decoder.control:
+            self.send(requests)
+
+    def send(self, message):
+        with self.send_lock:  # The echoes may be sent by WriteScheduler's thread
+            try:
+                self.conn.sendall(message)
+            except OSError:
+                pass  # The connection is broken; we find out when reading from it
+
+    def write(self, data, echo=None):
+        if sessionCatalog is not None:
+            sessionCatalog.add_data(self, data)
+        if writeScheduler is not None:
+            writeScheduler.enqueue(self, data, echo)
+        else:
+            self.file.write(data)
+            if echo is not None:
+                self.send_echo(echo)
+        self.data_total += len(data)
+        if mergeSink is not None:
+            mergeSink.feed(id(self), data, time.monotonic())
+
+    def close(self):
+        if self.head:  # The session was shorter than the preamble
+            self.write(self.head)
+        if mergeSink is not None:
+            mergeSink.end_session(id(self), time.monotonic())
+        if sessionCatalog is not None:
+            sessionCatalog.end_session(self)
+        if writeScheduler is not None:
+            writeScheduler.close(self)  # The connection stays open for the echoes till the data are written
+        else:
+            WriteScheduler.close_file(self)
+        if self.capture is not None:
+            self.capture.close()
+        if self.decoder is not None:
+            print(f"    Received total from {self.addr[0]}:{self.addr[1]}: {bytes2human_readable(self.data_total)} "
+                  f"(on the wire: {bytes2human_readable(self.wire_total)})")
+        else:
+            print(f"    Received total from {self.addr[0]}:{self.addr[1]}: {bytes2human_readable(self.data_total)}")
+
+
+def open_output_file(file_name):
+    global directWriterPool
+    if directWriterPool is not None:
+        try:
+            return DirectFile(file_name, directWriterPool)
+        except OSError as e:  # E.g., the file system doesn't support O_DIRECT
+            if e.errno != errno.EINVAL:
+                raise
+            print(f"WARNING: O_DIRECT isn't supported for '{file_name}', using buffered writes")
+            directWriterPool = None
+    return open(file_name, 'wb')
+
+
+def new_file_name():
+    # Construct the file name
+    name = ""
+    if filePath != "":
+        name = filePath + '/'
+    now = datetime.now()
+    #                                  date and time             first 4 digits of microseconds
+    name += filePrefix + now.strftime("_%y%m%d_%H%M%S") + '.' + now.strftime('%f')[:4]
+    candidate = name
+    suffix = 1
+    while os.path.exists(candidate + ("." + fileExt if fileExt != "" else "")):  # Concurrent sessions
+        candidate = f"{name}_{suffix}"
+        suffix += 1
+    if fileExt != "":
+        candidate += "." + fileExt
+    return candidate
+
+
 signal.signal(signal.SIGINT, signal_handler)  # Handling Ctrl+C
 
 # Global variables
@@ -88,6 +924,15 @@ fileExt = "txt"
 bindIP = "0.0.0.0"  # Standard loopback interface address (localhost)
 bindPort = 65432    # Port to listen on (non-privileged ports are > 1023)
 fileName = ""       # Initializing the variable to avoid a warning
+mergeSink = None    # MergeSink when --merge is used
+mergeDelay = 2.0    # Max. time (in seconds) a record waits in the merge
+sessionCatalog = None  # SessionCatalog when --catalog is used
+overloadControl = None  # OverloadControl when --overload_control is used
+writeScheduler = None  # WriteScheduler when --memory_budget is used
+directWriterPool = None  # DirectWriterPool when --direct_io is used
+directIOThreads = 4
+recordCapture = False  # Write the capture of the traffic shape of each session to a .rec file
+dictionaries = {}  # ID -> static dictionary loaded by --dict
 
 # Create the command line argument parser
 parser = argparse.ArgumentParser(prog="file_via_socket",
@@ -100,6 +945,35 @@ parser.add_argument('--ext', type=str, help=f'extension for the file name; defau
 parser.add_argument('--bind_ip', type=check_valid_ip, help=f'local IP to bind the socket listener to; defaults to {bindIP}')
 parser.add_argument('--bind_port', type=check_port_value,
                     help=f'local port to listen to connection on; values: 1024..65535; defaults to {bindPort}')
+parser.add_argument('--merge', type=str,
+                    help='file, to which timestamped lines of all concurrent sessions are merged in timestamp order')
+parser.add_argument('--merge_delay', type=float,
+                    help=f'max. time in seconds a line waits in the merge for older lines; defaults to {mergeDelay}')
+parser.add_argument('--merge_hex', action='store_true',
+                    help='timestamps at the start of the lines are hexadecimal numbers (decimal by default)')
+parser.add_argument('--merge_source', action='store_true',
+                    help='prepend the address of the client to each merged line')
+parser.add_argument('--record', action='store_true',
+                    help='record size and arrival time of each received chunk to a .rec file next to the data file '
+                         '(for replay_app_Linux_or_Win)')
+if hasattr(os, 'O_DIRECT'):  # Linux only
+    parser.add_argument('--direct_io', action='store_true',
+                        help='write the files with O_DIRECT, bypassing the page cache (for huge captures)')
+    parser.add_argument('--direct_io_threads', type=int,
+                        help=f'number of writer threads for --direct_io; defaults to {directIOThreads}')
+parser.add_argument('--memory_budget', type=float,
+                    help='write the files in a separate thread, with at most MEMORY_BUDGET MB of received data waiting '
+                         'to be written; the sessions share the budget and the disk fairly')
+parser.add_argument('--overload_control', type=int, metavar='VERBOSITY',
+                    help='when a half of the memory budget is used, ask the clients to lower the verbosity to VERBOSITY, '
+                         'to pause bulk transfers and to flush at most every 100 ms (needs --memory_budget)')
+parser.add_argument('--catalog', type=str,
+                    help='SQLite file, to which the sessions are recorded (peer, time, size, hash); see catalog_query.py')
+parser.add_argument('--catalog_index', type=float,
+                    help='record the offset in the file of the data received every CATALOG_INDEX seconds to the catalog')
+parser.add_argument('--dict', type=str, action='append', metavar='FILE',
+                    help='static dictionary (a .dict file created by train_dictionary.py) for the sessions compressed '
+                         'against it; may be given several times')
 # Parse the command line arguments
 args = parser.parse_args()
 # Store command line arguments values
@@ -113,49 +987,69 @@ if args.bind_ip is not None:
     bindIP = args.bind_ip
 if args.bind_port is not None:
     bindPort = args.bind_port
+if args.merge_delay is not None:
+    mergeDelay = args.merge_delay
+if getattr(args, 'direct_io_threads', None) is not None:
+    directIOThreads = max(1, args.direct_io_threads)
+if args.catalog is not None:
+    sessionCatalog = SessionCatalog(args.catalog, args.catalog_index if args.catalog_index is not None else 0)
+if args.memory_budget is not None:
+    writeScheduler = WriteScheduler(int(args.memory_budget * 1024 * 1024))
+if getattr(args, 'direct_io', False):
+    directWriterPool = DirectWriterPool(directIOThreads, writeScheduler is not None)
+if args.overload_control is not None:
+    if writeScheduler is None:
+        print("ERROR: --overload_control needs --memory_budget")
+        exit(1)
+    overloadControl = OverloadControl(max(0, min(args.overload_control, 255)), 100)
+if args.record:
+    recordCapture = True
+for dictFile in args.dict or []:
+    try:
+        with open(dictFile, 'rb') as f:
+            dictionary = f.read()[-MAX_DICTIONARY_SIZE:]
+    except OSError as e:
+        print(f"ERROR: Unable to read the dictionary '{dictFile}': {e}")
+        exit(1)
+    dictionaries[dictionary_id(dictionary)] = dictionary
+    print(f"Dictionary {dictFile}: {len(dictionary)} bytes, ID {dictionary_id(dictionary):08x}")
+if args.merge is not None:
+    mergeSink = MergeSink(args.merge, mergeDelay, args.merge_hex, args.merge_source)
 
 print(f"Waiting for connection on {bindIP}:{bindPort}\n"
        "(Press Ctrl+C to terminate)")
 
+sessions = {}  # Connection socket -> Session
+
 with socket.socket(socket.AF_INET, socket.SOCK_STREAM) as s:
     #  Set the IP socket
     s.bind((bindIP, bindPort))
-    s.listen(1)
-    while True:  # The outer cycle is for each socket connection, i.e., for each file
-        while True:
-            # We are using "select" because if we called s.accept() directly, it wouldn't be terminated by Ctrl+C
-            ready, _, _ = select([s], [], [], 1)  # Check if we have an incoming connection; timeout set to 1 sec
-            if ready:
+    s.listen(64)
+    while True:  # Each session (socket connection) is written to its own file; sessions can run concurrently
+        # We are using "select" because if we called s.accept() or recv() directly, they wouldn't be terminated
+        # by Ctrl+C. Timeout is 1 sec (shorter when merging, so the merge isn't delayed).
+        # Sessions over their share of the memory budget, or waiting for a free buffer of --direct_io,
+        # aren't read until their data are written.
+        readable = [conn for conn, session in sessions.items() if session.readable()]
+        timeout = 1 if mergeSink is None else 0.1
+        if len(readable) < len(sessions):
+            timeout = 0.01  # We check often whether the throttled sessions can be read again
+        ready, _, _ = select([s] + readable, [], [], timeout)
+        for sock in ready:
+            if sock is s:  # We have an incoming connection
                 conn, addr = s.accept()  # Connection object is returned
-                break  # We have a connection, let's handle incoming data
-
-        # Construct the file name
-        fileName = ""
-        if filePath != "":
-            fileName = filePath + '/'
-        now = datetime.now()
-#                                             date and time             first 4 digits of microseconds
-        fileName += filePrefix + now.strftime("_%y%m%d_%H%M%S") + '.' + now.strftime('%f')[:4]
-        if fileExt != "":
-            fileName += "." + fileExt
-        try:
-            with conn, open(fileName, 'wb') as f:
-                print(f"Got connection from {addr[0]}:{addr[1]}")
-                dataTotal = 0
-                while True:  # Reading data sent by client via the socket
-                    try:
-                        data = conn.recv(4096)
-                        if data:
-                            f.write(data)
-                            dataTotal += len(data)
-                        if not data:  # Empty data means that the client has disconnected
-                            break
-                    except ConnectionResetError:
-                        break
-                print(f"    Received total: {bytes2human_readable(dataTotal)}")
-        except FileNotFoundError:
-            print(f"ERROR: Unable to open file '{fileName}'")
-            exit(1)
-        except PermissionError:
-            print(f"ERROR: Permission error when opening file '{fileName}'")
-            exit(1)
+                fileName = new_file_name()
+                try:
+                    sessions[conn] = Session(conn, addr, fileName)
+                except FileNotFoundError:
+                    print(f"ERROR: Unable to open file '{fileName}'")
+                    exit(1)
+                except PermissionError:
+                    print(f"ERROR: Permission error when opening file '{fileName}'")
+                    exit(1)
+            elif not sessions[sock].receive():
+                sessions.pop(sock).close()
+        if overloadControl is not None:
+            overloadControl.update(sessions.values())
+        if mergeSink is not None:
+            mergeSink.emit(time.monotonic())
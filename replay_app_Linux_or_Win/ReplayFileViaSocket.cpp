@@ -0,0 +1,247 @@
+/*
+Replays sessions recorded by the server script (file_via_socket.py --record) against a server via FileViaSocket.
+Each recorded chunk is written and flushed at its recorded time (optionally scaled), so the server sees
+the same traffic shape (bursts, many small flushes) as in production.
+Details are explained on GitHub: https://github.com/viktor-nikolov/lwIP-file-via-socket
+
+Tested (and ready for compilation) on Windows 11 (MinGW toolchain) and Ubuntu 22.04 (gcc toolchain).
+
+BSD 2-Clause License:
+
+Copyright (c) 2024 Viktor Nikolov
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+#include <chrono>
+#include <thread>
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+#include "FileViaSocket.h"
+
+#ifdef __WIN32__
+#   include <winsock2.h>
+#else
+#   include <csignal>
+#endif
+
+/* One recorded session: the chunks as the server received them, and the data of the session.
+   When the file with the received data exists next to the capture, the chunks are replayed with the original data.
+   Otherwise, they are filled with a repeated sequence from 'A' to 'Z'. */
+struct Capture {
+	struct Chunk {
+		long long arrivalUs; // Time of arrival since the start of the session
+		std::size_t bytes;   // Bytes of data (i.e., decompressed) in the chunk
+	};
+	std::string       name;
+	std::vector<Chunk> chunks;
+	std::string       data;
+	std::size_t       totalBytes{ 0 };
+};
+
+struct Options {
+	std::string       serverAddress;
+	unsigned short    serverPort{ 65432 }; // The server script file_via_socket.py uses port 65432 by default.
+	double            timeScale{ 1.0 };    // 1 = real timing, 0.5 = twice as fast, 0 = no waiting at all
+	unsigned          concurrency{ 0 };    // Number of concurrent sessions; 0 = one session per capture
+	unsigned          repeat{ 1 };         // Each concurrent session replays its capture this many times
+	SocketBuffer::Compression compression{ SocketBuffer::Compression::None };
+};
+
+static bool loadCapture( const std::string &fileName, Capture &capture )
+{
+	std::ifstream in( fileName );
+	if( !in )
+		return false;
+	capture.name = fileName;
+	std::string line;
+	while( std::getline( in, line ) ) {
+		if( line.empty() || line[0] == '#' )
+			continue;
+		std::istringstream fields( line );
+		long long arrivalUs;
+		std::size_t wireBytes, dataBytes;
+		if( !(fields >> arrivalUs >> wireBytes >> dataBytes) )
+			return false;
+		if( dataBytes == 0 ) // E.g., the chunk contained only the start of a frame
+			continue;
+		capture.chunks.push_back( { arrivalUs, dataBytes } );
+		capture.totalBytes += dataBytes;
+	}
+
+	// The capture is named <data file>.rec
+	const std::string suffix{ ".rec" };
+	if( fileName.size() > suffix.size() && fileName.compare( fileName.size() - suffix.size(), suffix.size(), suffix ) == 0 ) {
+		std::ifstream dataFile( fileName.substr( 0, fileName.size() - suffix.size() ), std::ios::binary );
+		if( dataFile ) {
+			std::ostringstream content;
+			content << dataFile.rdbuf();
+			if( content.str().size() >= capture.totalBytes )
+				capture.data = content.str();
+		}
+	}
+	if( capture.data.empty() ) {
+		capture.data.resize( capture.totalBytes );
+		for( std::size_t i = 0; i < capture.totalBytes; i++ )
+			capture.data[i] = (i % 64 == 63) ? '\n' : 'A' + i % 26;
+	}
+	return true;
+}
+
+static std::atomic<unsigned long long> ReplayedBytes{ 0 };
+static std::atomic<unsigned>           FailedSessions{ 0 };
+
+static void replaySession( const Options &options, const Capture &capture )
+{
+	for( unsigned r = 0; r < options.repeat; r++ ) {
+		try {
+			FileViaSocket f;
+			f.setCompression( options.compression );
+			f.open( options.serverAddress, options.serverPort );
+
+			const auto start = std::chrono::steady_clock::now();
+			std::size_t offset = 0;
+			for( const Capture::Chunk &chunk : capture.chunks ) {
+				if( options.timeScale > 0 )
+					std::this_thread::sleep_until( start + std::chrono::microseconds(
+						static_cast<long long>( chunk.arrivalUs * options.timeScale ) ) );
+				f.write( capture.data.data() + offset, chunk.bytes );
+				f.flush(); // Each chunk reached the server separately, so we send it separately
+				if( !f ) // The stream reports a socket error by badbit, not by an exception
+					break;
+				offset += chunk.bytes;
+			}
+			f.close();
+			if( !f ) {
+				std::cerr << "Error on replaying " << capture.name << ": sending failed after " << offset << " bytes" << std::endl;
+				FailedSessions++;
+				return;
+			}
+			ReplayedBytes += offset;
+		}
+		catch( const std::exception& e ) {
+			std::cerr << "Error on replaying " << capture.name << ": " << e.what() << std::endl;
+			FailedSessions++;
+			return;
+		}
+	}
+}
+
+static void printUsage()
+{
+	std::cerr << "usage: ReplayFileViaSocket SERVER_IP [-p PORT] [-s TIME_SCALE] [-c CONCURRENCY] [-r REPEAT]" << std::endl
+	          << "                           [-z none|fast|strong|adaptive] CAPTURE.rec [CAPTURE.rec ...]" << std::endl
+	          << std::endl
+	          << "  -p PORT         server port; defaults to 65432" << std::endl
+	          << "  -s TIME_SCALE   multiplies the recorded times; 1 = real timing (default), 0 = as fast as possible" << std::endl
+	          << "  -c CONCURRENCY  number of concurrent sessions; the captures are assigned round-robin;" << std::endl
+	          << "                  defaults to the number of captures" << std::endl
+	          << "  -r REPEAT       each session replays its capture REPEAT times; defaults to 1" << std::endl
+	          << "  -z COMPRESSION  compression of the replayed sessions; defaults to none" << std::endl;
+}
+
+int main( int argc, char* argv[] )
+{
+#ifdef __WIN32__
+	// Initiate use of the Winsock DLL
+	WSADATA wsaData;
+	int WSAresult = WSAStartup(MAKEWORD(2,2), &wsaData);
+	if( WSAresult != 0 ) {
+		std::cerr << "WSAStartup failed: " << WSAresult << std::endl;
+		return 1;
+	}
+#else
+	// A session closed by the server fails by badbit and is counted, instead of SIGPIPE ending the whole replay
+	std::signal( SIGPIPE, SIG_IGN );
+#endif
+
+	Options options;
+	std::vector<std::string> captureFiles;
+	for( int i = 1; i < argc; i++ ) {
+		const std::string arg{ argv[i] };
+		if( arg.size() == 2 && arg[0] == '-' && i + 1 < argc ) {
+			const char *value = argv[++i];
+			switch( arg[1] ) {
+				case 'p': options.serverPort  = static_cast<unsigned short>( std::atoi( value ) ); continue;
+				case 's': options.timeScale   = std::atof( value ); continue;
+				case 'c': options.concurrency = static_cast<unsigned>( std::atoi( value ) ); continue;
+				case 'r': options.repeat      = static_cast<unsigned>( std::atoi( value ) ); continue;
+				case 'z':
+					if( std::strcmp( value, "fast" ) == 0 )
+						options.compression = SocketBuffer::Compression::Fast;
+					else if( std::strcmp( value, "strong" ) == 0 )
+						options.compression = SocketBuffer::Compression::Strong;
+					else if( std::strcmp( value, "adaptive" ) == 0 )
+						options.compression = SocketBuffer::Compression::Adaptive;
+					else if( std::strcmp( value, "none" ) == 0 )
+						options.compression = SocketBuffer::Compression::None;
+					else {
+						printUsage();
+						return 1;
+					}
+					continue;
+				default:
+					printUsage();
+					return 1;
+			}
+		}
+		if( options.serverAddress.empty() )
+			options.serverAddress = arg;
+		else
+			captureFiles.push_back( arg );
+	}
+	if( options.serverAddress.empty() || captureFiles.empty() ) {
+		printUsage();
+		return 1;
+	}
+
+	std::vector<Capture> captures( captureFiles.size() );
+	for( std::size_t i = 0; i < captureFiles.size(); i++ ) {
+		if( !loadCapture( captureFiles[i], captures[i] ) ) {
+			std::cerr << "Error: Unable to read the capture " << captureFiles[i] << std::endl;
+			return 1;
+		}
+	}
+	if( options.concurrency == 0 )
+		options.concurrency = static_cast<unsigned>( captures.size() );
+
+	std::cout << "Replaying " << captures.size() << " capture(s) in " << options.concurrency
+	          << " concurrent session(s) to " << options.serverAddress << ":" << options.serverPort << std::endl;
+
+	const auto start = std::chrono::steady_clock::now();
+	std::vector<std::thread> sessions;
+	for( unsigned i = 0; i < options.concurrency; i++ )
+		sessions.emplace_back( replaySession, std::cref( options ), std::cref( captures[i % captures.size()] ) );
+	for( std::thread &session : sessions )
+		session.join();
+	const double seconds = std::chrono::duration<double>( std::chrono::steady_clock::now() - start ).count();
+
+	std::cout << "Replayed " << ReplayedBytes << " bytes in " << seconds << " s ("
+	          << ReplayedBytes / seconds / 1e6 << " MB/s)";
+	if( FailedSessions > 0 )
+		std::cout << ", " << FailedSessions << " session(s) failed";
+	std::cout << std::endl;
+
+	return FailedSessions > 0 ? 1 : 0;
+} // main
@@ -0,0 +1,134 @@
+# This script rebuilds snapshots of a memory region from a file received by file_via_socket.py,
+# which was sent by the class SnapshotViaSocket. The file contains only changed blocks of each snapshot.
+# For details see the GitHub repository https://github.com/viktor-nikolov/lwIP-file-via-socket
+#
+# Run the script with the command 'python3 snapshot_via_socket.py [params] file'.
+#
+# usage: snapshot_via_socket [-h] [--out_dir OUT_DIR] [--prefix PREFIX] [--last_only] [--deltas] file
+#
+# options:
+#   -h, --help              Show help message and exit
+#   --out_dir OUT_DIR       Path for storing the snapshot files; defaults to current working directory
+#   --prefix PREFIX         Prefix of the snapshot file names; defaults to "snapshot"
+#   --last_only             Store only the last complete snapshot
+#   --deltas                Store only the changed blocks of each snapshot (as "<offset> <length>" index + data)
+#
+# BSD 2-Clause License:
+#
+# Copyright (c) 2024 Viktor Nikolov
+#
+# Redistribution and use in source and binary forms, with or without
+# modification, are permitted provided that the following conditions are met:
+# 1. Redistributions of source code must retain the above copyright notice, this
+#    list of conditions and the following disclaimer.
+# 2. Redistributions in binary form must reproduce the above copyright notice,
+#    this list of conditions and the following disclaimer in the documentation
+#    and/or other materials provided with the distribution.
+# THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+# AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+# IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+# DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+# FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+# DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+# SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+# CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+# OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+# OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+import argparse
+import struct
+import sys
+
+SNAPSHOT_MAGIC = b"FVSN"
+SNAPSHOT_VERSION = 1
+HEADER = struct.Struct("<4sBBHIQI")  # magic, version, flags, reserved, sequence number, region size, block size
+BLOCK = struct.Struct("<QI")         # offset, length (or end marker, number of blocks)
+END_MARKER = 0xFFFFFFFFFFFFFFFF
+
+
+class FormatError(Exception):
+    pass
+
+
+def read_exact(f, n):
+    data = f.read(n)
+    if len(data) != n:
+        raise EOFError()
+    return data
+
+
+def read_snapshots(f):
+    # Generator yielding (sequence number, is full snapshot, region size, list of (offset, data))
+    while True:
+        header = f.read(HEADER.size)
+        if not header:
+            return
+        if len(header) != HEADER.size:
+            raise EOFError()
+        magic, version, flags, _, seq, region_size, block_size = HEADER.unpack(header)
+        if magic != SNAPSHOT_MAGIC or version != SNAPSHOT_VERSION:
+            raise FormatError(f"unexpected snapshot header at offset {f.tell() - HEADER.size}")
+        blocks = []
+        while True:
+            offset, length = BLOCK.unpack(read_exact(f, BLOCK.size))
+            if offset == END_MARKER:
+                if length != len(blocks):
+                    raise FormatError(f"snapshot {seq}: expected {length} blocks, got {len(blocks)}")
+                break
+            if offset + length > region_size:
+                raise FormatError(f"snapshot {seq}: block at offset {offset} exceeds the region")
+            blocks.append((offset, read_exact(f, length)))
+        yield seq, bool(flags & 1), region_size, blocks
+
+
+def main():
+    parser = argparse.ArgumentParser(prog="snapshot_via_socket",
+                                     description='Rebuilds snapshots of a memory region from a file '
+                                                 'received by file_via_socket.py.')
+    parser.add_argument('file', type=str, help='file received by file_via_socket.py')
+    parser.add_argument('--out_dir', type=str, default=".",
+                        help='path for storing the snapshot files; defaults to current working directory')
+    parser.add_argument('--prefix', type=str, default="snapshot",
+                        help='prefix of the snapshot file names; defaults to "snapshot"')
+    parser.add_argument('--last_only', action='store_true', help='store only the last complete snapshot')
+    parser.add_argument('--deltas', action='store_true', help='store only the changed blocks of each snapshot')
+    args = parser.parse_args()
+    out_prefix = args.out_dir.rstrip('/\\') + '/' + args.prefix
+
+    region = None
+    last_seq = None
+    count = 0
+    with open(args.file, 'rb') as f:
+        try:
+            for seq, full, region_size, blocks in read_snapshots(f):
+                if region is None or len(region) != region_size:
+                    if not full:  # We can't rebuild a delta without the full snapshot sent before it
+                        print(f"Skipping snapshot {seq}: no full snapshot received before it")
+                        continue
+                    region = bytearray(region_size)
+                for offset, data in blocks:
+                    region[offset:offset + len(data)] = data
+                last_seq = seq
+                count += 1
+                if args.deltas:
+                    with open(f"{out_prefix}_{seq:08d}.delta", 'wb') as out:
+                        for offset, data in blocks:
+                            out.write(BLOCK.pack(offset, len(data)))
+                            out.write(data)
+                elif not args.last_only:
+                    with open(f"{out_prefix}_{seq:08d}.bin", 'wb') as out:
+                        out.write(region)
+        except EOFError:
+            print("WARNING: The file ends with an incomplete snapshot, which was ignored")
+        except FormatError as e:
+            print(f"ERROR: {e}")
+            sys.exit(1)
+
+    if args.last_only and region is not None:
+        with open(f"{out_prefix}_{last_seq:08d}.bin", 'wb') as out:
+            out.write(region)
+    print(f"Rebuilt {count} snapshots")
+
+
+if __name__ == "__main__":
+    main()
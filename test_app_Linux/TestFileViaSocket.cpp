@@ -0,0 +1,147 @@
+/*
+This is the client side of the tests in test_file_via_socket.py, which compiles it (by g++) and runs it against
+the server script, or against a fake server played by the test. Each scenario writes a fixed sequence of data,
+so the test can check what the server received.
+
+Usage: TestFileViaSocket <scenario> <server port>    (the server runs on 127.0.0.1)
+Scenarios:
+  split_record     - a repeated record written in two pieces with the flush interval set (the fake server sets it),
+                     with the suppression of repeated records
+  control_requests - prints the requests of the server (verbosity, bulk pause, flush interval) and how the stream
+                     follows them; the line "withdraw" asks the fake server to withdraw the requests
+
+Details are explained on GitHub: https://github.com/viktor-nikolov/lwIP-file-via-socket
+
+BSD 2-Clause License:
+
+Copyright (c) 2024 Viktor Nikolov
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <thread>
+#include "FileViaSocket.h"
+
+const char SERVER_IP[]{ "127.0.0.1" };
+
+void sleepMs( int ms )
+{
+	std::this_thread::sleep_for( std::chrono::milliseconds( ms ) );
+}
+
+/* The fake server sends the flush interval right after the preamble. The records written in two pieces must pass
+ * the filter as whole records, even when the flush deferred by the interval is done between the pieces. */
+int splitRecord( unsigned short port )
+{
+	FileViaSocket f;
+	f.setControlChannel( true );
+	f.recordFilter().setRepeatSuppression( true, 10000 );
+	f.open( SERVER_IP, port );
+	sleepMs( 100 );        // The flush interval arrives
+	f << "start\n";
+	f.flush();             // The request of the server is read when the block is sent
+	if( f.flushIntervalMs() == 0 ) {
+		std::cerr << "The flush interval wasn't received" << std::endl;
+		return 1;
+	}
+	f << "first\n";
+	f.flush();             // Sent; the interval starts
+	for( int i = 0; i < 3; i++ ) {
+		f << "ERROR disk full\n";
+		f.flush();         // Deferred by the interval
+		sleepMs( int(f.flushIntervalMs()) * 2 );
+		f << "ERROR disk "; // The deferred data are sent now; the incomplete record must stay in the filter
+		f << "full\n";
+	}
+	f.close();
+	return f ? 0 : 1;
+} // splitRecord
+
+/* Prints the requests of the server as "<label>: verbosity <v> paused <0|1> interval <ms> bulk <bytes>",
+ * where bulk is the number of bytes writeFrom() sent (0 while bulk transfers are paused). */
+void printRequests( FileViaSocket &f, const char *label )
+{
+	std::streamsize bulk = f.writeFrom( []( char *dest, std::size_t maxLen ) {
+		std::memset( dest, 'B', maxLen );
+		return maxLen;
+	}, 1000 );
+	std::cout << label << ": verbosity " << f.verbosity() << " paused " << f.bulkPaused()
+	          << " interval " << f.flushIntervalMs() << " bulk " << bulk << std::endl;
+} // printRequests
+
+/* The fake server asks for a lower verbosity, the pause of bulk transfers and the flush interval after the preamble,
+ * and withdraws the requests when it receives the line "withdraw". */
+int controlRequests( unsigned short port )
+{
+	FileViaSocket f;
+	f.setControlChannel( true );
+	f.open( SERVER_IP, port );
+	sleepMs( 100 );        // The requests arrive
+	f << "start\n";
+	f.flush();             // The requests are read when the block is sent
+	printRequests( f, "requested" );
+
+	std::uint64_t flushes = f.stats().flushes;
+	for( int i = 0; i < 10; i++ ) {
+		f << "line " << i << '\n';
+		f.flush();         // The first one is sent, the others are deferred by the interval
+	}
+	std::cout << "flushes " << f.stats().flushes - flushes << std::endl;
+
+	f << "withdraw\n";
+	f.flush();             // Deferred
+	flushes = f.stats().flushes;
+	f.flushIfDue();        // Not due yet
+	std::cout << "flushIfDue before the interval " << f.stats().flushes - flushes << std::endl;
+	sleepMs( int(f.flushIntervalMs()) + 50 );
+	f.flushIfDue();        // The application is idle; the deferred data are sent now
+	std::cout << "flushIfDue after the interval " << f.stats().flushes - flushes << std::endl;
+
+	sleepMs( 200 );        // The withdrawal arrives
+	f << "end\n";
+	f.flush();
+	printRequests( f, "withdrawn" );
+	f.close();
+	return f ? 0 : 1;
+} // controlRequests
+
+int main( int argc, char* argv[] )
+{
+	if( argc != 3 ) {
+		std::cerr << "Usage: TestFileViaSocket <scenario> <server port>" << std::endl;
+		return 2;
+	}
+	unsigned short port = (unsigned short)std::atoi( argv[2] );
+
+	try {
+		if( std::strcmp( argv[1], "split_record" ) == 0 )
+			return splitRecord( port );
+		if( std::strcmp( argv[1], "control_requests" ) == 0 )
+			return controlRequests( port );
+	}
+	catch( const std::exception &e ) {
+		std::cerr << "Exception: " << e.what() << std::endl;
+		return 1;
+	}
+	std::cerr << "Unknown scenario " << argv[1] << std::endl;
+	return 2;
+} // main
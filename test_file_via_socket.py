@@ -0,0 +1,496 @@
+# Tests of the server side script file_via_socket.py. Each test starts the script on a free port of the loopback,
+# with the files stored to a temporary directory, and plays the clients by plain sockets.
+# The tests of the client library run test_app_Linux/TestFileViaSocket.cpp (compiled by g++; skipped without it)
+# against the script, or against a fake server.
+# For details see the GitHub repository https://github.com/viktor-nikolov/lwIP-file-via-socket
+#
+# Run the tests with the command 'python3 test_file_via_socket.py' (Linux; the tests of --direct_io need
+# a file system supporting O_DIRECT, e.g., ext4 or xfs, for the temporary directory; set TMPDIR to change it).
+#
+# BSD 2-Clause License:
+#
+# Copyright (c) 2024 Viktor Nikolov
+#
+# Redistribution and use in source and binary forms, with or without
+# modification, are permitted provided that the following conditions are met:
+# 1. Redistributions of source code must retain the above copyright notice, this
+#    list of conditions and the following disclaimer.
+# 2. Redistributions in binary form must reproduce the above copyright notice,
+#    this list of conditions and the following disclaimer in the documentation
+#    and/or other materials provided with the distribution.
+# THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+# AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+# IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+# DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+# FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+# DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+# SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+# CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+# OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+# OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+import os
+import shutil
+import socket
+import struct
+import subprocess
+import sys
+import tempfile
+import threading
+import time
+import unittest
+
+REPO = os.path.dirname(os.path.abspath(__file__))
+SCRIPT = os.path.join(REPO, "file_via_socket.py")
+CLIENT_SOURCES = ["test_app_Linux/TestFileViaSocket.cpp", "FileViaSocket.cpp", "BlockCompressor.cpp", "RecordFilter.cpp"]
+
+# Framing as file_via_socket.py decodes it
+PREAMBLE_ECHO = b"\x89FVS\r\n\x1a\n" + bytes([1, 0x01, 0, 0])  # Version 1, the echoes are requested
+PREAMBLE_SIZE = len(PREAMBLE_ECHO)
+FRAME_HEADER = struct.Struct("<BI")
+FRAME_RAW = 0
+FRAME_LZ4 = 1
+FRAME_TIMESTAMP = 2
+TIMESTAMP_PAYLOAD = struct.Struct("<IQQ")
+ECHO_MESSAGE = struct.Struct("<BHIQQQQ")
+SERVER_MESSAGE_VERBOSITY = 2
+SERVER_MESSAGE_BULK_PAUSE = 3
+SERVER_MESSAGE_FLUSH_INTERVAL = 4
+CONTROL_MESSAGE_U8 = struct.Struct("<BHB")
+CONTROL_MESSAGE_U32 = struct.Struct("<BHI")
+PREAMBLE_CONTROL = PREAMBLE_ECHO[:9] + bytes([0x02, 0, 0])  # The client accepts control requests
+
+
+def control_requests(verbosity, paused, flush_interval_ms):
+    return (CONTROL_MESSAGE_U8.pack(SERVER_MESSAGE_VERBOSITY, 1, verbosity) +
+            CONTROL_MESSAGE_U8.pack(SERVER_MESSAGE_BULK_PAUSE, 1, paused) +
+            CONTROL_MESSAGE_U32.pack(SERVER_MESSAGE_FLUSH_INTERVAL, 4, flush_interval_ms))
+
+client_binary = None  # TestFileViaSocket compiled by build_client()
+
+# Runs the script with its output files written no faster than the given rate (a slow disk).
+# Arguments: MB/s, directory of the output files, the script, its options.
+THROTTLED_SCRIPT = """
+import builtins, runpy, sys, time
+rate, directory = float(sys.argv[1]) * 1e6, sys.argv[2]
+real_open = builtins.open
+
+class ThrottledFile:
+    def __init__(self, f):
+        self.f = f
+    def write(self, data):
+        time.sleep(len(data) / rate)
+        return self.f.write(data)
+    def __getattr__(self, name):
+        return getattr(self.f, name)
+
+def throttled_open(file, mode='r', *args, **kwargs):
+    f = real_open(file, mode, *args, **kwargs)
+    return ThrottledFile(f) if mode == 'wb' and str(file).startswith(directory) else f
+
+builtins.open = throttled_open
+sys.argv = sys.argv[3:]
+runpy.run_path(sys.argv[0], run_name='__main__')
+"""
+
+
+def build_client():
+    # Compiles the test client once; returns None when there is no compiler
+    global client_binary
+    if client_binary is None:
+        if shutil.which("g++") is None:
+            return None
+        client_dir = tempfile.mkdtemp()
+        client_binary = os.path.join(client_dir, "TestFileViaSocket")
+        subprocess.run(["g++", "-std=c++17", "-O2", "-I", REPO, "-o", client_binary] +
+                       [os.path.join(REPO, source) for source in CLIENT_SOURCES] + ["-lpthread"], check=True)
+    return client_binary
+
+
+def run_client(scenario, port, timeout=30):
+    binary = build_client()
+    if binary is None:
+        raise unittest.SkipTest("g++ isn't available for compiling the test client")
+    return subprocess.run([binary, scenario, str(port)], capture_output=True, text=True, timeout=timeout)
+
+
+def raw_frames(stream):
+    # Concatenated payloads of the raw frames of a framed session (the preamble included)
+    data = bytearray()
+    pos = PREAMBLE_SIZE
+    while pos + FRAME_HEADER.size <= len(stream):
+        frame_type, length = FRAME_HEADER.unpack_from(stream, pos)
+        if frame_type == FRAME_RAW:
+            data += stream[pos + FRAME_HEADER.size:pos + FRAME_HEADER.size + length]
+        pos += FRAME_HEADER.size + length
+    return bytes(data)
+
+
+class Server:
+    # The script running in a subprocess; its output is collected by a thread
+    def __init__(self, *options, write_rate=None):
+        # write_rate - MB/s, at which the script writes the files (see THROTTLED_SCRIPT); not limited by default
+        self.dir = tempfile.TemporaryDirectory()
+        with socket.socket() as s:
+            s.bind(("127.0.0.1", 0))
+            self.port = s.getsockname()[1]
+        script = [SCRIPT] if write_rate is None else ["-c", THROTTLED_SCRIPT, str(write_rate), self.dir.name, SCRIPT]
+        self.process = subprocess.Popen([sys.executable, "-u"] + script + ["--path", self.dir.name, "--bind_ip", "127.0.0.1",
+                                         "--bind_port", str(self.port)] + list(options),
+                                        stdout=subprocess.PIPE, stderr=subprocess.STDOUT, text=True)
+        self.output = []
+        ready = threading.Event()
+
+        def collect():
+            for line in self.process.stdout:
+                self.output.append(line)
+                if line.startswith("Waiting for connection"):
+                    ready.set()
+            ready.set()
+        threading.Thread(target=collect, daemon=True).start()
+        if not ready.wait(10) or self.process.poll() is not None:
+            raise RuntimeError("The server didn't start:\n" + "".join(self.output))
+
+    def connect(self):
+        deadline = time.monotonic() + 10
+        while True:  # The script prints that it's waiting before it binds the port
+            try:
+                return socket.create_connection(("127.0.0.1", self.port))
+            except ConnectionRefusedError:
+                if time.monotonic() > deadline:
+                    raise
+                time.sleep(0.05)
+
+    def files(self):
+        return sorted(os.path.join(self.dir.name, name) for name in os.listdir(self.dir.name))
+
+    def wait_for_files(self, expected, timeout):
+        # Waits till the files have the expected contents (in any order); returns the contents found last
+        deadline = time.monotonic() + timeout
+        expected = sorted(expected)
+        while True:
+            contents = []
+            for name in self.files():
+                with open(name, 'rb') as f:
+                    contents.append(f.read())
+            if sorted(contents) == expected or time.monotonic() > deadline or self.process.poll() is not None:
+                return sorted(contents)
+            time.sleep(0.1)
+
+    def wait_for_output(self, prefix, timeout):
+        # Waits till the script prints a line starting with the prefix; returns False on the timeout
+        deadline = time.monotonic() + timeout
+        while not any(line.startswith(prefix) for line in self.output):
+            if time.monotonic() > deadline:
+                return False
+            time.sleep(0.05)
+        return True
+
+    def stop(self):
+        self.process.terminate()
+        self.process.wait(10)
+        self.process.stdout.close()
+        self.dir.cleanup()
+
+
+class FakeServer:
+    # Listener accepting one session and collecting the whole session. It sends the messages after the preamble,
+    # and each of the replies when the data received so far contain its trigger.
+    def __init__(self, messages, replies=()):
+        self.listener = socket.create_server(("127.0.0.1", 0))
+        self.listener.settimeout(30)
+        self.port = self.listener.getsockname()[1]
+        self.received = bytearray()
+        self.thread = threading.Thread(target=self.serve, args=(messages, list(replies)), daemon=True)
+        self.thread.start()
+
+    def serve(self, messages, replies):
+        conn, _ = self.listener.accept()
+        with conn:
+            while len(self.received) < PREAMBLE_SIZE:
+                data = conn.recv(4096)
+                if not data:
+                    return
+                self.received += data
+            conn.sendall(messages)
+            while True:
+                data = conn.recv(65536)
+                if not data:
+                    return  # Closing the connection lets the client's close() finish
+                self.received += data
+                while replies and replies[0][0] in self.received:
+                    conn.sendall(replies.pop(0)[1])
+
+    def join(self):
+        self.thread.join(10)
+        self.listener.close()
+        return bytes(self.received)
+
+
+class ClientFilterTest(unittest.TestCase):
+    def test_split_record_with_flush_interval(self):
+        # A deferred flush happens between the two pieces of a repeated record; the client used to send the first
+        # piece unfiltered then, so the repeats weren't suppressed and the file got broken lines
+        server = FakeServer(CONTROL_MESSAGE_U32.pack(SERVER_MESSAGE_FLUSH_INTERVAL, 4, 50))
+        result = run_client("split_record", server.port)
+        lines = raw_frames(server.join()).decode().splitlines()
+        self.assertEqual(result.returncode, 0, result.stderr)
+        self.assertEqual(lines[:3], ["start", "first", "ERROR disk full"])
+        self.assertEqual(lines.count("ERROR disk full"), 1, f"the repeats weren't suppressed: {lines}")
+        self.assertEqual(lines[3:], ["[repeated 5 times] ERROR disk full"])
+
+
+class MalformedFrameTest(unittest.TestCase):
+    def setUp(self):
+        self.server = Server()
+
+    def tearDown(self):
+        self.server.stop()
+
+    def test_malformed_frames_close_only_their_session(self):
+        # A malformed frame used to raise an exception other than ValueError, which killed the script;
+        # a huge frame length made it buffer whatever the client sent
+        preamble = PREAMBLE_ECHO[:9] + bytes([0, 0, 0])  # No echoes
+        malformed = [
+            FRAME_HEADER.pack(FRAME_TIMESTAMP, 3) + b"abc",                  # Truncated timestamp
+            FRAME_HEADER.pack(FRAME_LZ4, 2) + b"ab",                         # Truncated raw length
+            FRAME_HEADER.pack(FRAME_LZ4, 6) + struct.pack("<I", 100) + b"\xf0\x01",  # Truncated LZ4 block
+            FRAME_HEADER.pack(FRAME_LZ4, 8) + struct.pack("<I", 1 << 30) + b"\x10abc",  # Huge raw length
+            FRAME_HEADER.pack(FRAME_RAW, 0xFFFFFFFF) + b"x" * 1000,            # Huge frame
+        ]
+        good = self.server.connect()
+        good.sendall(preamble + FRAME_HEADER.pack(FRAME_RAW, 6) + b"first\n")
+        for frames in malformed:
+            with self.server.connect() as conn:
+                conn.sendall(preamble + FRAME_HEADER.pack(FRAME_RAW, 3) + b"ok\n" + frames)
+                conn.settimeout(10)
+                self.assertEqual(conn.recv(100), b"", "the malformed session wasn't closed")
+        good.sendall(FRAME_HEADER.pack(FRAME_RAW, 7) + b"second\n")
+        good.close()
+        contents = self.server.wait_for_files([b"first\nsecond\n"] + [b"ok\n"] * len(malformed), 10)
+        self.assertIsNone(self.server.process.poll(), "the script died:\n" + "".join(self.server.output))
+        self.assertEqual(contents, sorted([b"first\nsecond\n"] + [b"ok\n"] * len(malformed)))
+        self.assertEqual(sum("Corrupted framed session" in line for line in self.server.output), len(malformed))
+
+
+class ClientControlTest(unittest.TestCase):
+    def test_client_follows_requests(self):
+        # The requests of the server take effect, flushes are coalesced by the interval, flushIfDue() sends
+        # the deferred data only when the interval elapsed, and the withdrawal restores the defaults
+        server = FakeServer(control_requests(2, 1, 100), [(b"withdraw\n", control_requests(255, 0, 0))])
+        result = run_client("control_requests", server.port)
+        lines = raw_frames(server.join()).decode()
+        self.assertEqual(result.returncode, 0, result.stderr)
+        self.assertEqual(result.stdout.splitlines(), [
+            "requested: verbosity 2 paused 1 interval 100 bulk 0",
+            "flushes 1",
+            "flushIfDue before the interval 0",
+            "flushIfDue after the interval 1",
+            "withdrawn: verbosity 255 paused 0 interval 0 bulk 1000"])
+        self.assertEqual(lines, "start\n" + "".join(f"line {i}\n" for i in range(10)) + "withdraw\nend\n" + "B" * 1000)
+
+
+class OverloadControlTest(unittest.TestCase):
+    def setUp(self):
+        # The simulated disk is slow, so the bulk data fill the budget
+        self.server = Server("--memory_budget", "1", "--overload_control", "2", write_rate=2)
+
+    def tearDown(self):
+        self.server.stop()
+
+    def test_requests_sent_and_withdrawn(self):
+        # Two bulk sessions fill more than a half of the budget (each may use a third of it); the session with
+        # the control channel gets the requests, and their withdrawal when the waiting data are written
+        control = self.server.connect()
+        control.sendall(PREAMBLE_CONTROL)
+        control.settimeout(30)
+        time.sleep(0.2)
+        bulks = [self.server.connect() for _ in range(2)]
+        for bulk in bulks:
+            bulk.setsockopt(socket.SOL_SOCKET, socket.SO_SNDBUF, 64 * 1024)
+        stop = threading.Event()
+
+        def send_bulk(bulk):
+            try:
+                while not stop.is_set():
+                    bulk.sendall(b"x" * 4095 + b"\n")
+            except OSError:
+                pass  # Shut down below
+        threads = [threading.Thread(target=send_bulk, args=(bulk,)) for bulk in bulks]
+        for t in threads:
+            t.start()
+        expected = [control_requests(2, 1, 100), control_requests(255, 0, 0)]
+        received = b""
+        try:
+            while len(received) < len(expected[0]):
+                received += control.recv(4096)
+        finally:
+            stop.set()
+            for bulk in bulks:
+                bulk.shutdown(socket.SHUT_RDWR)
+                bulk.close()
+            for t in threads:
+                t.join(10)
+        self.assertEqual(received, expected[0], "the requests weren't sent")
+        while len(received) < len(expected[0]) + len(expected[1]):  # The waiting data are being written
+            data = control.recv(4096)
+            if not data:
+                break
+            received += data
+        control.close()
+        self.assertEqual(received, expected[0] + expected[1], "the requests weren't withdrawn")
+        self.assertTrue(self.server.wait_for_output("Not overloaded anymore", 5))
+        self.assertTrue(any(line.startswith("Overloaded") for line in self.server.output))
+
+
+class DirectIOTest(unittest.TestCase):
+    def setUp(self):
+        self.server = Server("--direct_io", "--direct_io_threads", "1")  # 4 buffers
+
+    def tearDown(self):
+        self.server.stop()
+
+    def test_more_sessions_than_buffers(self):
+        # Each session takes a buffer by its first bytes and keeps it; the sessions over the number of buffers
+        # must get one too (the receiving loop used to wait for a free buffer forever)
+        sessions = 6
+        data = [bytes([65 + i]) * 5000 + os.urandom(5 * 1024 * 1024 + 123 * i) for i in range(sessions)]
+        conns = [self.server.connect() for _ in range(sessions)]
+        for conn, d in zip(conns, data):
+            conn.sendall(d[:5000])
+        time.sleep(0.5)
+
+        def send(conn, d):
+            conn.sendall(d[5000:])
+            conn.close()
+        threads = [threading.Thread(target=send, args=(conn, d)) for conn, d in zip(conns, data)]
+        for t in threads:
+            t.start()
+        for t in threads:
+            t.join(30)
+            self.assertFalse(t.is_alive(), "a client is blocked; the server stopped reading")
+        if any("O_DIRECT isn't supported" in line for line in self.server.output):
+            self.skipTest("the file system of the temporary directory doesn't support O_DIRECT")
+        contents = self.server.wait_for_files(data, 30)
+        self.assertEqual(len(contents), sessions)
+        self.assertTrue(contents == sorted(data), "the files differ from the data sent")
+
+
+
+class SlowClientLatencyTest(unittest.TestCase):
+    WRITE_RATE = 10      # MB/s of the simulated disk
+    DURATION = 3         # Seconds the clients send
+    LINE_INTERVAL = 0.01
+
+    def measure(self, *options):
+        # A bulk client sends as fast as it can, while a slow client sends a short line every 10 ms and measures
+        # the time till the echo of the line, i.e., till the line is written. Returns the latencies in ms.
+        server = Server(*options, write_rate=self.WRITE_RATE)
+        try:
+            bulk = server.connect()
+            stop = threading.Event()
+
+            def send_bulk():
+                try:
+                    while not stop.is_set():
+                        bulk.sendall(b"x" * 65535 + b"\n")
+                except OSError:
+                    pass  # Shut down below
+            bulk_thread = threading.Thread(target=send_bulk)
+            bulk_thread.start()
+            time.sleep(0.5)  # The bulk data fill the buffers (and the budget)
+
+            slow = server.connect()
+            slow.sendall(PREAMBLE_ECHO)
+            lines = int(self.DURATION / self.LINE_INTERVAL)
+            arrivals = {}
+
+            def read_echoes():
+                received = b""
+                while len(arrivals) < lines:
+                    data = slow.recv(4096)
+                    if not data:
+                        return
+                    received += data
+                    while len(received) >= ECHO_MESSAGE.size:
+                        arrivals[ECHO_MESSAGE.unpack_from(received)[2]] = time.monotonic_ns()
+                        received = received[ECHO_MESSAGE.size:]
+            reader = threading.Thread(target=read_echoes)
+            reader.start()
+            sent = []
+            for seq in range(lines):
+                now = time.monotonic_ns()
+                sent.append(now)
+                line = f"line {seq}\n".encode()
+                slow.sendall(FRAME_HEADER.pack(FRAME_TIMESTAMP, TIMESTAMP_PAYLOAD.size) +
+                             TIMESTAMP_PAYLOAD.pack(seq, now, now) + FRAME_HEADER.pack(FRAME_RAW, len(line)) + line)
+                time.sleep(self.LINE_INTERVAL)
+            reader.join(30)
+            stop.set()
+            bulk.shutdown(socket.SHUT_RDWR)
+            bulk_thread.join(10)
+            bulk.close()
+            slow.close()
+            self.assertEqual(len(arrivals), lines, "echoes are missing")
+            return sorted((arrivals[seq] - sent[seq]) / 1e6 for seq in range(lines))
+        finally:
+            server.stop()
+
+    def test_slow_client_with_memory_budget(self):
+        # With the budget, the slow client waits for at most one round of the writing thread: the quantum (64 KB)
+        # of the bulk session and its own line, i.e., about 7 ms at 10 MB/s
+        with_budget = self.measure("--memory_budget", "16")
+        without_budget = self.measure()
+        p99 = [latencies[int(len(latencies) * 0.99)] for latencies in (with_budget, without_budget)]
+        print(f"\nSlow client latency p99 at {self.WRITE_RATE} MB/s: {p99[0]:.2f} ms with --memory_budget 16, "
+              f"{p99[1]:.2f} ms without it", file=sys.stderr)
+        self.assertLess(p99[0], 30, "the slow client waits for the bulk client")
+
+
+class EchoTest(unittest.TestCase):
+    def setUp(self):
+        self.server = Server("--memory_budget", "64")
+
+    def tearDown(self):
+        self.server.stop()
+
+    def test_echo_after_write(self):
+        # With the memory budget, the data wait for the writing thread; the echo of a block must come only when
+        # the block is in the file (the script used to echo when the block was queued)
+        blocks, block_size = 256, 16 * 1024  # The script rejects frames much longer than the client's blocks
+        conn = self.server.connect()
+        stream = bytearray(PREAMBLE_ECHO)
+        for seq in range(blocks):
+            now = time.monotonic_ns()
+            stream += FRAME_HEADER.pack(FRAME_TIMESTAMP, TIMESTAMP_PAYLOAD.size) + TIMESTAMP_PAYLOAD.pack(seq, now, now)
+            stream += FRAME_HEADER.pack(FRAME_RAW, block_size) + bytes([65 + seq % 26]) * block_size
+        echoes = []  # (echo, size of the file when the echo arrived)
+
+        def read_echoes():
+            received = b""
+            while True:
+                data = conn.recv(4096)
+                if not data:
+                    return
+                received += data
+                while len(received) >= ECHO_MESSAGE.size:
+                    files = self.server.files()
+                    size = os.path.getsize(files[0]) if files else 0
+                    echoes.append((ECHO_MESSAGE.unpack_from(received), size))
+                    received = received[ECHO_MESSAGE.size:]
+        reader = threading.Thread(target=read_echoes)
+        reader.start()
+        conn.sendall(stream)
+        conn.shutdown(socket.SHUT_WR)
+        reader.join(30)
+        conn.close()
+        self.assertFalse(reader.is_alive(), "the connection wasn't closed")
+        self.assertEqual([echo[2] for echo, _ in echoes], list(range(blocks)), "echoes are missing")
+        for echo, size in echoes:
+            seq, receive_ns, write_ns = echo[2], echo[5], echo[6]
+            self.assertGreaterEqual(size, (seq + 1) * block_size, f"block {seq} was echoed before it was written")
+            self.assertGreaterEqual(write_ns, receive_ns)
+
+
+if __name__ == '__main__':
+    unittest.main()
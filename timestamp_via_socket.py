@@ -0,0 +1,176 @@
+# This script converts the hardware timestamps of the records in a file received by file_via_socket.py
+# (see SocketBuffer::setTimestamps) to the wall-clock time.
+# For details see the GitHub repository https://github.com/viktor-nikolov/lwIP-file-via-socket
+#
+# Run the script with the command 'python3 timestamp_via_socket.py [params] file'.
+#
+# usage: timestamp_via_socket [-h] [--out OUT] [--unix] [--anchor ANCHOR] file
+#
+# options:
+#   -h, --help              Show help message and exit
+#   --out OUT               Output file; defaults to the standard output
+#   --unix                  Write Unix time (seconds) instead of local date and time
+#   --anchor ANCHOR         Wall-clock time of the first calibration record ("YYYY-MM-DD HH:MM:SS.ffffff" or Unix time)
+#                           for devices without a wall clock; defaults to the time in the file name
+#
+# BSD 2-Clause License:
+#
+# Copyright (c) 2024 Viktor Nikolov
+#
+# Redistribution and use in source and binary forms, with or without
+# modification, are permitted provided that the following conditions are met:
+# 1. Redistributions of source code must retain the above copyright notice, this
+#    list of conditions and the following disclaimer.
+# 2. Redistributions in binary form must reproduce the above copyright notice,
+#    this list of conditions and the following disclaimer in the documentation
+#    and/or other materials provided with the distribution.
+# THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+# AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+# IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+# DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+# FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+# DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+# SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+# CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+# OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+# OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+import argparse
+import mmap
+import os
+import re
+import struct
+import sys
+from datetime import datetime
+
+CALIBRATION = re.compile(rb"#FVS-CAL (hex|bin) ticks=([0-9a-f]{16}) hz=(\d+) wall_ns=(\d+)\n")
+HEX_TIMESTAMP = re.compile(rb"[0-9a-f]{16} ")
+BINARY_MARK = 0x1E
+FILE_NAME_TIME = re.compile(r"_(\d{6}_\d{6})\.(\d{4})")  # via_socket_240324_203824.6369.txt
+
+
+class Calibration:
+    # Conversion of the counter values to Unix time (in ns), valid from a calibration record till the next one
+    def __init__(self, ticks, hz, wall_ns):
+        self.ticks = ticks
+        self.hz = hz
+        self.wall_ns = wall_ns
+
+    def to_wall_ns(self, ticks):
+        delta = ticks - self.ticks
+        if delta < 0:  # The counter wrapped around (a 32-bit counter, or 64-bit after a reset)
+            delta += 1 << 64
+            if delta > 1 << 63:
+                delta -= 1 << 64
+        return self.wall_ns + delta * 1_000_000_000 // self.hz
+
+
+def find_calibrations(data, anchor_ns):
+    # Returns a list of (offset, format, Calibration). Between two records with the wall-clock time, the frequency
+    # of the counter is measured from them, which corrects the drift of the counter against the wall clock.
+    records = [(m.start(), m.group(1).decode(), int(m.group(2), 16), int(m.group(3)), int(m.group(4)))
+               for m in CALIBRATION.finditer(data)]
+    result = []
+    offset_ns = None  # Devices without wall clock: wall time = anchor + (counter time since the first record)
+    for i, (offset, fmt, ticks, hz, wall_ns) in enumerate(records):
+        if wall_ns == 0:
+            if anchor_ns is None:
+                raise ValueError("the device has no wall clock; use --anchor")
+            if offset_ns is None:
+                offset_ns = (anchor_ns, ticks, hz)
+            base_ns, base_ticks, base_hz = offset_ns
+            wall_ns = base_ns + (ticks - base_ticks) * 1_000_000_000 // base_hz
+        if i + 1 < len(records) and records[i + 1][4] != 0 and records[i + 1][2] > ticks:
+            measured = (records[i + 1][2] - ticks) * 1_000_000_000 // max(records[i + 1][4] - wall_ns, 1)
+            if abs(measured - hz) < hz // 100:  # Only a plausible correction (the clock wasn't set in between)
+                hz = measured
+        result.append((offset, fmt, Calibration(ticks, hz, wall_ns)))
+    return result
+
+
+def format_time(wall_ns, unix):
+    if unix:
+        return f"{wall_ns // 1_000_000_000}.{wall_ns % 1_000_000_000 // 1000:06d} ".encode()
+    t = datetime.fromtimestamp(wall_ns // 1_000_000_000)
+    return (t.strftime("%Y-%m-%d %H:%M:%S") + f".{wall_ns % 1_000_000_000 // 1000:06d} ").encode()
+
+
+def convert(data, calibrations, out, unix):
+    # Copies the records to out, replacing the timestamps. Returns the number of converted timestamps.
+    converted = 0
+    pos = 0
+    fmt = None
+    calibration = None
+    next_cal = 0
+    while pos < len(data):
+        if next_cal < len(calibrations) and pos == calibrations[next_cal][0]:
+            _, fmt, calibration = calibrations[next_cal]
+            next_cal += 1
+        ticks = None
+        if fmt == "bin" and data[pos] == BINARY_MARK and pos + 9 <= len(data):
+            ticks = struct.unpack_from("<Q", data, pos + 1)[0]
+            pos += 9
+        elif fmt == "hex" and HEX_TIMESTAMP.match(data, pos):
+            ticks = int(data[pos:pos + 16], 16)
+            pos += 17
+        if ticks is not None:
+            out.write(format_time(calibration.to_wall_ns(ticks), unix))
+            converted += 1
+        end = data.find(b"\n", pos)
+        end = len(data) if end < 0 else end + 1
+        out.write(data[pos:end])
+        pos = end
+    return converted
+
+
+def parse_anchor(text):
+    try:
+        return int(float(text) * 1_000_000_000)
+    except ValueError:
+        return int(datetime.strptime(text, "%Y-%m-%d %H:%M:%S.%f").timestamp() * 1_000_000_000)
+
+
+def main():
+    parser = argparse.ArgumentParser(prog="timestamp_via_socket",
+                                     description='Converts hardware timestamps of the records in a file '
+                                                 'received by file_via_socket.py to the wall-clock time.')
+    parser.add_argument('file', type=str, help='file received by file_via_socket.py')
+    parser.add_argument('--out', type=str, help='output file; defaults to the standard output')
+    parser.add_argument('--unix', action='store_true',
+                        help='write Unix time (seconds) instead of local date and time')
+    parser.add_argument('--anchor', type=str,
+                        help='wall-clock time of the first calibration record ("YYYY-MM-DD HH:MM:SS.ffffff" '
+                             'or Unix time) for devices without a wall clock; defaults to the time in the file name')
+    args = parser.parse_args()
+
+    anchor_ns = None
+    if args.anchor is not None:
+        anchor_ns = parse_anchor(args.anchor)
+    else:
+        m = FILE_NAME_TIME.search(os.path.basename(args.file))
+        if m:
+            anchor_ns = int(datetime.strptime(m.group(1) + m.group(2), "%y%m%d_%H%M%S%f").timestamp() * 1_000_000_000)
+
+    with open(args.file, 'rb') as f:
+        if os.fstat(f.fileno()).st_size == 0:
+            return
+        with mmap.mmap(f.fileno(), 0, access=mmap.ACCESS_READ) as data:
+            try:
+                calibrations = find_calibrations(data, anchor_ns)
+            except ValueError as e:
+                print(f"ERROR: {e}", file=sys.stderr)
+                sys.exit(1)
+            if not calibrations:
+                print("ERROR: The file contains no calibration record", file=sys.stderr)
+                sys.exit(1)
+            out = open(args.out, 'wb') if args.out is not None else sys.stdout.buffer
+            try:
+                converted = convert(data, calibrations, out, args.unix)
+            finally:
+                if args.out is not None:
+                    out.close()
+    print(f"Converted {converted} timestamps", file=sys.stderr)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,190 @@
+# This script trains a static dictionary for the compression of small flushed records
+# (see SocketBuffer::Compression::Dictionary) on a sample of the records, e.g., files received by file_via_socket.py.
+# It writes the dictionary twice: NAME.h with a C array for the client, and NAME.dict for the server
+# (file_via_socket.py --dict NAME.dict).
+# For details see the GitHub repository https://github.com/viktor-nikolov/lwIP-file-via-socket
+#
+# Run the script with the command 'python3 train_dictionary.py [params] file [file ...]'.
+#
+# usage: train_dictionary [-h] [--out OUT] [--size SIZE] [--segment SEGMENT] [--dmer DMER] [--max_input MAX_INPUT]
+#                         [--symbol SYMBOL] file [file ...]
+#
+# options:
+#   -h, --help              Show help message and exit
+#   --out OUT               Name of the output files (OUT.h and OUT.dict); defaults to "fvs_dictionary"
+#   --size SIZE             Size of the dictionary in bytes; defaults to 4096 (max. 32768)
+#   --segment SEGMENT       Length of the segments the dictionary is composed of; defaults to 64
+#   --dmer DMER             Length of the substrings, whose frequency is counted; defaults to 8
+#   --max_input MAX_INPUT   Max. megabytes of the samples read; defaults to 8
+#   --symbol SYMBOL         Name of the array in OUT.h; defaults to FVS_DICTIONARY
+#
+# BSD 2-Clause License:
+#
+# Copyright (c) 2024 Viktor Nikolov
+#
+# Redistribution and use in source and binary forms, with or without
+# modification, are permitted provided that the following conditions are met:
+# 1. Redistributions of source code must retain the above copyright notice, this
+#    list of conditions and the following disclaimer.
+# 2. Redistributions in binary form must reproduce the above copyright notice,
+#    this list of conditions and the following disclaimer in the documentation
+#    and/or other materials provided with the distribution.
+# THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+# AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+# IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+# DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+# FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+# DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+# SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+# CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+# OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+# OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+import argparse
+import os
+import sys
+from collections import Counter
+
+MAX_DICTIONARY_SIZE = 32768  # BlockCompressor::MAX_DICTIONARY_SIZE
+
+
+def dictionary_id(dictionary):
+    # ID of a static dictionary: FNV-1a hash of its data (as BlockCompressor::dictionaryId)
+    h = 2166136261
+    for b in dictionary:
+        h = ((h ^ b) * 16777619) & 0xFFFFFFFF
+    return h
+
+
+def read_records(files, max_bytes):
+    # Reads the records (lines) of the sample files, till max_bytes are read
+    records = []
+    total = 0
+    for name in files:
+        with open(name, 'rb') as f:
+            data = f.read(max_bytes - total)
+        for record in data.splitlines(keepends=True):
+            records.append(record)
+        total += len(data)
+        if total >= max_bytes:
+            break
+    return records
+
+
+def count_dmers(records, d):
+    # Number of records, in which each substring of length d occurs
+    freq = Counter()
+    for r in records:
+        freq.update({r[i:i + d] for i in range(len(r) - d + 1)})
+    return freq
+
+
+def best_segment(corpus, begin, end, freq, k, d):
+    # Finds the segment of length k in corpus[begin:end] with the highest score, i.e., the sum of the frequencies
+    # of the distinct substrings of length d in it. Substrings occurring in one record only don't count.
+    # Returns (score, segment begin, segment end).
+    active = Counter()  # Substrings in the current window
+    score = 0
+    best = (0, begin, begin)
+    for p in range(begin, end - d + 1):
+        dmer = corpus[p:p + d]
+        if active[dmer] == 0 and freq.get(dmer, 0) > 1:
+            score += freq[dmer]
+        active[dmer] += 1
+        first = p - (k - d)  # The window is the substrings starting at first..p
+        if first - 1 >= begin:  # The substring leaving the window
+            old = corpus[first - 1:first - 1 + d]
+            active[old] -= 1
+            if active[old] == 0 and freq.get(old, 0) > 1:
+                score -= freq[old]
+        if first >= begin and score > best[0]:
+            best = (score, first, p + d)
+    return best
+
+
+def train(records, size, k, d):
+    # Builds the dictionary of the best segments (the COVER algorithm): the corpus is split into epochs, the best
+    # segment of each epoch is selected, and the substrings it covers no longer count for the next segments.
+    corpus = b"".join(records)
+    freq = count_dmers(records, d)
+    epochs = max(1, size // k)
+    epoch_len = max(k, len(corpus) // epochs)
+    segments = []
+    total = 0
+    for begin in range(0, len(corpus), epoch_len):
+        if total >= size:
+            break
+        score, seg_begin, seg_end = best_segment(corpus, begin, min(len(corpus), begin + epoch_len), freq, k, d)
+        if score == 0:
+            continue
+        # The substrings, which don't occur in other records, are trimmed from both ends
+        while seg_end - seg_begin > d and freq.get(corpus[seg_begin:seg_begin + d], 0) <= 1:
+            seg_begin += 1
+        while seg_end - seg_begin > d and freq.get(corpus[seg_end - d:seg_end], 0) <= 1:
+            seg_end -= 1
+        segment = corpus[seg_begin:seg_end]
+        for i in range(len(segment) - d + 1):
+            freq[segment[i:i + d]] = 0
+        segments.append((score, segment))
+        total += len(segment)
+    # The best segments are placed at the end of the dictionary, i.e., closest to the data
+    segments.sort(key=lambda s: s[0])
+    return b"".join(segment for _, segment in segments)[-size:]
+
+
+def write_header(file_name, symbol, dictionary, dict_name, record_count):
+    with open(file_name, 'w') as f:
+        guard = symbol.upper() + "_H"
+        f.write(f"/* Static dictionary for SocketBuffer::Compression::Dictionary, generated by train_dictionary.py\n"
+                f" * from {record_count} records. ID {dictionary_id(dictionary):08x}; the server loads it by\n"
+                f" *   python3 file_via_socket.py --dict {dict_name}\n"
+                f" * Usage: f.setDictionary( {symbol}, sizeof({symbol}) ); */\n"
+                f"#ifndef {guard}\n#define {guard}\n\n"
+                f"static const unsigned char {symbol}[{len(dictionary)}] = {{\n")
+        for i in range(0, len(dictionary), 16):
+            f.write("\t" + ", ".join(f"0x{b:02x}" for b in dictionary[i:i + 16]) + ",\n")
+        f.write(f"}};\n\n#endif // {guard}\n")
+
+
+def main():
+    parser = argparse.ArgumentParser(prog="train_dictionary",
+                                     description='Trains a static dictionary for the compression of small flushed '
+                                                 'records on a sample of the records.')
+    parser.add_argument('file', type=str, nargs='+', help='sample of the records, e.g., a file received by file_via_socket.py')
+    parser.add_argument('--out', type=str, default="fvs_dictionary",
+                        help='name of the output files (OUT.h and OUT.dict); defaults to "fvs_dictionary"')
+    parser.add_argument('--size', type=int, default=4096,
+                        help=f'size of the dictionary in bytes; defaults to 4096 (max. {MAX_DICTIONARY_SIZE})')
+    parser.add_argument('--segment', type=int, default=64,
+                        help='length of the segments the dictionary is composed of; defaults to 64')
+    parser.add_argument('--dmer', type=int, default=8,
+                        help='length of the substrings, whose frequency is counted; defaults to 8')
+    parser.add_argument('--max_input', type=float, default=8,
+                        help='max. megabytes of the samples read; defaults to 8')
+    parser.add_argument('--symbol', type=str, default="FVS_DICTIONARY",
+                        help='name of the array in OUT.h; defaults to FVS_DICTIONARY')
+    args = parser.parse_args()
+    size = max(16, min(args.size, MAX_DICTIONARY_SIZE))
+    d = max(4, args.dmer)
+    k = max(d, args.segment)
+
+    try:
+        records = read_records(args.file, int(args.max_input * 1024 * 1024))
+    except OSError as e:
+        print(f"ERROR: {e}", file=sys.stderr)
+        sys.exit(1)
+    dictionary = train(records, size, k, d)
+    if not dictionary:
+        print("ERROR: The samples have no repeated content; the dictionary would be empty", file=sys.stderr)
+        sys.exit(1)
+
+    dict_name = args.out + ".dict"
+    with open(dict_name, 'wb') as f:
+        f.write(dictionary)
+    write_header(args.out + ".h", args.symbol, dictionary, os.path.basename(dict_name), len(records))
+    print(f"Dictionary of {len(dictionary)} bytes (ID {dictionary_id(dictionary):08x}) trained on {len(records)} records "
+          f"written to {args.out}.h and {dict_name}", file=sys.stderr)
+
+
+if __name__ == "__main__":
+    main()